@@ -8,3 +8,19 @@ target_include_directories(aseba_conf INTERFACE ${PROJECT_SOURCE_DIR}/aseba ${PR
 if (WIN32)
     target_compile_definitions(aseba_conf INTERFACE -DWIN32_LEAN_AND_MEAN -DNOMINMAX)
 endif()
+
+# Hosted VMs execute bytecode from a pre-decoded copy (see AsebaVMState::decoded). This adds a field to
+# AsebaVMState, so the definition must be seen by every target including vm.h, not only by the VM.
+if(CMAKE_C_COMPILER_ID MATCHES "GNU|Clang")
+    target_compile_definitions(aseba_conf INTERFACE -DASEBA_VM_PREDECODE)
+endif()
+
+# Hosted VMs can track which blocks of variables were written (see AsebaVMState::variablesDirty), so that
+# AsebaSendChangedVariables only compares those. This also adds a field to AsebaVMState.
+target_compile_definitions(aseba_conf INTERFACE -DASEBA_VM_DIRTY_VARIABLES)
+
+# Configure with -DASEBA_VM_PROFILER=ON to let hosted VMs count steps per address and per event, and the
+# time spent in native functions (see AsebaVMProfile). This also adds a field to AsebaVMState.
+if(ASEBA_VM_PROFILER)
+    target_compile_definitions(aseba_conf INTERFACE -DASEBA_VM_PROFILER)
+endif()
@@ -3,7 +3,6 @@
 
 #include <QDebug>
 #include <QQmlEngine>
-#include <sstream>
 
 Q_DECLARE_METATYPE(Aseba::Message*)
 
@@ -74,11 +73,11 @@ QString AsebaNode::setProgram(QVariantMap events, QString source) {
     compiler.setTargetDescription(m_robot->description());
     compiler.setCommonDefinitions(&commonDefinitions);
 
-    std::wistringstream input(source.toStdWString());
+    const std::wstring input(source.toStdWString());
     Aseba::BytecodeVector bytecode;
     unsigned allocatedVariablesCount;
     Aseba::Error error;
-    bool result = compiler.compile(input, bytecode, allocatedVariablesCount, error);
+    bool result = compiler.compile(std::wstring_view(input), bytecode, allocatedVariablesCount, error);
 
     if(!result) {
         qWarning() << QString::fromStdWString(error.toWString());
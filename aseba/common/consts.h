@@ -176,6 +176,7 @@ typedef enum
 	ASEBA_MESSAGE_NODE_PRESENT,
 	ASEBA_MESSAGE_DEVICE_INFO,
 	ASEBA_MESSAGE_CHANGED_VARIABLES,
+	ASEBA_MESSAGE_PROFILE_DATA, // VMs built with ASEBA_VM_PROFILER only
 
 	/* from IDE to all nodes */
 	ASEBA_MESSAGE_GET_DESCRIPTION = 0xA000,
@@ -207,6 +208,7 @@ typedef enum
 	ASEBA_MESSAGE_SET_DEVICE_INFO,  // v6
 	ASEBA_MESSAGE_GET_CHANGED_VARIABLES, // v7
 	ASEBA_MESSAGE_GET_NODE_DESCRIPTION_FRAGMENT, //v8
+	ASEBA_MESSAGE_GET_PROFILE_DATA, // VMs built with ASEBA_VM_PROFILER only
 
 	ASEBA_MESSAGE_INVALID = 0xFFFF
 } AsebaSystemMessagesTypes;
@@ -227,11 +229,20 @@ typedef enum {
 	DEVICE_INFO_ENUM_COUNT = 3
 } DeviceInfoType;
 
+/*! Counters of the VM profiler, requested by ASEBA_MESSAGE_GET_PROFILE_DATA */
+typedef enum {
+	ASEBA_PROFILE_PC_STEPS = 0,		/*!< steps executed at each address */
+	ASEBA_PROFILE_PC_NATIVE_TIME,	/*!< time spent in the native function called at each address */
+	ASEBA_PROFILE_EVENT_RUNS,		/*!< times each entry of the event vector was executed */
+	ASEBA_PROFILE_EVENT_STEPS,		/*!< steps executed by each entry of the event vector */
+} AsebaProfileCounters;
+
 
 /*! Limits for static buffers allocation */
 typedef enum
 {
 	ASEBA_MAX_EVENT_ARG_COUNT = 258,	/*!< Maximum number of arguments in an event (in word) */
+	ASEBA_MAX_PROFILE_DATA_COUNT = 128,	/*!< Maximum number of 32-bit counters in a profile data message */
 } AsebaLimits;
 
 /*! Maximum size of arguments in a user-defined event (in bytes) */
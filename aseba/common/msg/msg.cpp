@@ -56,6 +56,7 @@ public:
         registerMessageType<Disconnected>(ASEBA_MESSAGE_DISCONNECTED);
         registerMessageType<Variables>(ASEBA_MESSAGE_VARIABLES);
         registerMessageType<ChangedVariables>(ASEBA_MESSAGE_CHANGED_VARIABLES);
+        registerMessageType<ProfileData>(ASEBA_MESSAGE_PROFILE_DATA);
         registerMessageType<ArrayAccessOutOfBounds>(ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS);
         registerMessageType<DivisionByZero>(ASEBA_MESSAGE_DIVISION_BY_ZERO);
         registerMessageType<EventExecutionKilled>(ASEBA_MESSAGE_EVENT_EXECUTION_KILLED);
@@ -81,6 +82,7 @@ public:
         registerMessageType<GetVariables>(ASEBA_MESSAGE_GET_VARIABLES);
         registerMessageType<SetVariables>(ASEBA_MESSAGE_SET_VARIABLES);
         registerMessageType<GetChangedVariables>(ASEBA_MESSAGE_GET_CHANGED_VARIABLES);
+        registerMessageType<GetProfileData>(ASEBA_MESSAGE_GET_PROFILE_DATA);
         registerMessageType<SetVariables>(ASEBA_MESSAGE_SET_VARIABLES);
         registerMessageType<WriteBytecode>(ASEBA_MESSAGE_WRITE_BYTECODE);
         registerMessageType<Reboot>(ASEBA_MESSAGE_REBOOT);
@@ -703,6 +705,37 @@ void ChangedVariables::dumpSpecific(wostream& stream) const {
 
 //
 
+void ProfileData::serializeSpecific(SerializationBuffer& buffer) const {
+    buffer.add(counters);
+    buffer.add(start);
+    for(const auto value : values) {
+        buffer.add(uint16_t(value & 0xffff));
+        buffer.add(uint16_t(value >> 16));
+    }
+}
+
+void ProfileData::deserializeSpecific(SerializationBuffer& buffer) {
+    counters = buffer.get<uint16_t>();
+    start = buffer.get<uint16_t>();
+    values.resize((buffer.rawData.size() - buffer.readPos) / 4);
+    for(auto& value : values) {
+        const uint32_t low = buffer.get<uint16_t>();
+        const uint32_t high = buffer.get<uint16_t>();
+        value = low | (high << 16);
+    }
+}
+
+void ProfileData::dumpSpecific(wostream& stream) const {
+    stream << "counters " << counters << ", start " << start << ", values vector of size " << values.size();
+}
+
+bool operator==(const ProfileData& lhs, const ProfileData& rhs) {
+    return static_cast<const Message&>(lhs) == static_cast<const Message&>(rhs) && lhs.counters == rhs.counters &&
+        lhs.start == rhs.start && lhs.values == rhs.values;
+}
+
+//
+
 void ArrayAccessOutOfBounds::serializeSpecific(SerializationBuffer& buffer) const {
     buffer.add(pc);
     buffer.add(size);
@@ -990,6 +1023,35 @@ void sendBytecode(std::vector<std::shared_ptr<Message> >& messagesVector, uint16
     }
 }
 
+void sendBytecodeChanges(std::vector<std::shared_ptr<Message> >& messagesVector, uint16_t dest,
+                         const std::vector<uint16_t>& previous, const std::vector<uint16_t>& bytecode) {
+    const size_t bytecodePayloadSize = ASEBA_MAX_EVENT_ARG_COUNT - 2;
+    // Resending a few unchanged words costs less than the header of another message
+    const size_t maxUnchangedWords = 4;
+    const auto changed = [&](size_t i) { return i >= previous.size() || previous[i] != bytecode[i]; };
+
+    size_t start = 0;
+    while(start < bytecode.size()) {
+        if(!changed(start)) {
+            ++start;
+            continue;
+        }
+        // extend the range up to its last changed word, across short runs of unchanged ones
+        size_t end = start + 1;
+        for(size_t i = end; i < bytecode.size() && i - end < maxUnchangedWords; ++i) {
+            if(changed(i))
+                end = i + 1;
+        }
+        for(; start < end; start += bytecodePayloadSize) {
+            const size_t count = min(bytecodePayloadSize, end - start);
+            auto setBytecodeMessage = make_shared<SetBytecode>(dest, uint16_t(start));
+            setBytecodeMessage->bytecode.assign(bytecode.begin() + start, bytecode.begin() + start + count);
+            messagesVector.push_back(move(setBytecodeMessage));
+        }
+        start = end;
+    }
+}
+
 //
 
 bool operator==(const Reset& lhs, const Reset& rhs) {
@@ -1114,6 +1176,38 @@ GetChangedVariables::GetChangedVariables(uint16_t dest) : CmdMessage(ASEBA_MESSA
 
 //
 
+GetProfileData::GetProfileData(uint16_t dest, uint16_t counters, uint16_t start, uint16_t length)
+    : CmdMessage(ASEBA_MESSAGE_GET_PROFILE_DATA, dest), counters(counters), start(start), length(length) {}
+
+void GetProfileData::serializeSpecific(SerializationBuffer& buffer) const {
+    CmdMessage::serializeSpecific(buffer);
+
+    buffer.add(counters);
+    buffer.add(start);
+    buffer.add(length);
+}
+
+void GetProfileData::deserializeSpecific(SerializationBuffer& buffer) {
+    CmdMessage::deserializeSpecific(buffer);
+
+    counters = buffer.get<uint16_t>();
+    start = buffer.get<uint16_t>();
+    length = buffer.get<uint16_t>();
+}
+
+void GetProfileData::dumpSpecific(wostream& stream) const {
+    CmdMessage::dumpSpecific(stream);
+
+    stream << "counters " << counters << ", start " << start << ", length " << length;
+}
+
+bool operator==(const GetProfileData& lhs, const GetProfileData& rhs) {
+    return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs) &&
+        lhs.counters == rhs.counters && lhs.start == rhs.start && lhs.length == rhs.length;
+}
+
+//
+
 SetVariables::SetVariables(uint16_t dest, uint16_t start, VariablesDataVector variables)
     : CmdMessage(ASEBA_MESSAGE_SET_VARIABLES, dest), start(start), variables(std::move(variables)) {}
 
@@ -436,6 +436,27 @@ protected:
 
 bool operator==(const Variables& lhs, const Variables& rhs);
 
+//! Some execution counters of a node, see AsebaProfileCounters
+class ProfileData : public Message {
+public:
+    uint16_t counters;
+    uint16_t start;
+    std::vector<uint32_t> values;
+
+public:
+    ProfileData() : Message(ASEBA_MESSAGE_PROFILE_DATA) {}
+
+protected:
+    void serializeSpecific(SerializationBuffer& buffer) const override;
+    void deserializeSpecific(SerializationBuffer& buffer) override;
+    void dumpSpecific(std::wostream& stream) const override;
+    operator const char*() const override {
+        return "profile data";
+    }
+};
+
+bool operator==(const ProfileData& lhs, const ProfileData& rhs);
+
 //! Exception: an array acces attempted to read past memory
 class ArrayAccessOutOfBounds : public Message {
 public:
@@ -712,6 +733,11 @@ void sendBytecode(std::vector<std::unique_ptr<Message> >& messagesVector, uint16
 void sendBytecode(std::vector<std::shared_ptr<Message> >& messagesVector, uint16_t dest,
                   const std::vector<uint16_t>& bytecode);
 
+//! Call the SetBytecode multiple time in order to send only the words of bytecode differing from previous,
+//! the bytecode known to be on the node. No message is added if both are identical.
+void sendBytecodeChanges(std::vector<std::shared_ptr<Message> >& messagesVector, uint16_t dest,
+                         const std::vector<uint16_t>& previous, const std::vector<uint16_t>& bytecode);
+
 //! Reset a node
 class Reset : public CmdMessage {
 public:
@@ -876,6 +902,28 @@ protected:
     }
 };
 
+//! Read some execution counters from a node, which only answers if it is profiling
+class GetProfileData : public CmdMessage {
+public:
+    uint16_t counters;
+    uint16_t start;
+    uint16_t length;
+
+public:
+    GetProfileData() : CmdMessage(ASEBA_MESSAGE_GET_PROFILE_DATA, ASEBA_DEST_INVALID) {}
+    GetProfileData(uint16_t dest, uint16_t counters, uint16_t start, uint16_t length);
+
+protected:
+    void serializeSpecific(SerializationBuffer& buffer) const override;
+    void deserializeSpecific(SerializationBuffer& buffer) override;
+    void dumpSpecific(std::wostream& stream) const override;
+    operator const char*() const override {
+        return "get profile data";
+    }
+};
+
+bool operator==(const GetProfileData& lhs, const GetProfileData& rhs);
+
 //! Set some variables on a node
 class SetVariables : public CmdMessage {
 public:
@@ -184,14 +184,18 @@ std::string WStringToUTF8(const std::wstring& s) {
  *  - Or a multiple-codepoint grapheme
  */
 bool is_utf8_alpha_num(wchar_t c) {
+    // most characters of programs are ASCII, which do not need the locale
+    if(c < 128)
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 #ifdef ANDROID
     return std::isalnum(c);
 #endif
 #ifdef _WIN32
     return IsCharAlphaNumericW(c);
 #else
-    static std::locale utf8Locale("en_US.UTF-8");
-    return std::isalnum(c, utf8Locale);
+    static const std::locale utf8Locale("en_US.UTF-8");
+    static const auto& ctype = std::use_facet<std::ctype<wchar_t>>(utf8Locale);
+    return ctype.is(std::ctype_base::alnum, c);
 #endif
 }
 
@@ -223,8 +227,9 @@ released under the following license:
 * OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-std::wstring UTF8ToWString(const std::string& s) {
+std::wstring UTF8ToWString(std::string_view s) {
     std::wstring res;
+    res.reserve(s.size());
     size_t left(s.size());
     for(const char& c : s) {
         const char* a = &c;
@@ -22,6 +22,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cassert>
 #include <cstdlib>
 #include <vector>
@@ -176,7 +177,7 @@ public:
 std::string WStringToUTF8(const std::wstring& s);
 
 //! Transform a UTF8 string into a wstring, this function is thread-safe
-std::wstring UTF8ToWString(const std::string& s);
+std::wstring UTF8ToWString(std::string_view s);
 
 bool is_utf8_alpha_num(wchar_t c);
 
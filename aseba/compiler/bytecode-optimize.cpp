@@ -0,0 +1,303 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Created by Stéphane Magnenat <stephane at magnenat dot net> (http://stephane.magnenat.net)
+    with contributions from the community.
+    Copyright (C) 2007--2018 the authors, see authors.txt for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compiler.h"
+#include "common/consts.h"
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+namespace Aseba {
+/** \addtogroup compiler */
+/*@{*/
+
+/*
+ * Bytecode optimization: peephole and jump threading
+ *   - Works on each event and subroutine before linking, as their jumps are relative to themselves
+ *   - Instructions are decoded with their jump targets resolved to instructions, so that
+ *     instructions can be removed or replaced, and the jumps are re-encoded afterwards
+ *   - Kept instructions keep their words, hence the line of source code they were generated from
+ *   - Stores are never removed, even if their value is overwritten before being read: the variables can be
+ *     seen at any instruction, when an event is killed for running out of steps or when debugging
+ *   - If anything cannot be decoded or re-encoded (for instance a jump too far away after threading),
+ *     the bytecode is left unchanged
+ */
+
+namespace {
+    const size_t noTarget = SIZE_MAX;
+
+    //! An instruction, with the target of its jump if it is a jump or a conditional branch
+    struct Instruction {
+        std::vector<BytecodeElement> words;
+        size_t target = noTarget;  //!< index of the target instruction
+        bool removed = false;
+
+        unsigned type() const {
+            return words[0].bytecode >> 12;
+        }
+        unsigned argument() const {
+            return words[0].bytecode & 0x0fff;
+        }
+        bool isJump() const {
+            return type() == ASEBA_BYTECODE_JUMP || type() == ASEBA_BYTECODE_CONDITIONAL_BRANCH;
+        }
+        //! whether execution never continues with the next instruction
+        bool isTerminal() const {
+            return type() == ASEBA_BYTECODE_JUMP || type() == ASEBA_BYTECODE_STOP || type() == ASEBA_BYTECODE_SUB_RET;
+        }
+    };
+    using Instructions = std::vector<Instruction>;
+
+    //! Decode bytecode to instructions, return false if it is malformed
+    bool decode(const BytecodeVector& bytecode, Instructions& instructions) {
+        std::vector<size_t> indexAtAddress(bytecode.size(), noTarget);
+        for(size_t pc = 0; pc < bytecode.size();) {
+            const unsigned size = bytecode[pc].getWordSize();
+            if(pc + size > bytecode.size())
+                return false;
+            indexAtAddress[pc] = instructions.size();
+            instructions.emplace_back();
+            instructions.back().words.assign(bytecode.begin() + pc, bytecode.begin() + pc + size);
+            pc += size;
+        }
+
+        size_t pc = 0;
+        for(auto& instruction : instructions) {
+            int target = int(pc);
+            if(instruction.type() == ASEBA_BYTECODE_JUMP)
+                target += int16_t(instruction.words[0].bytecode << 4) >> 4;
+            else if(instruction.type() == ASEBA_BYTECODE_CONDITIONAL_BRANCH)
+                target += int16_t(instruction.words[1].bytecode);
+            if(instruction.isJump()) {
+                if(target < 0 || size_t(target) >= bytecode.size() || indexAtAddress[target] == noTarget)
+                    return false;
+                instruction.target = indexAtAddress[target];
+            }
+            pc += instruction.words.size();
+        }
+        return true;
+    }
+
+    //! Encode instructions which are not removed to bytecode, return false if a jump does not fit
+    bool encode(const Instructions& instructions, std::deque<BytecodeElement>& bytecode) {
+        std::vector<int> addresses(instructions.size());
+        int pc = 0;
+        for(size_t i = 0; i < instructions.size(); ++i) {
+            addresses[i] = pc;
+            if(!instructions[i].removed)
+                pc += int(instructions[i].words.size());
+        }
+
+        for(size_t i = 0; i < instructions.size(); ++i) {
+            const Instruction& instruction = instructions[i];
+            if(instruction.removed)
+                continue;
+            std::vector<BytecodeElement> words(instruction.words);
+            if(instruction.isJump()) {
+                assert(!instructions[instruction.target].removed);
+                const int disp = addresses[instruction.target] - addresses[i];
+                if(instruction.type() == ASEBA_BYTECODE_JUMP) {
+                    if(disp < -2048 || disp > 2047)
+                        return false;
+                    words[0].bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_JUMP) | (unsigned(disp) & 0x0fff);
+                } else
+                    words[1].bytecode = uint16_t(disp);
+            }
+            bytecode.insert(bytecode.end(), words.begin(), words.end());
+        }
+        return true;
+    }
+
+    //! Return the index of the next instruction not removed after i, or noTarget;
+    //! the first one if i is noTarget
+    size_t next(const Instructions& instructions, size_t i) {
+        for(++i; i < instructions.size(); ++i)
+            if(!instructions[i].removed)
+                return i;
+        return noTarget;
+    }
+
+    //! Make jumps go directly where the jumps they go to would go
+    bool threadJumps(Instructions& instructions) {
+        bool changed = false;
+        for(auto& instruction : instructions) {
+            if(instruction.removed || !instruction.isJump())
+                continue;
+            size_t target = instruction.target;
+            // bounded by the instructions count, in case of a loop of jumps
+            for(size_t hops = 0; hops < instructions.size(); ++hops) {
+                const Instruction& destination = instructions[target];
+                if(destination.type() != ASEBA_BYTECODE_JUMP || destination.target == target)
+                    break;
+                target = destination.target;
+            }
+            if(target != instruction.target) {
+                instruction.target = target;
+                changed = true;
+            }
+
+            // jump to the end, just end
+            const unsigned destinationType = instructions[target].type();
+            if(instruction.type() == ASEBA_BYTECODE_JUMP &&
+               (destinationType == ASEBA_BYTECODE_STOP || destinationType == ASEBA_BYTECODE_SUB_RET)) {
+                instruction.words.assign(
+                    1, BytecodeElement(instructions[target].words[0].bytecode, instruction.words[0].line));
+                instruction.target = noTarget;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    //! Remove the instructions that can never be executed
+    bool removeUnreachable(Instructions& instructions) {
+        std::vector<bool> reachable(instructions.size(), false);
+        std::vector<size_t> toVisit(1, next(instructions, noTarget));
+        while(!toVisit.empty()) {
+            size_t i = toVisit.back();
+            toVisit.pop_back();
+            // follow the flow until something already seen
+            while(i != noTarget && !reachable[i]) {
+                reachable[i] = true;
+                const Instruction& instruction = instructions[i];
+                if(instruction.isJump())
+                    toVisit.push_back(instruction.target);
+                i = instruction.isTerminal() ? noTarget : next(instructions, i);
+            }
+        }
+
+        bool changed = false;
+        for(size_t i = 0; i < instructions.size(); ++i) {
+            if(!instructions[i].removed && !reachable[i]) {
+                instructions[i].removed = true;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    //! Whether the pair first, second has no effect: "load x; store x", or a neutral element such as "+ 0"
+    bool isNeutralPair(const Instruction& first, const Instruction& second) {
+        if(first.type() == ASEBA_BYTECODE_LOAD && second.type() == ASEBA_BYTECODE_STORE)
+            return first.argument() == second.argument();
+
+        if(first.type() != ASEBA_BYTECODE_SMALL_IMMEDIATE || second.type() != ASEBA_BYTECODE_BINARY_ARITHMETIC)
+            return false;
+        const unsigned value = first.argument();
+        switch(second.words[0].bytecode & ASEBA_BINARY_OPERATOR_MASK) {
+            case ASEBA_OP_SHIFT_LEFT:
+            case ASEBA_OP_SHIFT_RIGHT:
+            case ASEBA_OP_ADD:
+            case ASEBA_OP_SUB:
+            case ASEBA_OP_BIT_OR:
+            case ASEBA_OP_BIT_XOR: return value == 0;
+            case ASEBA_OP_MULT:
+            case ASEBA_OP_DIV: return value == 1;
+            default: return false;
+        }
+    }
+
+    //! Remove jumps to the next instruction and sequences without effect
+    bool removeUseless(Instructions& instructions) {
+        // instructions that are jumped to cannot be the second of a pair
+        std::vector<bool> isTarget(instructions.size(), false);
+        for(const auto& instruction : instructions)
+            if(!instruction.removed && instruction.isJump())
+                isTarget[instruction.target] = true;
+
+        bool changed = false;
+        for(size_t i = next(instructions, noTarget); i != noTarget; i = next(instructions, i)) {
+            Instruction& instruction = instructions[i];
+            const size_t j = next(instructions, i);
+            if(j == noTarget)
+                break;
+
+            if(instruction.type() == ASEBA_BYTECODE_JUMP && instruction.target == j) {
+                instruction.removed = true;
+                changed = true;
+            } else if(!isTarget[j] && isNeutralPair(instruction, instructions[j]) &&
+                      next(instructions, j) != noTarget) {
+                instruction.removed = true;
+                instructions[j].removed = true;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    //! Make the jumps to removed instructions go to the next instruction not removed,
+    //! return false if there is none
+    bool retarget(Instructions& instructions) {
+        for(auto& instruction : instructions) {
+            if(instruction.removed || !instruction.isJump() || !instructions[instruction.target].removed)
+                continue;
+            instruction.target = next(instructions, instruction.target);
+            if(instruction.target == noTarget)
+                return false;
+        }
+        return true;
+    }
+
+    //! Optimize a bytecode vector in place, return whether it was changed
+    bool optimizeBytecode(BytecodeVector& bytecode) {
+        Instructions instructions;
+        if(!decode(bytecode, instructions))
+            return false;
+
+        bool changed = false;
+        bool wasActivity;
+        do {
+            wasActivity = threadJumps(instructions);
+            wasActivity = removeUnreachable(instructions) || wasActivity;
+            wasActivity = removeUseless(instructions) || wasActivity;
+            if(!retarget(instructions))
+                return false;
+            changed = changed || wasActivity;
+        } while(wasActivity);
+
+        std::deque<BytecodeElement> optimized;
+        if(!changed || !encode(instructions, optimized))
+            return false;
+        static_cast<std::deque<BytecodeElement>&>(bytecode) = std::move(optimized);
+        return true;
+    }
+}  // namespace
+
+//! Optimize the bytecode of events and subroutines, must be called after fixup()
+void PreLinkBytecode::optimize(std::wostream* dump) {
+    for(auto& event : events) {
+        const size_t size = event.second.size();
+        if(optimizeBytecode(event.second) && dump) {
+            *dump << "event " << event.first << ": " << size << " -> " << event.second.size() << " words\n";
+        }
+    }
+    for(auto& subroutine : subroutines) {
+        const size_t size = subroutine.second.size();
+        if(optimizeBytecode(subroutine.second) && dump) {
+            *dump << "subroutine " << subroutine.first << ": " << size << " -> " << subroutine.second.size()
+                  << " words\n";
+        }
+    }
+}
+
+/*@}*/
+
+}  // namespace Aseba
@@ -64,7 +64,9 @@ Compiler::Compiler() {
     commonDefinitions = nullptr;
     freeVariableIndex = 0;
     endVariableIndex = 0;
-    TranslatableError::setTranslateCB(ErrorMessages::defaultCallback);
+    maxEndVariableIndex = 0;
+    incremental = false;
+    vectorLoops = false;
 }
 
 //! Set the description of the target as returned by the microcontroller. You must call this
@@ -78,6 +80,14 @@ void Compiler::setCommonDefinitions(const CommonDefinitions* definitions) {
     commonDefinitions = definitions;
 }
 
+//! Keep the compiled events and subroutines between compilations, so that compile() only compiles again
+//! the ones which changed, see compileIncrementally()
+void Compiler::setIncrementalCompilation(bool enabled) {
+    incremental = enabled;
+    compiledSections.clear();
+    compiledSectionsContext.clear();
+}
+
 //! Compile a new condition
 //! \param source stream to read the source code from
 //! \param bytecode destination array for bytecode
@@ -87,9 +97,38 @@ void Compiler::setCommonDefinitions(const CommonDefinitions* definitions) {
 //! \return returns true on success
 bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
                        Error& errorDescription, std::wostream* dump) {
+    const std::wstring text((std::istreambuf_iterator<wchar_t>(source)), std::istreambuf_iterator<wchar_t>());
+    return compile(std::wstring_view(text), bytecode, allocatedVariablesCount, errorDescription, dump);
+}
+
+//! Compile a new condition from its source code, see compile()
+bool Compiler::compile(std::wstring_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                       Error& errorDescription, std::wostream* dump) {
     assert(targetDescription);
     assert(commonDefinitions);
 
+    // the dump is only complete for a full compilation
+    if(!incremental || dump)
+        return compileProgram(source, bytecode, allocatedVariablesCount, errorDescription, dump);
+
+    if(compileIncrementally(source, bytecode, allocatedVariablesCount))
+        return true;
+
+    // the full compilation reports the same error as if the program was not compiled incrementally
+    return compileProgram(source, bytecode, allocatedVariablesCount, errorDescription, dump);
+}
+
+//! Compile a new condition from its source code encoded in UTF-8, see compile()
+bool Compiler::compile(std::string_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                       Error& errorDescription, std::wostream* dump) {
+    const std::wstring text(UTF8ToWString(source));
+    return compile(std::wstring_view(text), bytecode, allocatedVariablesCount, errorDescription, dump);
+}
+
+//! Compile the whole program, see compile()
+bool Compiler::compileProgram(std::wstring_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                              Error& errorDescription, std::wostream* dump) {
+
     unsigned indent = 0;
 
     // we need to build maps at each compilation in case previous ones produced errors and messed
@@ -115,6 +154,7 @@ bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned
     }
 
     // parsing
+    maxEndVariableIndex = 0;
     std::unique_ptr<Node> program;
     try {
         program.reset(parseProgram());
@@ -161,7 +201,9 @@ bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned
         *dump << "Second pass for vectorial operations:\n";
     }
 
-    // expand the vectorial nodes into scalar operations
+    // expand the vectorial nodes into scalar operations,
+    // the temporary variables it allocates must not overlap the ones of any statement
+    endVariableIndex = maxEndVariableIndex;
     try {
         Node* expandedProgram(program->expandVectorialNodes(dump, this));
         program.release();
@@ -216,6 +258,7 @@ bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned
         const float fillPercentage = float(allocatedVariablesCount * 100.f) / float(targetDescription->variablesSize);
         *dump << "Using " << allocatedVariablesCount << " on " << targetDescription->variablesSize << " ("
               << fillPercentage << " %) words of variable space\n";
+        *dump << "Using " << maxEndVariableIndex << " words of temporary variables\n";
         *dump << "\n\n";
     }
 
@@ -232,8 +275,27 @@ bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned
         return false;
     }
 
+    if(dump)
+        *dump << "Bytecode optimizations:\n";
+
+    // peephole optimizations and jump threading
+    preLinkBytecode.optimize(dump);
+
+    if(dump)
+        *dump << "\n\n";
+
     // linking (flattening of complex structure into linear vector)
     if(!link(preLinkBytecode, bytecode)) {
+        // Large vector assignments take less bytecode when computed in a loop, but several times more steps,
+        // which counts against the steps an event can execute; so they are only used if the program does not fit
+        if(!vectorLoops) {
+            if(dump)
+                *dump << "Script too big, compiling again with large vector assignments computed in loops\n\n";
+            vectorLoops = true;
+            const bool success = compileProgram(source, bytecode, allocatedVariablesCount, errorDescription, dump);
+            vectorLoops = false;
+            return success;
+        }
         errorDescription = TranslatableError(SourcePos(), ERROR_SCRIPT_TOO_BIG).toError();
         return false;
     }
@@ -20,10 +20,12 @@
 #ifndef __ASEBA_COMPILER_H
 #define __ASEBA_COMPILER_H
 
+#include <atomic>
 #include <utility>
 #include <vector>
 #include <deque>
 #include <string>
+#include <string_view>
 #include <map>
 #include <set>
 #include <utility>
@@ -139,7 +141,9 @@ struct TranslatableError : public Error {
     Error toError();
     static void setTranslateCB(ErrorMessages::ErrorCallback newCB);
 
-    static ErrorMessages::ErrorCallback translateCB;
+    //! Callback translating error messages, ErrorMessages::defaultCallback unless set; shared by all compilers,
+    //! which may run in parallel threads
+    static std::atomic<ErrorMessages::ErrorCallback> translateCB;
     WFormatableString message;
 };
 
@@ -294,6 +298,20 @@ public:
     //! Lookup table for event name => id
     typedef std::map<std::wstring, unsigned> EventsMap;
 
+    //! A section of a program, compiled on its own when compiling incrementally: the code before the first
+    //! event or subroutine, an event, or a subroutine
+    struct CompiledSection {
+        bool isSubroutine{false};
+        unsigned eventId{0};             //!< id of the event, if not a subroutine
+        unsigned parseTemporaries{0};    //!< space of the temporary variables allocated while parsing
+        unsigned temporariesStart{0};    //!< maxEndVariableIndex the bytecode was generated with
+        BytecodeVector unoptimized;      //!< bytecode before optimizations, empty if none, for the stack check
+        BytecodeVector optimized;        //!< bytecode to link
+        bool used{false};                //!< whether used by the last compilation
+    };
+    //! Compiled sections by source code, their lines are relative to their first token
+    typedef std::map<std::wstring, CompiledSection> CompiledSectionsMap;
+
     friend struct AssignmentNode;
     friend struct CallSubNode;
 
@@ -312,11 +330,16 @@ public:
     void setCommonDefinitions(const CommonDefinitions* definitions);
     bool compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
                  Error& errorDescription, std::wostream* dump = nullptr);
+    bool compile(std::wstring_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                 Error& errorDescription, std::wostream* dump = nullptr);
+    bool compile(std::string_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                 Error& errorDescription, std::wostream* dump = nullptr);
+    void setIncrementalCompilation(bool enabled);
     void setTranslateCallback(ErrorMessages::ErrorCallback newCB) {
         TranslatableError::setTranslateCB(newCB);
     }
     static std::wstring translate(ErrorCode error) {
-        return TranslatableError::translateCB(error);
+        return TranslatableError::translateCB.load()(error);
     }
     static bool isKeyword(const std::wstring& word);
 
@@ -340,7 +363,7 @@ protected:
     template <int length>
     void expectOneOf(const Token::Type types[length]) const;
 
-    void freeTemporaryMemory();
+    void freeTemporaryMemory(unsigned mark = 0);
     unsigned allocateTemporaryMemory(const SourcePos varPos, const unsigned size);
     AssignmentNode* allocateTemporaryVariable(const SourcePos varPos, Node* rValue);
 
@@ -352,10 +375,17 @@ protected:
     SubroutineReverseTable::const_iterator findSubroutine(const std::wstring& name, const SourcePos& pos) const;
     bool constantExists(const std::wstring& name) const;
     void buildMaps();
-    void tokenize(std::wistream& source);
-    wchar_t getNextCharacter(std::wistream& source, SourcePos& pos);
-    bool testNextCharacter(std::wistream& source, SourcePos& pos, wchar_t test, Token::Type tokenIfTrue);
+    void tokenize(std::wstring_view source);
+    wchar_t getNextCharacter(const wchar_t*& cursor, SourcePos& pos);
+    bool testNextCharacter(const wchar_t*& cursor, const wchar_t* end, SourcePos& pos, wchar_t test,
+                           Token::Type tokenIfTrue);
     void dumpTokens(std::wostream& dest) const;
+    bool compileProgram(std::wstring_view source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount,
+                        Error& errorDescription, std::wostream* dump);
+    bool compileIncrementally(std::wstring_view source, BytecodeVector& bytecode,
+                              unsigned& allocatedVariablesCount);
+    bool compileSection(Node* program, CompiledSection& section);
+    std::wstring incrementalContext(const std::vector<std::wstring>& subroutineNames) const;
     bool verifyStackCalls(PreLinkBytecode& preLinkBytecode);
     bool link(const PreLinkBytecode& preLinkBytecode, BytecodeVector& bytecode);
     void disassemble(BytecodeVector& bytecode, const PreLinkBytecode& preLinkBytecode, std::wostream& dump) const;
@@ -416,8 +446,13 @@ protected:
     unsigned freeVariableIndex;                     //!< index pointing to the first free variable
     unsigned endVariableIndex;                      //!< (endMemory - endVariableIndex) is pointing to the first free
                                                     //!< variable at the end
+    unsigned maxEndVariableIndex;                   //!< highest endVariableIndex reached, space of temporaries
     const TargetDescription* targetDescription;     //!< description of the target VM
     const CommonDefinitions* commonDefinitions;     //!< common definitions, such as events or some constants
+    bool incremental;                               //!< whether compiled sections are kept between compilations
+    bool vectorLoops;                               //!< whether large vector assignments may be computed in loops
+    CompiledSectionsMap compiledSections;           //!< sections kept by the last incremental compilation
+    std::wstring compiledSectionsContext;           //!< what the kept sections depend on, besides their source
 
     ErrorMessages translator;
 };  // Compiler
@@ -437,6 +472,7 @@ struct PreLinkBytecode {
     PreLinkBytecode();
 
     void fixup(const Compiler::SubroutineTable& subroutineTable);
+    void optimize(std::wostream* dump);
 };
 
 /*@}*/
@@ -19,6 +19,7 @@
 
 #include "errors_code.h"
 #include "compiler.h"
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -27,9 +28,11 @@ namespace Aseba {
 /*@{*/
 
 static const wchar_t* error_map[ERROR_END];
+// compilers can be created in parallel threads, the map is only filled once
+static std::once_flag error_map_filled;
 
 // clang-format off
-ErrorMessages::ErrorMessages() {
+static void fillErrorMap() {
     // compiler.cpp
     error_map[ERROR_BROKEN_TARGET] = L"Broken target description: not enough room for internal variables";
     error_map[ASEBA_ERROR_STACK_OVERFLOW] = L"Execution stack will overflow, check for any recursive subroutine call and cut long mathematical expressions";
@@ -181,8 +184,14 @@ ErrorMessages::ErrorMessages() {
 
     error_map[ERROR_UNKNOWN_ERROR] = L"Unknown error";
 }
+// clang-format on
+
+ErrorMessages::ErrorMessages() {
+    std::call_once(error_map_filled, fillErrorMap);
+}
 
 const std::wstring ErrorMessages::defaultCallback(ErrorCode error) {
+    std::call_once(error_map_filled, fillErrorMap);
     if(error >= ERROR_END)
         return std::wstring(error_map[ERROR_UNKNOWN_ERROR]);
     else
@@ -199,11 +208,11 @@ std::wstring Error::toWString() const {
     return oss.str();
 }
 
-ErrorMessages::ErrorCallback TranslatableError::translateCB = nullptr;
+std::atomic<ErrorMessages::ErrorCallback> TranslatableError::translateCB{&ErrorMessages::defaultCallback};
 
 TranslatableError::TranslatableError(const SourcePos& pos, ErrorCode error) {
     this->pos = pos;
-    message = translateCB(error);
+    message = translateCB.load()(error);
 }
 
 Error TranslatableError::toError() {
@@ -0,0 +1,283 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Created by Stéphane Magnenat <stephane at magnenat dot net> (http://stephane.magnenat.net)
+    with contributions from the community.
+    Copyright (C) 2007--2018 the authors, see authors.txt for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compiler.h"
+#include "tree.h"
+#include "common/consts.h"
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <sstream>
+
+namespace Aseba {
+/** \addtogroup compiler */
+/*@{*/
+
+/*
+ * Incremental compilation
+ *   - The program is split in sections: the code before the first event or subroutine, then each event
+ *     and each subroutine; the sections are compiled on their own, as their bytecode is linked separately
+ *   - The bytecode of a section only depends on its source code, on what the code before the first section
+ *     declares, on the names of the subroutines, and on where the temporary variables of the vectorial
+ *     operations start; so it is kept, by source code, as long as these do not change
+ *   - The lines of the kept bytecode are relative to the first token of its section, which can move
+ *   - Checks involving several sections (stack, size, duplicates) run on the whole program at each compilation
+ *   - Nothing is reported on error, compile() then compiles the whole program to report the same error
+ *     as if it was not compiled incrementally
+ */
+
+namespace {
+    //! Add delta to the lines of bytecode
+    void shiftLines(BytecodeVector& bytecode, unsigned delta) {
+        for(auto& element : bytecode)
+            element.line += delta;
+        bytecode.lastLine += delta;
+    }
+}  // namespace
+
+//! Return what the compilation of the sections depends on, besides their source code,
+//! once the code before the first section is parsed
+std::wstring Compiler::incrementalContext(const std::vector<std::wstring>& subroutineNames) const {
+    std::wostringstream context;
+    context << targetDescription->variablesSize << L' ' << freeVariableIndex << L'\n';
+    for(const auto& variable : variablesMap)
+        context << variable.first << L' ' << variable.second.first << L' ' << variable.second.second << L'\n';
+    for(const auto& constant : constantsMap)
+        context << constant.first << L' ' << constant.second << L'\n';
+    for(const auto& event : commonDefinitions->events)
+        context << event.name << L' ' << event.value << L'\n';
+    for(const auto& event : targetDescription->localEvents)
+        context << event.name << L'\n';
+    for(const auto& function : targetDescription->nativeFunctions) {
+        context << function.name;
+        for(const auto& parameter : function.parameters)
+            context << L' ' << parameter.name << L' ' << parameter.size;
+        context << L'\n';
+    }
+    for(const auto& name : subroutineNames)
+        context << name << L'\n';
+    return context.str();
+}
+
+//! Compile a section of the program from its syntax tree, return false on error
+bool Compiler::compileSection(Node* program, CompiledSection& section) {
+    std::unique_ptr<Node> tree(program);
+    try {
+        tree->checkVectorSize();
+
+        Node* expandedTree(tree->expandAbstractNodes(nullptr));
+        tree.release();
+        tree.reset(expandedTree);
+
+        endVariableIndex = section.temporariesStart;
+        expandedTree = tree->expandVectorialNodes(nullptr, this);
+        tree.release();
+        tree.reset(expandedTree);
+
+        tree->typeCheck(this);
+
+        Node* optimizedTree(tree->optimize(nullptr));
+        tree.release();
+        tree.reset(optimizedTree);
+    } catch(TranslatableError error) {
+        return false;
+    }
+
+    PreLinkBytecode preLinkBytecode;
+    tree->emit(preLinkBytecode);
+    preLinkBytecode.fixup(subroutineTable);
+
+    // a section has at most one bytecode vector, events without code have none
+    assert(preLinkBytecode.events.size() + preLinkBytecode.subroutines.size() <= 1);
+    const auto bytecode = [&preLinkBytecode]() {
+        if(!preLinkBytecode.subroutines.empty())
+            return preLinkBytecode.subroutines.begin()->second;
+        if(!preLinkBytecode.events.empty())
+            return preLinkBytecode.events.begin()->second;
+        return BytecodeVector();
+    };
+    section.unoptimized = bytecode();
+    preLinkBytecode.optimize(nullptr);
+    section.optimized = bytecode();
+    return true;
+}
+
+//! Compile the program, only compiling again the sections which changed since the last compilation;
+//! return false on error, without reporting it
+bool Compiler::compileIncrementally(std::wstring_view source, BytecodeVector& bytecode,
+                                    unsigned& allocatedVariablesCount) {
+    buildMaps();
+    if(freeVariableIndex > targetDescription->variablesSize)
+        return false;
+
+    try {
+        tokenize(source);
+    } catch(TranslatableError error) {
+        return false;
+    }
+
+    // split the tokens in sections, each one ending with the end of stream
+    std::vector<std::deque<Token>> sectionsTokens(1);
+    for(const auto& token : tokens) {
+        if(token == Token::TOKEN_STR_onevent || token == Token::TOKEN_STR_sub) {
+            sectionsTokens.back().push_back(tokens.back());
+            sectionsTokens.emplace_back();
+        }
+        sectionsTokens.back().push_back(token);
+    }
+    const size_t sectionsCount = sectionsTokens.size();
+
+    // source code and first line of the sections
+    std::vector<std::wstring> texts(sectionsCount);
+    std::vector<unsigned> firstLines(sectionsCount, 0);
+    std::vector<std::wstring> subroutineNames;
+    for(size_t i = 0; i < sectionsCount; ++i) {
+        const size_t begin = i == 0 ? 0 : sectionsTokens[i].front().pos.character;
+        const size_t end = i + 1 == sectionsCount ? source.size() : sectionsTokens[i + 1].front().pos.character;
+        texts[i] = std::wstring(source.substr(begin, end - begin));
+        if(i > 0)
+            firstLines[i] = sectionsTokens[i].front().pos.row;
+        if(sectionsTokens[i].front() == Token::TOKEN_STR_sub) {
+            if(sectionsTokens[i][1] != Token::TOKEN_STRING_LITERAL)
+                return false;
+            subroutineNames.push_back(sectionsTokens[i][1].sValue);
+        }
+    }
+
+    // the code before the first section declares the constants and the variables, it is always parsed
+    std::vector<std::unique_ptr<Node>> trees(sectionsCount);
+    std::vector<unsigned> parseTemporaries(sectionsCount, 0);
+    tokens = std::move(sectionsTokens[0]);
+    maxEndVariableIndex = 0;
+    try {
+        trees[0].reset(parseProgram());
+    } catch(TranslatableError error) {
+        return false;
+    }
+    parseTemporaries[0] = maxEndVariableIndex;
+
+    // the kept sections are only valid in the context they were compiled in
+    const std::wstring context(incrementalContext(subroutineNames));
+    if(context != compiledSectionsContext) {
+        compiledSections.clear();
+        compiledSectionsContext = context;
+    }
+
+    // parse the sections which changed, declare the events and subroutines of the others
+    std::vector<CompiledSection*> sections(sectionsCount, nullptr);
+    for(size_t i = 0; i < sectionsCount; ++i) {
+        auto it = compiledSections.find(texts[i]);
+        if(it != compiledSections.end()) {
+            CompiledSection& section = it->second;
+            sections[i] = &section;
+            parseTemporaries[i] = section.parseTemporaries;
+            if(i == 0)
+                continue;
+            if(section.isSubroutine) {
+                const Token& nameToken = sectionsTokens[i][1];
+                if(subroutineReverseTable.find(nameToken.sValue) != subroutineReverseTable.end())
+                    return false;
+                subroutineReverseTable[nameToken.sValue] = unsigned(subroutineTable.size());
+                subroutineTable.emplace_back(nameToken.sValue, 0, firstLines[i]);
+            } else if(!implementedEvents.insert(section.eventId).second)
+                return false;
+        } else if(i > 0) {
+            tokens = std::move(sectionsTokens[i]);
+            maxEndVariableIndex = 0;
+            try {
+                trees[i].reset(parseProgram());
+            } catch(TranslatableError error) {
+                return false;
+            }
+            parseTemporaries[i] = maxEndVariableIndex;
+        }
+    }
+
+    // as for a full compilation, temporary variables of the vectorial operations start after the ones
+    // allocated while parsing any section
+    const unsigned temporariesStart = *std::max_element(parseTemporaries.begin(), parseTemporaries.end());
+    maxEndVariableIndex = temporariesStart;
+    for(size_t i = 0; i < sectionsCount; ++i) {
+        if(sections[i] && sections[i]->temporariesStart != temporariesStart) {
+            // rare, when the edited section needs more temporary variables than any other one
+            compiledSections.clear();
+            return compileIncrementally(source, bytecode, allocatedVariablesCount);
+        }
+    }
+
+    // compile the sections which changed
+    for(size_t i = 0; i < sectionsCount; ++i) {
+        if(sections[i])
+            continue;
+        CompiledSection section;
+        if(i == 0)
+            section.eventId = ASEBA_EVENT_INIT;
+        else if(auto* eventDecl = dynamic_cast<EventDeclNode*>(trees[i]->children.front()))
+            section.eventId = eventDecl->eventId;
+        else
+            section.isSubroutine = true;
+        section.parseTemporaries = parseTemporaries[i];
+        section.temporariesStart = temporariesStart;
+        if(!compileSection(trees[i].release(), section))
+            return false;
+        shiftLines(section.unoptimized, -firstLines[i]);
+        shiftLines(section.optimized, -firstLines[i]);
+        sections[i] = &(compiledSections[texts[i]] = std::move(section));
+    }
+
+    // assemble the sections at their current lines
+    PreLinkBytecode unoptimized;
+    PreLinkBytecode optimized;
+    unoptimized.events.clear();
+    optimized.events.clear();
+    unsigned subroutineId = 0;
+    for(size_t i = 0; i < sectionsCount; ++i) {
+        CompiledSection& section = *sections[i];
+        section.used = true;
+        if(!section.isSubroutine && section.unoptimized.empty())
+            continue;
+        BytecodeVector& unoptimizedBytecode = section.isSubroutine ? unoptimized.subroutines[subroutineId]
+                                                                   : unoptimized.events[section.eventId];
+        BytecodeVector& optimizedBytecode = section.isSubroutine ? optimized.subroutines[subroutineId++]
+                                                                 : optimized.events[section.eventId];
+        unoptimizedBytecode = section.unoptimized;
+        optimizedBytecode = section.optimized;
+        shiftLines(unoptimizedBytecode, firstLines[i]);
+        shiftLines(optimizedBytecode, firstLines[i]);
+    }
+
+    // forget the sections which are not in the program anymore
+    for(auto it = compiledSections.begin(); it != compiledSections.end();) {
+        if(it->second.used) {
+            it->second.used = false;
+            ++it;
+        } else
+            it = compiledSections.erase(it);
+    }
+
+    if(!verifyStackCalls(unoptimized) || !link(optimized, bytecode))
+        return false;
+
+    allocatedVariablesCount = freeVariableIndex;
+    return true;
+}
+
+/*@}*/
+
+}  // namespace Aseba
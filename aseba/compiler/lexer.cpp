@@ -27,6 +27,7 @@
 #include <cctype>
 #include <cstdio>
 #include <cwctype>
+#include <iterator>
 #include <locale>
 
 namespace Aseba {
@@ -48,6 +49,77 @@ long int wcstol_fix(const wchar_t* str, wchar_t** endptr, int base) {
 #    define wcstol wcstol_fix
 #endif  // ANDROID
 
+namespace {
+    //! A keyword of the language and its token
+    struct Keyword {
+        std::wstring_view name;
+        Compiler::Token::Type type;
+    };
+
+    constexpr Keyword keywords[] = {
+        {L"when", Compiler::Token::TOKEN_STR_when},
+        {L"emit", Compiler::Token::TOKEN_STR_emit},
+        {L"_emit", Compiler::Token::TOKEN_STR_hidden_emit},
+        {L"for", Compiler::Token::TOKEN_STR_for},
+        {L"in", Compiler::Token::TOKEN_STR_in},
+        {L"step", Compiler::Token::TOKEN_STR_step},
+        {L"while", Compiler::Token::TOKEN_STR_while},
+        {L"do", Compiler::Token::TOKEN_STR_do},
+        {L"if", Compiler::Token::TOKEN_STR_if},
+        {L"then", Compiler::Token::TOKEN_STR_then},
+        {L"else", Compiler::Token::TOKEN_STR_else},
+        {L"elseif", Compiler::Token::TOKEN_STR_elseif},
+        {L"end", Compiler::Token::TOKEN_STR_end},
+        {L"var", Compiler::Token::TOKEN_STR_var},
+        {L"const", Compiler::Token::TOKEN_STR_const},
+        {L"call", Compiler::Token::TOKEN_STR_call},
+        {L"sub", Compiler::Token::TOKEN_STR_sub},
+        {L"callsub", Compiler::Token::TOKEN_STR_callsub},
+        {L"onevent", Compiler::Token::TOKEN_STR_onevent},
+        {L"abs", Compiler::Token::TOKEN_STR_abs},
+        {L"return", Compiler::Token::TOKEN_STR_return},
+        {L"or", Compiler::Token::TOKEN_OP_OR},
+        {L"and", Compiler::Token::TOKEN_OP_AND},
+        {L"not", Compiler::Token::TOKEN_OP_NOT},
+    };
+
+    //! Perfect hash of the keywords, from their first and last characters
+    constexpr unsigned keywordHash(std::wstring_view word) {
+        return (2 * unsigned(word.front()) + 11 * unsigned(word.back())) % 64;
+    }
+
+    //! Keywords by hash, as their index plus one, 0 where no keyword has this hash
+    struct KeywordSlots {
+        unsigned char index[64];
+        bool perfect;
+    };
+
+    constexpr KeywordSlots buildKeywordSlots() {
+        KeywordSlots slots{};
+        slots.perfect = true;
+        for(size_t i = 0; i < std::size(keywords); ++i) {
+            unsigned char& slot = slots.index[keywordHash(keywords[i].name)];
+            if(slot != 0)
+                slots.perfect = false;
+            slot = (unsigned char)(i + 1);
+        }
+        return slots;
+    }
+
+    constexpr KeywordSlots keywordSlots = buildKeywordSlots();
+    static_assert(keywordSlots.perfect, "two keywords have the same hash, change keywordHash()");
+
+    //! Return the token of a keyword, TOKEN_STRING_LITERAL if word is not a keyword
+    Compiler::Token::Type keywordType(std::wstring_view word) {
+        if(word.empty())
+            return Compiler::Token::TOKEN_STRING_LITERAL;
+        const unsigned slot = keywordSlots.index[keywordHash(word)];
+        if(slot != 0 && keywords[slot - 1].name == word)
+            return keywords[slot - 1].type;
+        return Compiler::Token::TOKEN_STRING_LITERAL;
+    }
+}  // namespace
+
 //! Construct a new token of given type and value
 Compiler::Token::Token(Type type, SourcePos pos, const std::wstring& value) : type(type), sValue(value), pos(pos) {
     if(type == TOKEN_INT_LITERAL) {
@@ -157,17 +229,16 @@ std::wstring Compiler::Token::toWString() const {
 }
 //! Parse source and build tokens vector
 //! \param source source code
-void Compiler::tokenize(std::wistream& source) {
+void Compiler::tokenize(std::wstring_view source) {
     tokens.clear();
     SourcePos pos(0, 0, 0);
     const unsigned tabSize = 4;
+    const wchar_t* cursor = source.data();
+    const wchar_t* const end = cursor + source.size();
 
     // tokenize text source
-    while(source.good()) {
-        wchar_t c = source.get();
-
-        if(source.eof())
-            break;
+    while(cursor != end) {
+        wchar_t c = *cursor++;
 
         pos.column++;
         pos.character++;
@@ -192,13 +263,13 @@ void Compiler::tokenize(std::wistream& source) {
             // special case for comment
             case '#': {
                 // check if it's a comment block #* ... *#
-                if(source.peek() == '*') {
+                if(cursor != end && *cursor == '*') {
                     // comment block
                     // record position of the begining
                     SourcePos begin(pos);
                     // move forward by 2 characters then search for the end
                     int step = 2;
-                    while((step > 0) || (c != '*') || (source.peek() != '#')) {
+                    while((step > 0) || (c != '*') || (cursor == end) || (*cursor != '#')) {
                         if(step)
                             step--;
 
@@ -209,23 +280,26 @@ void Compiler::tokenize(std::wistream& source) {
                             pos.column = 0;
                         } else
                             pos.column++;
-                        c = source.get();
-                        pos.character++;
-                        if(source.eof()) {
+                        if(cursor == end) {
                             // EOF -> unbalanced block
                             throw TranslatableError(begin, ERROR_UNBALANCED_COMMENT_BLOCK);
                         }
+                        c = *cursor++;
+                        pos.character++;
                     }
                     // fetch the #
-                    getNextCharacter(source, pos);
+                    getNextCharacter(cursor, pos);
                 } else {
                     // simple comment
-                    while((c != '\n') && (c != '\r') && (!source.eof())) {
+                    bool eof = cursor == end;
+                    while((c != '\n') && (c != '\r') && !eof) {
                         if(c == '\t')
                             pos.column += tabSize;
                         else
                             pos.column++;
-                        c = source.get();
+                        eof = cursor == end;
+                        if(!eof)
+                            c = *cursor++;
                         pos.character++;
                     }
                     if(c == '\n') {
@@ -238,53 +312,53 @@ void Compiler::tokenize(std::wistream& source) {
 
             // cases that require one character look-ahead
             case '+':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_ADD_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_ADD_EQUAL))
                     break;
-                if(testNextCharacter(source, pos, '+', Token::TOKEN_OP_PLUS_PLUS))
+                if(testNextCharacter(cursor, end, pos, '+', Token::TOKEN_OP_PLUS_PLUS))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_ADD, pos);
                 break;
 
             case '-':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_NEG_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_NEG_EQUAL))
                     break;
-                if(testNextCharacter(source, pos, '-', Token::TOKEN_OP_MINUS_MINUS))
+                if(testNextCharacter(cursor, end, pos, '-', Token::TOKEN_OP_MINUS_MINUS))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_NEG, pos);
                 break;
 
             case '*':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_MULT_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_MULT_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_MULT, pos);
                 break;
 
             case '/':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_DIV_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_DIV_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_DIV, pos);
                 break;
 
             case '%':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_MOD_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_MOD_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_MOD, pos);
                 break;
 
             case '|':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_OR_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_OR_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_BIT_OR, pos);
                 break;
 
             case '^':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_XOR_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_XOR_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_BIT_XOR, pos);
                 break;
 
             case '&':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_AND_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_AND_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_BIT_AND, pos);
                 break;
@@ -292,44 +366,44 @@ void Compiler::tokenize(std::wistream& source) {
             case '~': tokens.emplace_back(Token::TOKEN_OP_BIT_NOT, pos); break;
 
             case '!':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_NOT_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_NOT_EQUAL))
                     break;
                 throw TranslatableError(pos, ERROR_SYNTAX);
                 break;
 
             case '=':
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_ASSIGN, pos);
                 break;
 
             // cases that require two characters look-ahead
             case '<':
-                if(source.peek() == '<') {
+                if(cursor != end && *cursor == '<') {
                     // <<
-                    getNextCharacter(source, pos);
-                    if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_SHIFT_LEFT_EQUAL))
+                    getNextCharacter(cursor, pos);
+                    if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SHIFT_LEFT_EQUAL))
                         break;
                     tokens.emplace_back(Token::TOKEN_OP_SHIFT_LEFT, pos);
                     break;
                 }
                 // <
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_SMALLER_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SMALLER_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_SMALLER, pos);
                 break;
 
             case '>':
-                if(source.peek() == '>') {
+                if(cursor != end && *cursor == '>') {
                     // >>
-                    getNextCharacter(source, pos);
-                    if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_SHIFT_RIGHT_EQUAL))
+                    getNextCharacter(cursor, pos);
+                    if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SHIFT_RIGHT_EQUAL))
                         break;
                     tokens.emplace_back(Token::TOKEN_OP_SHIFT_RIGHT, pos);
                     break;
                 }
                 // >
-                if(testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIGGER_EQUAL))
+                if(testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIGGER_EQUAL))
                     break;
                 tokens.emplace_back(Token::TOKEN_OP_BIGGER, pos);
                 break;
@@ -341,16 +415,11 @@ void Compiler::tokenize(std::wistream& source) {
                     throw TranslatableError(pos, ERROR_INVALID_IDENTIFIER).arg((unsigned)c, 0, 16);
 
                 // get a string
-                std::wstring s;
-                s += c;
-                wchar_t nextC = source.peek();
-                int posIncrement = 0;
-                while((source.good()) && (is_utf8_alpha_num(nextC) || (nextC == '_') || (nextC == '.'))) {
-                    s += nextC;
-                    source.get();
-                    posIncrement++;
-                    nextC = source.peek();
-                }
+                const wchar_t* const begin = cursor - 1;
+                while((cursor != end) && (is_utf8_alpha_num(*cursor) || (*cursor == '_') || (*cursor == '.')))
+                    ++cursor;
+                const std::wstring_view s(begin, cursor - begin);
+                const int posIncrement = int(s.size()) - 1;
 
                 // we now have a string, let's check what it is
                 if(std::iswdigit(s[0])) {
@@ -374,81 +443,36 @@ void Compiler::tokenize(std::wistream& source) {
                             if(!std::iswdigit(s[i]))
                                 throw TranslatableError(pos, ERROR_IN_NUMBER);
                     }
-                    tokens.emplace_back(Token::TOKEN_INT_LITERAL, pos, s);
+                    tokens.emplace_back(Token::TOKEN_INT_LITERAL, pos, std::wstring(s));
                 } else {
                     // check if it is a known keyword
-                    // FIXME: clean-up that with a table
-                    if(s == L"when")
-                        tokens.emplace_back(Token::TOKEN_STR_when, pos);
-                    else if(s == L"emit")
-                        tokens.emplace_back(Token::TOKEN_STR_emit, pos);
-                    else if(s == L"_emit")
-                        tokens.emplace_back(Token::TOKEN_STR_hidden_emit, pos);
-                    else if(s == L"for")
-                        tokens.emplace_back(Token::TOKEN_STR_for, pos);
-                    else if(s == L"in")
-                        tokens.emplace_back(Token::TOKEN_STR_in, pos);
-                    else if(s == L"step")
-                        tokens.emplace_back(Token::TOKEN_STR_step, pos);
-                    else if(s == L"while")
-                        tokens.emplace_back(Token::TOKEN_STR_while, pos);
-                    else if(s == L"do")
-                        tokens.emplace_back(Token::TOKEN_STR_do, pos);
-                    else if(s == L"if")
-                        tokens.emplace_back(Token::TOKEN_STR_if, pos);
-                    else if(s == L"then")
-                        tokens.emplace_back(Token::TOKEN_STR_then, pos);
-                    else if(s == L"else")
-                        tokens.emplace_back(Token::TOKEN_STR_else, pos);
-                    else if(s == L"elseif")
-                        tokens.emplace_back(Token::TOKEN_STR_elseif, pos);
-                    else if(s == L"end")
-                        tokens.emplace_back(Token::TOKEN_STR_end, pos);
-                    else if(s == L"var")
-                        tokens.emplace_back(Token::TOKEN_STR_var, pos);
-                    else if(s == L"const")
-                        tokens.emplace_back(Token::TOKEN_STR_const, pos);
-                    else if(s == L"call")
-                        tokens.emplace_back(Token::TOKEN_STR_call, pos);
-                    else if(s == L"sub")
-                        tokens.emplace_back(Token::TOKEN_STR_sub, pos);
-                    else if(s == L"callsub")
-                        tokens.emplace_back(Token::TOKEN_STR_callsub, pos);
-                    else if(s == L"onevent")
-                        tokens.emplace_back(Token::TOKEN_STR_onevent, pos);
-                    else if(s == L"abs")
-                        tokens.emplace_back(Token::TOKEN_STR_abs, pos);
-                    else if(s == L"return")
-                        tokens.emplace_back(Token::TOKEN_STR_return, pos);
-                    else if(s == L"or")
-                        tokens.emplace_back(Token::TOKEN_OP_OR, pos);
-                    else if(s == L"and")
-                        tokens.emplace_back(Token::TOKEN_OP_AND, pos);
-                    else if(s == L"not")
-                        tokens.emplace_back(Token::TOKEN_OP_NOT, pos);
+                    const Token::Type keyword = keywordType(s);
+                    if(keyword != Token::TOKEN_STRING_LITERAL)
+                        tokens.emplace_back(keyword, pos);
                     else
-                        tokens.emplace_back(Token::TOKEN_STRING_LITERAL, pos, s);
+                        tokens.emplace_back(Token::TOKEN_STRING_LITERAL, pos, std::wstring(s));
                 }
 
                 pos.column += posIncrement;
                 pos.character += posIncrement;
             } break;
         }  // switch (c)
-    }      // while (source.good())
+    }      // while (cursor != end)
 
     tokens.emplace_back(Token::TOKEN_END_OF_STREAM, pos);
 }
 
-wchar_t Compiler::getNextCharacter(std::wistream& source, SourcePos& pos) {
+wchar_t Compiler::getNextCharacter(const wchar_t*& cursor, SourcePos& pos) {
     pos.column++;
     pos.character++;
-    return source.get();
+    return *cursor++;
 }
 
-bool Compiler::testNextCharacter(std::wistream& source, SourcePos& pos, wchar_t test, Token::Type tokenIfTrue) {
-    if((int)source.peek() == int(test)) {
+bool Compiler::testNextCharacter(const wchar_t*& cursor, const wchar_t* end, SourcePos& pos, wchar_t test,
+                                 Token::Type tokenIfTrue) {
+    if(cursor != end && *cursor == test) {
         tokens.emplace_back(tokenIfTrue, pos);
-        getNextCharacter(source, pos);
+        getNextCharacter(cursor, pos);
         return true;
     }
     return false;
@@ -462,56 +486,6 @@ void Compiler::dumpTokens(std::wostream& dest) const {
 
 //! Return whether a string is a language keyword
 bool Compiler::isKeyword(const std::wstring& s) {
-    // FIXME: clean-up that with a table
-    if(s == L"when")
-        return true;
-    else if(s == L"emit")
-        return true;
-    else if(s == L"_emit")
-        return true;
-    else if(s == L"for")
-        return true;
-    else if(s == L"in")
-        return true;
-    else if(s == L"step")
-        return true;
-    else if(s == L"while")
-        return true;
-    else if(s == L"do")
-        return true;
-    else if(s == L"if")
-        return true;
-    else if(s == L"then")
-        return true;
-    else if(s == L"else")
-        return true;
-    else if(s == L"elseif")
-        return true;
-    else if(s == L"end")
-        return true;
-    else if(s == L"var")
-        return true;
-    else if(s == L"const")
-        return true;
-    else if(s == L"call")
-        return true;
-    else if(s == L"sub")
-        return true;
-    else if(s == L"callsub")
-        return true;
-    else if(s == L"onevent")
-        return true;
-    else if(s == L"abs")
-        return true;
-    else if(s == L"return")
-        return true;
-    else if(s == L"or")
-        return true;
-    else if(s == L"and")
-        return true;
-    else if(s == L"not")
-        return true;
-    else
-        return false;
+    return keywordType(s) != Token::TOKEN_STRING_LITERAL;
 }
 }  // namespace Aseba
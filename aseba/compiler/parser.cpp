@@ -27,6 +27,7 @@
 #include <cassert>
 #include <typeinfo>
 #include <algorithm>
+#include <atomic>
 
 #define IS_ONE_OF(array) (isOneOf<sizeof(array) / sizeof(Token::Type)>(array))
 #define EXPECT_ONE_OF(array) (expectOneOf<sizeof(array) / sizeof(Token::Type)>(array))
@@ -210,8 +211,9 @@ void Compiler::expectOneOf(const Token::Type types[length]) const {
     }
 }
 
-void Compiler::freeTemporaryMemory() {
-    endVariableIndex = 0;
+//! Free the temporary memory allocated after mark, all of it by default
+void Compiler::freeTemporaryMemory(unsigned mark) {
+    endVariableIndex = mark;
 }
 
 unsigned Compiler::allocateTemporaryMemory(const SourcePos varPos, const unsigned size) {
@@ -219,6 +221,7 @@ unsigned Compiler::allocateTemporaryMemory(const SourcePos varPos, const unsigne
     unsigned endOfMemory = targetDescription->variablesSize - endVariableIndex;
     unsigned varAddr = endOfMemory - size;
     endVariableIndex += size;
+    maxEndVariableIndex = std::max(maxEndVariableIndex, endVariableIndex);
 
     // free space check
     if(freeVariableIndex + endVariableIndex > targetDescription->variablesSize)
@@ -228,7 +231,8 @@ unsigned Compiler::allocateTemporaryMemory(const SourcePos varPos, const unsigne
 }
 
 AssignmentNode* Compiler::allocateTemporaryVariable(const SourcePos varPos, Node* rValue) {
-    static unsigned uid = 0;
+    // compilations can run in parallel
+    static std::atomic<unsigned> uid{0};
 
     // allocate the temporary variable
     const unsigned size = rValue->getVectorSize();
@@ -23,6 +23,7 @@
 #include "common/utils/FormatableString.h"
 
 #include <cassert>
+#include <climits>
 #include <memory>
 #include <iostream>
 
@@ -182,6 +183,136 @@ static bool matchNameInMemoryVector(const Node* root, std::wstring name) {
     return false;
 }
 
+//! Vectorial assignments of at least this size are computed in a loop, when it takes less bytecode.
+//! A loop of n elements executes about four times more steps than the n unrolled assignments, so loops are
+//! only used for programs which do not fit in the bytecode of the target otherwise (see Compiler::vectorLoops).
+static const unsigned vectorLoopMinSize = 8;
+
+/*
+ * helper function to know if a constant vector, possibly made of nested tuples, holds a single
+ * value; first is the first constant found
+ */
+static bool isUniformConstant(const Node* node, const ImmediateNode*& first) {
+    auto* immediate = dynamic_cast<const ImmediateNode*>(node);
+    if(immediate) {
+        if(!first)
+            first = immediate;
+        return immediate->value == first->value;
+    }
+
+    if(!dynamic_cast<const TupleVectorNode*>(node))
+        return false;
+    for(const auto child : node->children)
+        if(!isUniformConstant(child, first))
+            return false;
+    return true;
+}
+
+/*
+ * helper function to know if all elements of a vector can be accessed by their index
+ * in a loop: memory at a static address, constant vectors of a single value, and
+ * element-wise operations on them
+ */
+static bool isLoopable(const Node* node) {
+    auto* memory = dynamic_cast<const MemoryVectorNode*>(node);
+    if(memory)
+        return memory->isAddressStatic();
+
+    const ImmediateNode* first = nullptr;
+    if(dynamic_cast<const TupleVectorNode*>(node))
+        return isUniformConstant(node, first);
+
+    if(!dynamic_cast<const BinaryArithmeticNode*>(node) && !dynamic_cast<const UnaryArithmeticNode*>(node))
+        return false;
+    for(const auto child : node->children)
+        if(!isLoopable(child))
+            return false;
+    return true;
+}
+
+/*
+ * helper function to expand a loopable vector to its element at the index held in
+ * the variable at counterAddr
+ */
+static Node* expandAtLoopIndex(const Node* node, unsigned counterAddr) {
+    auto* memory = dynamic_cast<const MemoryVectorNode*>(node);
+    if(memory) {
+        const unsigned addr = memory->getVectorAddr();
+        const unsigned size = memory->getVectorSize();
+        Node* array;
+        if(memory->write)
+            array = new ArrayWriteNode(memory->sourcePos, addr, size, memory->arrayName);
+        else
+            array = new ArrayReadNode(memory->sourcePos, addr, size, memory->arrayName);
+        array->children.push_back(new LoadNode(memory->sourcePos, counterAddr));
+        return array;
+    }
+
+    const ImmediateNode* first = nullptr;
+    if(dynamic_cast<const TupleVectorNode*>(node) && isUniformConstant(node, first))
+        return first->shallowCopy();
+
+    // element-wise operation
+    Node* operation = node->shallowCopy();
+    operation->children.clear();
+    for(const auto child : node->children)
+        operation->children.push_back(expandAtLoopIndex(child, counterAddr));
+    return operation;
+}
+
+/*
+ * helper function to expand "left = right" into
+ *   counter = 0
+ *   while counter < size do
+ *       left[counter] = right[counter]
+ *       counter = counter + 1
+ *   end
+ */
+static Node* expandToLoop(const SourcePos& pos, const MemoryVectorNode* left, const Node* right,
+                          unsigned counterAddr) {
+    std::unique_ptr<BlockNode> block(new BlockNode(pos));
+    block->children.push_back(new AssignmentNode(pos, new StoreNode(pos, counterAddr), new ImmediateNode(pos, 0)));
+
+    auto* whileNode = new WhileNode(pos);
+    block->children.push_back(whileNode);
+    whileNode->children.push_back(new BinaryArithmeticNode(pos, ASEBA_OP_SMALLER_THAN, new LoadNode(pos, counterAddr),
+                                                           new ImmediateNode(pos, int(left->getVectorSize()))));
+
+    auto* body = new BlockNode(pos);
+    whileNode->children.push_back(body);
+    body->children.push_back(
+        new AssignmentNode(pos, expandAtLoopIndex(left, counterAddr), expandAtLoopIndex(right, counterAddr)));
+    body->children.push_back(new AssignmentNode(
+        pos, new StoreNode(pos, counterAddr),
+        new BinaryArithmeticNode(pos, ASEBA_OP_ADD, new LoadNode(pos, counterAddr), new ImmediateNode(pos, 1))));
+
+    return block.release();
+}
+
+/*
+ * helper function returning the size of the bytecode generated for a scalar tree, once
+ * optimized, or UINT_MAX if it does not compile; errors are reported by the later passes
+ */
+static unsigned bytecodeSize(const Node* root, Compiler* compiler) {
+    std::unique_ptr<Node> copy(root->deepCopy());
+    try {
+        copy->typeCheck(compiler);
+        Node* optimized = copy->optimize(nullptr);
+        if(optimized != copy.get()) {
+            copy.release();  // deleted by optimize()
+            copy.reset(optimized);
+        }
+    } catch(TranslatableError&) {
+        return UINT_MAX;
+    }
+    if(!copy)
+        return 0;
+
+    PreLinkBytecode bytecodes;
+    copy->emit(bytecodes);
+    return unsigned(bytecodes.current->size());
+}
+
 //! This is the root node, take in charge the tree creation / deletion
 Node* ProgramNode::expandVectorialNodes(std::wostream* dump, Compiler* compiler, unsigned int index) {
     Node* newMe = Node::expandVectorialNodes(dump, compiler, index);
@@ -216,6 +347,9 @@ Node* AssignmentNode::expandVectorialNodes(std::wostream* dump, Compiler* compil
     // right vector can be anything
     Node* rightVector = children[1];
 
+    // temporary variables allocated to expand this assignment are only used by it
+    const unsigned mark = compiler ? compiler->endVariableIndex : 0;
+
     // check if the left vector appears somewhere on the right side
     if(matchNameInMemoryVector(rightVector, leftVector->arrayName) && leftVector->getVectorSize() > 1) {
         // in such case, there is a risk of involuntary overwriting the content
@@ -231,7 +365,10 @@ Node* AssignmentNode::expandVectorialNodes(std::wostream* dump, Compiler* compil
         // leftVector = tempVar
         tempBlock->children.push_back(new AssignmentNode(sourcePos, leftVector->deepCopy(), tempVar->deepCopy()));
 
-        return tempBlock->expandVectorialNodes(dump, compiler);  // tempBlock will be reclaimed
+        Node* expanded = tempBlock->expandVectorialNodes(dump, compiler);  // tempBlock will be reclaimed
+        // the temporary variable is dead after this assignment, its space can be reused by the next ones
+        compiler->freeTemporaryMemory(mark);
+        return expanded;
     }
     // else
 
@@ -243,6 +380,23 @@ Node* AssignmentNode::expandVectorialNodes(std::wostream* dump, Compiler* compil
                                                      rightVector->expandVectorialNodes(dump, compiler, i)));
     }
 
+    // large vectors might take less bytecode if computed in a loop, when the program does not fit otherwise
+    const unsigned size = leftVector->getVectorSize();
+    if(compiler && compiler->vectorLoops && size >= vectorLoopMinSize && isLoopable(leftVector) && isLoopable(rightVector)) {
+        const unsigned counterAddr = compiler->allocateTemporaryMemory(sourcePos, 1);
+        std::unique_ptr<Node> loop(expandToLoop(sourcePos, leftVector, rightVector, counterAddr));
+
+        const unsigned unrolledSize = bytecodeSize(block.get(), compiler);
+        const unsigned loopSize = bytecodeSize(loop.get(), compiler);
+        compiler->freeTemporaryMemory(mark);
+        if(unrolledSize != UINT_MAX && loopSize < unrolledSize) {
+            if(dump)
+                *dump << sourcePos.toWString() << L" assignment of " << size << L" elements computed in a loop, saving "
+                      << unrolledSize - loopSize << L" words of bytecode\n";
+            return loop.release();
+        }
+    }
+
     return block.release();
 }
 
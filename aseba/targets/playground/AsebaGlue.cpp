@@ -22,6 +22,7 @@
 #    define ASEBA_ASSERT
 #endif
 
+#include <chrono>
 #include <string>
 #include <typeinfo>
 #include <algorithm>
@@ -33,15 +34,39 @@
 #include "common/utils/FormatableString.h"
 
 namespace Aseba {
-// Mapping so that Aseba C callbacks can dispatch to the right objects
-VMStateToEnvironment vmStateToEnvironment;
-
 NamedRobot::NamedRobot(std::string robotName) : robotName(std::move(robotName)) {}
 
 // SingleVMNodeGlue
 
 SingleVMNodeGlue::SingleVMNodeGlue(std::string robotName, int16_t nodeId) : NamedRobot(std::move(robotName)) {
     vm.nodeId = nodeId;
+    vm.userData = nullptr;
+#ifdef ASEBA_VM_PROFILER
+    vm.profile = nullptr;
+#endif
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    vm.variablesDirty = nullptr;
+#endif
+}
+
+void SingleVMNodeGlue::setupProfile() {
+#ifdef ASEBA_VM_PROFILER
+    // one profile data message worth of events is plenty for the robots of playground
+    profile.eventsSize = ASEBA_MAX_PROFILE_DATA_COUNT;
+    profileCounters.resize(2 * vm.bytecodeSize + 2 * profile.eventsSize);
+    profile.pcSteps = &profileCounters[0];
+    profile.pcNativeTime = profile.pcSteps + vm.bytecodeSize;
+    profile.eventRuns = profile.pcNativeTime + vm.bytecodeSize;
+    profile.eventSteps = profile.eventRuns + profile.eventsSize;
+    vm.profile = &profile;
+#endif
+}
+
+void SingleVMNodeGlue::setupVariablesDirty() {
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    variablesDirty.resize(ASEBA_VM_DIRTY_WORDS(vm.variablesSize));
+    vm.variablesDirty = &variablesDirty[0];
+#endif
 }
 
 // RecvBufferNodeConnection
@@ -65,47 +90,54 @@ extern "C" void AsebaPutVmToSleep(AsebaVMState*) {
 }
 
 extern "C" void AsebaSendBuffer(AsebaVMState* vm, const uint8_t* data, uint16_t length) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     Aseba::AbstractNodeConnection* connection(environment.second);
     assert(connection);
     connection->sendBuffer(vm->nodeId, data, length);
 }
 
 extern "C" uint16_t AsebaGetBuffer(AsebaVMState* vm, uint8_t* data, uint16_t maxLength, uint16_t* source) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     Aseba::AbstractNodeConnection* connection(environment.second);
     assert(connection);
     return connection->getBuffer(data, maxLength, source);
 }
 
 extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState* vm) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     const Aseba::AbstractNodeGlue* glue(environment.first);
     assert(glue);
     return glue->getDescription();
 }
 
 extern "C" const AsebaLocalEventDescription* AsebaGetLocalEventsDescriptions(AsebaVMState* vm) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     const Aseba::AbstractNodeGlue* glue(environment.first);
     assert(glue);
     return glue->getLocalEventsDescriptions();
 }
 
 extern "C" const AsebaNativeFunctionDescription* const* AsebaGetNativeFunctionsDescriptions(AsebaVMState* vm) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     const Aseba::AbstractNodeGlue* glue(environment.first);
     assert(glue);
     return glue->getNativeFunctionsDescriptions();
 }
 
 extern "C" void AsebaNativeFunction(AsebaVMState* vm, uint16_t id) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     Aseba::AbstractNodeGlue* glue(environment.first);
     assert(glue);
     glue->callNativeFunction(id);
 }
 
+#ifdef ASEBA_VM_PROFILER
+extern "C" uint32_t AsebaVMProfilerTime(AsebaVMState*) {
+    using namespace std::chrono;
+    return uint32_t(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
 extern "C" void AsebaWriteBytecode(AsebaVMState*) {
     // not implemented in playground
 }
@@ -119,7 +151,7 @@ extern "C" int AsebaHandleDeviceInfoMessages(AsebaVMState*, uint16_t, uint16_t*,
 }
 
 extern "C" void AsebaAssert(AsebaVMState* vm, AsebaAssertReason reason) {
-    const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.find(vm)->second);
+    const Aseba::NodeEnvironment& environment(Aseba::getNodeEnvironment(vm));
     const Aseba::AbstractNodeGlue* glue(environment.first);
     assert(glue);
     std::cerr << Aseba::FormatableString(
@@ -26,8 +26,8 @@
 #include "vm/natives.h"
 #include <valarray>
 #include <vector>
-#include <map>
 #include <string>
+#include <utility>
 
 namespace Aseba {
 // Abstractions to virtualise VM and connection
@@ -58,8 +58,25 @@ struct SingleVMNodeGlue : NamedRobot, AbstractNodeGlue {
     AsebaVMState vm;
     std::valarray<unsigned short> bytecode;
     std::valarray<signed short> stack;
+#ifdef ASEBA_VM_PREDECODE
+    std::valarray<AsebaVMDecodedInstruction> decodedBytecode;
+#endif
+#ifdef ASEBA_VM_PROFILER
+    AsebaVMProfile profile;
+    std::valarray<uint32_t> profileCounters;
+#endif
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    std::valarray<uint16_t> variablesDirty;
+#endif
 
     SingleVMNodeGlue(std::string robotName, int16_t nodeId);
+
+protected:
+    //! Enable the profiling of the VM, must be called once the bytecode is allocated and before AsebaVMInit
+    void setupProfile();
+    //! Track written variables, must be called once the variables are allocated and before AsebaVMInit;
+    //! the robot must then call AsebaVMSetVariablesDirty for the variables it writes
+    void setupVariablesDirty();
 };
 
 struct AbstractNodeConnection {
@@ -67,12 +84,14 @@ struct AbstractNodeConnection {
     virtual uint16_t getBuffer(uint8_t* data, uint16_t maxLength, uint16_t* source) = 0;
 };
 
-// Mapping so that Aseba C callbacks can dispatch to the right objects
+// Objects that Aseba C callbacks dispatch to, pointed to by the userData field of the VM
 
 typedef std::pair<AbstractNodeGlue*, AbstractNodeConnection*> NodeEnvironment;
-typedef std::map<AsebaVMState*, NodeEnvironment> VMStateToEnvironment;
 
-extern VMStateToEnvironment vmStateToEnvironment;
+//! Return the environment of a VM, set by the robot owning it
+inline const NodeEnvironment& getNodeEnvironment(const AsebaVMState* vm) {
+    return *static_cast<const NodeEnvironment*>(vm->userData);
+}
 
 // Buffer for data reception
 
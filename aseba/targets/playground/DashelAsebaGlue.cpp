@@ -133,11 +133,9 @@ bool SimpleConnectionBase::handleSingleMessageData() {
     QByteArray data(m_messageSize + 2, Qt::Uninitialized);
     stream.readRawData(data.data(), data.size());
     m_lastMessage =  data;
-    for(auto vmStateToEnvironmentKV : vmStateToEnvironment) {
-        if(vmStateToEnvironmentKV.second.second == this) {
-            AsebaProcessIncomingEvents(vmStateToEnvironmentKV.first);
-            AsebaVMRun(vmStateToEnvironmentKV.first, 1000);
-        }
+    if(m_vm) {
+        AsebaProcessIncomingEvents(m_vm);
+        AsebaVMRun(m_vm, 1000);
     }
     return true;
 }
@@ -152,12 +150,10 @@ uint16_t SimpleConnectionBase::getBuffer(uint8_t* data, uint16_t maxLength, uint
     return s;
 }
 
-//! Clear breakpoints on all VM that are linked to this connection
+//! Clear breakpoints on the VM linked to this connection
 void SimpleConnectionBase::clearBreakpoints() {
-    for(auto vmStateToEnvironmentKV : vmStateToEnvironment) {
-        if(vmStateToEnvironmentKV.second.second == this)
-            vmStateToEnvironmentKV.first->breakpointsCount = 0;
-    }
+    if(m_vm)
+        m_vm->breakpointsCount = 0;
 }
 
 }  // namespace Aseba
@@ -61,6 +61,7 @@ private:
     uint16_t m_messageSize = 0;
     uint16_t m_messageSource = 0;
     QByteArray m_lastMessage;
+    AsebaVMState* m_vm = nullptr;  //!< the VM linked to this connection, set by SimpleConnection
 
 protected:
     void clearBreakpoints();
@@ -71,16 +72,18 @@ template <typename Robot>
 class SimpleConnection : public SimpleConnectionBase, public Robot {
 public:
     SimpleConnection(const QString& type, const QString& name, unsigned& port, uint16_t nodeId)
-        : SimpleConnectionBase(type, name, port), Robot(name.toStdString(), nodeId) {
-
-        Aseba::vmStateToEnvironment[&this->vm] =
-            std::make_pair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection*)this);
+        : SimpleConnectionBase(type, name, port), Robot(name.toStdString(), nodeId), environment(this, this) {
+        this->vm.userData = &environment;
+        m_vm = &this->vm;
     }
 
 public:
     void externalInputStep(double) {
         handleSingleMessageData();
     }
+
+private:
+    NodeEnvironment environment;
 };
 
 
@@ -18,18 +18,83 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include "DirectAsebaGlue.h"
 #include "EnkiGlue.h"
 #include "common/utils/FormatableString.h"
 #include "transport/buffer/vm-buffer.h"
 
 namespace Aseba {
-void DirectConnection::sendBuffer(uint16_t nodeId, const uint8_t* data, uint16_t length) {
-    // deserialize message
+// MessageRing
+
+MessageRing::MessageRing(size_t capacity) : slots(std::max<size_t>(capacity, 1)) {}
+
+MessageRing::Slot& MessageRing::push() {
+    if(count == slots.size()) {
+        // full, unroll the ring at the start of a larger one
+        std::rotate(slots.begin(), slots.begin() + head, slots.end());
+        slots.resize(slots.size() * 2);
+        head = 0;
+    }
+    Slot& slot(slots[(head + count) % slots.size()]);
+    ++count;
+    return slot;
+}
+
+void MessageRing::pop() {
+    assert(count);
+    head = (head + 1) % slots.size();
+    --count;
+}
+
+// DirectConnection
+
+void DirectConnection::pushInMessage(const Message& message) {
     Message::SerializationBuffer content;
-    std::copy(data + 2, data + length, std::back_inserter(content.rawData));
-    const uint16_t type(*reinterpret_cast<const uint16_t*>(data));
-    outQueue.emplace(Message::create(nodeId, type, content));
+    message.serializeSpecific(content);
+    assert(content.rawData.size() + 2 <= ASEBA_MAX_INNER_PACKET_SIZE);
+    auto& slot(inQueue.push());
+    slot.source = message.source;
+    slot.length = uint16_t(content.rawData.size() + 2);
+    const uint16_t type(bswap16(message.type));
+    memcpy(slot.data, &type, 2);
+    std::copy(content.rawData.begin(), content.rawData.end(), slot.data + 2);
+}
+
+std::unique_ptr<Message> DirectConnection::popOutMessage() {
+    if(outQueue.empty())
+        return nullptr;
+    const auto& slot(outQueue.front());
+    Message::SerializationBuffer content;
+    content.rawData.assign(slot.data + 2, slot.data + slot.length);
+    uint16_t type;
+    memcpy(&type, slot.data, 2);
+    std::unique_ptr<Message> message(Message::create(slot.source, bswap16(type), content));
+    outQueue.pop();
+    return message;
+}
+
+void DirectConnection::sendBuffer(uint16_t nodeId, const uint8_t* data, uint16_t length) {
+    // the buffer of the VM is reused for the next message, so keep a copy
+    assert(length <= ASEBA_MAX_INNER_PACKET_SIZE);
+    auto& slot(outQueue.push());
+    slot.source = nodeId;
+    slot.length = length;
+    memcpy(slot.data, data, length);
+}
+
+uint16_t DirectConnection::getBuffer(uint8_t* data, uint16_t maxLength, uint16_t* source) {
+    // only used by AsebaProcessIncomingEvents, as DirectlyConnected reads messages in place
+    if(inQueue.empty())
+        return 0;
+    const auto& slot(inQueue.front());
+    const uint16_t length(std::min(maxLength, slot.length));
+    *source = slot.source;
+    memcpy(data, slot.data, length);
+    inQueue.pop();
+    return length;
 }
 
 }  // namespace Aseba
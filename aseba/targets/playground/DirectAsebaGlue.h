@@ -22,22 +22,65 @@
 #define __PLAYGROUND_DIRECT_ASEBA_GLUE_H
 
 #include <memory>
-#include <queue>
+#include <vector>
 #include "common/msg/msg.h"
 #include "transport/buffer/vm-buffer.h"
 #include "AsebaGlue.h"
+#include "VMScheduler.h"
 
 // Implementation of the connection using direct connection
 
 namespace Aseba {
-class DirectConnection : public RecvBufferNodeConnection {
+//! A queue of messages in the raw form exchanged with the VM, stored in slots that are reused.
+//! Slots are allocated only when the queue grows beyond its largest size so far.
+//! The queue is not synchronized: it must be used by one thread at a time.
+class MessageRing {
 public:
-    using MessageQueue = std::queue<std::unique_ptr<Message> >;
-    MessageQueue inQueue;
-    MessageQueue outQueue;
+    //! A message as given to AsebaSendBuffer: its type followed by its payload, in little endian
+    struct Slot {
+        uint16_t source;
+        uint16_t length;  //!< number of bytes in data
+        alignas(uint16_t) uint8_t data[ASEBA_MAX_INNER_PACKET_SIZE];
+    };
+
+    explicit MessageRing(size_t capacity = 16);
+
+    bool empty() const {
+        return count == 0;
+    }
+    size_t size() const {
+        return count;
+    }
+    //! Append a slot and return it, to be filled by the caller; invalidates references to other slots
+    Slot& push();
+    //! Return the oldest slot
+    Slot& front() {
+        return slots[head];
+    }
+    //! Remove the oldest slot
+    void pop();
+
+private:
+    std::vector<Slot> slots;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+//! A connection to a VM running in the same process, messages are exchanged through rings of raw buffers
+class DirectConnection : public AbstractNodeConnection {
+public:
+    MessageRing inQueue;  //!< messages for the VM, in raw form
+    MessageRing outQueue;  //!< messages sent by the VM, in raw form
 
 public:
+    //! Serialize a message into inQueue; when the node is stepped by a VMScheduler, this must not be called
+    //! concurrently with VMScheduler::step(), which pops inQueue from its threads
+    void pushInMessage(const Message& message);
+    //! Deserialize and remove the oldest message of outQueue, return nullptr if there is none
+    std::unique_ptr<Message> popOutMessage();
+
     void sendBuffer(uint16_t nodeId, const uint8_t* data, uint16_t length) override;
+    uint16_t getBuffer(uint8_t* data, uint16_t maxLength, uint16_t* source) override;
 };
 
 }  // namespace Aseba
@@ -46,45 +89,52 @@ public:
 // Implementations of robots using Dashel
 
 namespace Enki {
+//! A robot whose VM exchanges messages through in-memory queues.
+//! Incoming messages are handled during the world step, or, once the robot is added to a VMScheduler,
+//! in batch and in parallel with the other robots whenever the scheduler is stepped.
+//! Messages must then be pushed between the steps of the scheduler, from the thread calling step().
 template <typename AsebaRobot>
-class DirectlyConnected : public AsebaRobot, public Aseba::DirectConnection {
+class DirectlyConnected : public AsebaRobot, public Aseba::DirectConnection, public Aseba::ScheduledNode {
 public:
     template <typename... Params>
-    DirectlyConnected(Params... parameters) : AsebaRobot(parameters...) {
-        Aseba::vmStateToEnvironment[&this->vm] =
-            std::make_pair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection*)this);
+    DirectlyConnected(Params... parameters) : AsebaRobot(parameters...), environment(this, this) {
+        this->vm.userData = &environment;
     }
 
     ~DirectlyConnected() override {
-        Aseba::vmStateToEnvironment.erase(&this->vm);
+        if(scheduler)
+            scheduler->remove(this);
+    }
+
+    // from ScheduledNode
+
+    void scheduledStep() override {
+        processInQueue();
     }
 
 protected:
     // from AbstractNodeGlue
 
     void externalInputStep(double) override {
+        // when scheduled, the scheduler processes the incoming messages
+        if(!scheduler)
+            processInQueue();
+    }
+
+    //! Execute the incoming messages on the VM of this robot
+    void processInQueue() {
         while(!inQueue.empty()) {
-            // serialize message into reception buffer
-            const auto message(inQueue.front().get());
-            lastMessageSource = message->source;
-            Aseba::Message::SerializationBuffer content;
-            message->serializeSpecific(content);
-            lastMessageData.resize(content.rawData.size() + 2);
-            *reinterpret_cast<uint16_t*>(&lastMessageData[0]) = message->type;
-            std::copy(&content.rawData[0], &content.rawData[content.rawData.size()], &lastMessageData[2]);
-
-            // execute event on all VM that are linked to this connection
-            for(auto vmStateToEnvironmentKV : Aseba::vmStateToEnvironment) {
-                if(vmStateToEnvironmentKV.second.second == this) {
-                    AsebaProcessIncomingEvents(vmStateToEnvironmentKV.first);
-                    AsebaVMRun(vmStateToEnvironmentKV.first, 1000);
-                }
-            }
-
-            // delete message
+            // execute event on the VM, reading the message in place
+            const auto& message(inQueue.front());
+            AsebaProcessIncomingBuffer(&this->vm, message.data, message.length, message.source);
+            AsebaVMRun(&this->vm, 1000);
+
             inQueue.pop();
         }
     }
+
+private:
+    Aseba::NodeEnvironment environment;
 };
 }  // namespace Enki
 
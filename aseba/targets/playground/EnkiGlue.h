@@ -27,6 +27,7 @@
 #include <enki/PhysicalEngine.h>
 #include "vm/vm.h"
 #include "common/utils/utils.h"
+#include "VMScheduler.h"
 
 namespace Enki {
 // Interface for Aseba-enabled Enki objects and their native functions
@@ -60,10 +61,15 @@ struct SimulatorEnvironment {
 //! A global pointer to the environment
 extern std::unique_ptr<SimulatorEnvironment> simulatorEnvironment;
 
-//! Helper macro to write notification sending in a convenient way
-#define SEND_NOTIFICATION(type, description, ...) \
-    if(Enki::simulatorEnvironment)                \
-        Enki::simulatorEnvironment->notify(Enki::EnvironmentNotificationType::type, description, {__VA_ARGS__});
+//! Helper macro to write notification sending in a convenient way.
+//! When called from a VM stepped by a VMScheduler, the notification is sent at the end of the tick.
+#define SEND_NOTIFICATION(type, description, ...)                                                             \
+    Aseba::VMScheduler::defer([notificationDescription = std::string(description),                            \
+                               notificationArguments = Enki::strings{__VA_ARGS__}] {                          \
+        if(Enki::simulatorEnvironment)                                                                        \
+            Enki::simulatorEnvironment->notify(Enki::EnvironmentNotificationType::type, notificationDescription, \
+                                               notificationArguments);                                        \
+    });
 
 //! Return the Enki object of a given type associated with a given vm
 template <typename ObjectType>
@@ -0,0 +1,135 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Copyright (C) 2007--2013:
+        Stephane Magnenat <stephane at magnenat dot net>
+        (http://stephane.magnenat.net)
+        and other contributors, see authors.txt for details
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include "VMScheduler.h"
+#include "vm/natives.h"
+
+namespace Aseba {
+
+// calls deferred by the node being stepped on this thread, if any
+static thread_local std::vector<std::function<void()>>* currentDeferred = nullptr;
+
+VMScheduler::VMScheduler(unsigned threadCount) {
+    if(threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for(unsigned i = 1; i < threadCount; ++i)
+        workers.emplace_back(&VMScheduler::workerLoop, this);
+}
+
+VMScheduler::~VMScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    tickStarted.notify_all();
+    for(auto& worker : workers)
+        worker.join();
+    for(auto& entry : entries)
+        entry.node->scheduler = nullptr;
+}
+
+void VMScheduler::add(ScheduledNode* node) {
+    assert(node->scheduler == nullptr);
+    node->scheduler = this;
+    // seeds are drawn in the order nodes are added, so they do not depend on threads
+    entries.push_back({node, AsebaGetRandom(), {}});
+}
+
+void VMScheduler::remove(ScheduledNode* node) {
+    const auto it(std::find_if(entries.begin(), entries.end(), [=](const Entry& e) { return e.node == node; }));
+    if(it == entries.end())
+        return;
+    node->scheduler = nullptr;
+    entries.erase(it);
+}
+
+void VMScheduler::step() {
+    if(entries.empty())
+        return;
+
+    // a few batches per thread, so that threads stepping costly VMs do not hold back the others
+    batchSize = std::max<size_t>(entries.size() / (threadCount() * 4), 1);
+    nextEntry = 0;
+    if(!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers = unsigned(workers.size());
+            ++tick;
+        }
+        tickStarted.notify_all();
+    }
+
+    runBatches();
+
+    if(!workers.empty()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        tickDone.wait(lock, [this] { return busyWorkers == 0; });
+    }
+
+    // run the deferred calls in the order of nodes
+    for(auto& entry : entries) {
+        for(auto& f : entry.deferred)
+            f();
+        entry.deferred.clear();
+    }
+}
+
+void VMScheduler::defer(std::function<void()> f) {
+    if(currentDeferred)
+        currentDeferred->push_back(std::move(f));
+    else
+        f();
+}
+
+void VMScheduler::workerLoop() {
+    unsigned seenTick = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        tickStarted.wait(lock, [&] { return stopping || tick != seenTick; });
+        if(stopping)
+            return;
+        seenTick = tick;
+        lock.unlock();
+        runBatches();
+        lock.lock();
+        if(--busyWorkers == 0)
+            tickDone.notify_one();
+    }
+}
+
+void VMScheduler::runBatches() {
+    const size_t count(entries.size());
+    for(size_t begin = nextEntry.fetch_add(batchSize); begin < count; begin = nextEntry.fetch_add(batchSize)) {
+        const size_t end(std::min(begin + batchSize, count));
+        for(size_t i = begin; i < end; ++i) {
+            Entry& entry(entries[i]);
+            // the random state is per thread, load the one of this node
+            AsebaSetRandomSeed(entry.randomSeed);
+            currentDeferred = &entry.deferred;
+            entry.node->scheduledStep();
+            currentDeferred = nullptr;
+            entry.randomSeed = AsebaGetRandom();
+        }
+    }
+}
+
+}  // namespace Aseba
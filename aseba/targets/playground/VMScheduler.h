@@ -0,0 +1,106 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Copyright (C) 2007--2013:
+        Stephane Magnenat <stephane at magnenat dot net>
+        (http://stephane.magnenat.net)
+        and other contributors, see authors.txt for details
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PLAYGROUND_VM_SCHEDULER_H
+#define __PLAYGROUND_VM_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common/types.h"
+
+namespace Aseba {
+
+class VMScheduler;
+
+//! A node whose VM can be stepped by a VMScheduler
+struct ScheduledNode {
+    //! Default virtual destructor
+    virtual ~ScheduledNode() = default;
+
+    //! Run the VM on the events received since the last tick; called from any thread of the scheduler,
+    //! so it must only touch this node, and defer anything else using VMScheduler::defer()
+    virtual void scheduledStep() = 0;
+
+    //! The scheduler stepping this node, if any
+    VMScheduler* scheduler = nullptr;
+};
+
+//! Steps a set of independent VMs once per simulation tick, in batches spread over a pool of threads.
+//! The result of a tick does not depend on the number of threads: every node has its own math.rand sequence,
+//! and the calls deferred by nodes are run after the tick, in the order in which the nodes were added.
+class VMScheduler {
+public:
+    //! Create a scheduler running on threadCount threads including the caller of step(), 0 for one per core
+    explicit VMScheduler(unsigned threadCount = 0);
+    ~VMScheduler();
+    VMScheduler(const VMScheduler&) = delete;
+    VMScheduler& operator=(const VMScheduler&) = delete;
+
+    //! Add a node, which will be stepped from the next tick on
+    void add(ScheduledNode* node);
+    //! Remove a node, must not be called while stepping
+    void remove(ScheduledNode* node);
+    //! Step all nodes once, and return when all of them are done.
+    //! Nodes are stepped from several threads without any lock, so their state, for instance their queue of
+    //! incoming messages, must not be accessed by other threads until step() returns.
+    void step();
+
+    //! Return the number of threads stepping nodes, including the caller of step()
+    unsigned threadCount() const {
+        return unsigned(workers.size()) + 1;
+    }
+    //! Return the number of nodes
+    size_t size() const {
+        return entries.size();
+    }
+
+    //! Run f once the current tick is over if called from a node being stepped, or immediately otherwise
+    static void defer(std::function<void()> f);
+
+private:
+    struct Entry {
+        ScheduledNode* node;
+        uint16_t randomSeed;  //!< state of math.rand for this node between ticks
+        std::vector<std::function<void()>> deferred;  //!< calls to run at the end of the tick
+    };
+
+    void workerLoop();
+    void runBatches();
+
+    std::vector<Entry> entries;
+    size_t batchSize = 1;
+    std::atomic<size_t> nextEntry{0};
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable tickStarted;
+    std::condition_variable tickDone;
+    unsigned tick = 0;  //!< number of ticks started, guarded by mutex
+    unsigned busyWorkers = 0;  //!< number of workers still stepping the current tick, guarded by mutex
+    bool stopping = false;  //!< whether workers must quit, guarded by mutex
+};
+
+}  // namespace Aseba
+
+#endif  // __PLAYGROUND_VM_SCHEDULER_H
@@ -52,6 +52,13 @@
 #    include "common/zeroconf/zeroconf-qt.h"
 #endif  // ZEROCONF_SUPPORT
 
+#ifdef ASEBA_VM_NGRAM_PROFILER
+#    include "vm/vm.h"
+#    include <algorithm>
+#    include <iostream>
+#    include <vector>
+#endif  // ASEBA_VM_NGRAM_PROFILER
+
 namespace Enki {
 //! The simulator environment for playground
 class PlaygroundSimulatorEnvironment : public SimulatorEnvironment {
@@ -102,6 +109,37 @@ struct RobotType {
     unsigned number = 0;           //!< number of robots of this type instantiated
 };
 
+#ifdef ASEBA_VM_NGRAM_PROFILER
+//! Print the most frequent sequences of bytecodes executed by the VMs, to select superinstructions
+static void dumpNGramCounts(std::ostream& os, size_t maxCount = 20) {
+    static const char* const bytecodeNames[16] = {
+        "stop",  "small immediate", "large immediate", "load",  "store",    "load indirect",
+        "store indirect", "unary arithmetic", "binary arithmetic", "jump", "conditional branch",
+        "emit",  "native call", "sub call", "sub ret", "unknown"};
+
+    for(uint16_t n = 2; n <= 4; ++n) {
+        std::vector<std::pair<uint32_t, uint16_t>> counts;
+        for(uint32_t ngram = 0; ngram < (1u << (4 * n)); ++ngram) {
+            const uint32_t count(AsebaVMGetNGramCount(uint16_t(ngram), n));
+            if(count)
+                counts.emplace_back(count, uint16_t(ngram));
+        }
+        std::sort(counts.rbegin(), counts.rend());
+        if(counts.size() > maxCount)
+            counts.resize(maxCount);
+
+        os << "Most frequent sequences of " << n << " bytecodes:\n";
+        for(const auto& count : counts) {
+            os << "  " << count.first << ":";
+            for(int i = n - 1; i >= 0; --i)
+                os << " " << bytecodeNames[(count.second >> (4 * i)) & 0xf] << (i ? ";" : "");
+            os << "\n";
+        }
+    }
+    os.flush();
+}
+#endif  // ASEBA_VM_NGRAM_PROFILER
+
 
 int main(int argc, char* argv[]) {
     Q_INIT_RESOURCE(asebaqtabout);
@@ -478,6 +516,10 @@ int main(int argc, char* argv[]) {
     // Run the application
     const int exitValue(app.exec());
 
+#ifdef ASEBA_VM_NGRAM_PROFILER
+    dumpNGramCounts(std::cerr);
+#endif  // ASEBA_VM_NGRAM_PROFILER
+
     // Stop and delete ongoing processes
     foreach(QProcess* process, processes) {
         process->terminate();
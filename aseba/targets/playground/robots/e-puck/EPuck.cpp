@@ -68,6 +68,7 @@ extern "C" void PlaygroundEPuckNative_energyamount(AsebaVMState* vm) {
     int index = AsebaNativePopArg(vm);
 
     vm->variables[index] = energyPool;
+    AsebaVMSetVariablesDirty(vm, index, 1);
 }
 
 extern "C" AsebaNativeFunctionDescription PlaygroundEPuckNativeDescription_energyamount;
@@ -152,6 +153,11 @@ AsebaFeedableEPuck::AsebaFeedableEPuck(std::string robotName, int16_t nodeId)
     bytecode.resize(1024);
     vm.bytecode = &bytecode[0];
     vm.bytecodeSize = uint16_t(bytecode.size());
+#ifdef ASEBA_VM_PREDECODE
+    decodedBytecode.resize(bytecode.size());
+    vm.decoded = &decodedBytecode[0];
+#endif
+    setupProfile();
 
     stack.resize(32);
     vm.stack = &stack[0];
@@ -160,6 +166,7 @@ AsebaFeedableEPuck::AsebaFeedableEPuck(std::string robotName, int16_t nodeId)
     vm.variables = reinterpret_cast<int16_t*>(&variables);
     vm.variablesOld = reinterpret_cast<int16_t*>(&variablesOld);
     vm.variablesSize = sizeof(variables) / sizeof(int16_t);
+    setupVariablesDirty();
 
     AsebaVMInit(&vm);
 
@@ -211,6 +218,9 @@ void AsebaFeedableEPuck::controlStep(double dt) {
 
     // set motion
     FeedableEPuck::controlStep(dt);
+
+    // the variables of the robot, written above or from outside, are compared at the next poll
+    AsebaVMSetVariablesDirty(&vm, 0, uint16_t(variables.user - vm.variables));
 }
 
 
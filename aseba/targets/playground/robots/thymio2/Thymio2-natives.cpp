@@ -84,6 +84,7 @@ extern "C" void PlaygroundThymio2Native_sound_duration(AsebaVMState* vm) {
     const uint16_t durationAddr(AsebaNativePopArg(vm));
 
     vm->variables[durationAddr] = 0;
+    AsebaVMSetVariablesDirty(vm, durationAddr, 1);
 
     logNativeFromVM(vm, 21, {number, static_cast<int16_t>(durationAddr)});
 
@@ -291,6 +292,7 @@ extern "C" void PlaygroundThymio2Native_sd_open(AsebaVMState* vm) {
         }
 
         vm->variables[statusAddr] = result;
+        AsebaVMSetVariablesDirty(vm, statusAddr, 1);
 
         logNativeFromThymio2(*thymio2, 17, {number, result});
     }
@@ -314,6 +316,7 @@ extern "C" void PlaygroundThymio2Native_sd_write(AsebaVMState* vm) {
         // not handled properly.
 
         vm->variables[statusAddr] = result;
+        AsebaVMSetVariablesDirty(vm, statusAddr, 1);
 
         // log the data written and the status
         std::vector<int16_t> data(&vm->variables[dataAddr], &vm->variables[dataAddr + dataLength]);
@@ -334,12 +337,15 @@ extern "C" void PlaygroundThymio2Native_sd_read(AsebaVMState* vm) {
         if(thymio2->sdCardFile)
             thymio2->sdCardFile.read(reinterpret_cast<char*>(&vm->variables[dataAddr]), dataLength * 2);
 
+        AsebaVMSetVariablesDirty(vm, dataAddr, dataLength);
+
         if(thymio2->sdCardFile)
             result = dataLength;
         else
             result = int16_t(thymio2->sdCardFile.gcount() / 2);
 
         vm->variables[statusAddr] = result;
+        AsebaVMSetVariablesDirty(vm, statusAddr, 1);
 
         // log the data read and the status
         std::vector<int16_t> data(&vm->variables[dataAddr], &vm->variables[dataAddr + dataLength]);
@@ -370,6 +376,7 @@ extern "C" void PlaygroundThymio2Native_sd_seek(AsebaVMState* vm) {
             result = -1;
 
         vm->variables[statusAddr] = result;
+        AsebaVMSetVariablesDirty(vm, statusAddr, 1);
 
         logNativeFromThymio2(*thymio2, 20, {seek, result});
     }
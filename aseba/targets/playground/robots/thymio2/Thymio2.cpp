@@ -44,6 +44,11 @@ AsebaThymio2::AsebaThymio2(std::string robotName, int16_t nodeId)
     bytecode.resize(766 + 768);
     vm.bytecode = &bytecode[0];
     vm.bytecodeSize = uint16_t(bytecode.size());
+#ifdef ASEBA_VM_PREDECODE
+    decodedBytecode.resize(bytecode.size());
+    vm.decoded = &decodedBytecode[0];
+#endif
+    setupProfile();
 
     stack.resize(32);
     vm.stack = &stack[0];
@@ -52,6 +57,7 @@ AsebaThymio2::AsebaThymio2(std::string robotName, int16_t nodeId)
     vm.variables = reinterpret_cast<int16_t*>(&variables);
     vm.variablesOld = reinterpret_cast<int16_t*>(&variablesOld);
     vm.variablesSize = sizeof(variables) / sizeof(int16_t);
+    setupVariablesDirty();
 
     AsebaVMInit(&vm);
 
@@ -170,6 +176,9 @@ void AsebaThymio2::controlStep(double dt) {
         execLocalEvent(EVENT_TAP);
     lastStepCollided = thisStepCollided;
     thisStepCollided = false;
+
+    // the variables of the robot, written above or from outside, are compared at the next poll
+    AsebaVMSetVariablesDirty(&vm, 0, uint16_t(variables.freeSpace - vm.variables));
 }
 
 // robot description
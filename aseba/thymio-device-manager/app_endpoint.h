@@ -1,9 +1,11 @@
 #pragma once
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
+#include <limits>
 #include <memory>
 #include <type_traits>
-#include <queue>
+#include <optional>
+#include "app_message_queue.h"
 #include "flatbuffers_message_writer.h"
 #include "flatbuffers_message_reader.h"
 #include "flatbuffers_messages.h"
@@ -29,8 +31,12 @@ public:
     template <typename CB>
     void read_message(CB&& handle) = delete;
     void start() = delete;
-    void do_write_message(const flatbuffers::DetachedBuffer& buffer) = delete;
+    void do_write_messages(const std::vector<app_message_queue::message>& messages) = delete;
+    std::size_t max_messages_per_write() const = delete;
+    std::size_t max_bytes_per_write(std::size_t max_message_size) const = delete;
+    void set_capabilities(uint64_t capabilities) = delete;
     tcp::socket& tcp_socket() = delete;
+    void close() = delete;
 };
 
 template <typename Self>
@@ -61,13 +67,37 @@ public:
         m_socket.async_read(m_buffer, std::move(cb));
     }
 
-    void do_write_message(const flatbuffers::DetachedBuffer& buffer) {
+    // Optional features of the protocol supported by this transport
+    static constexpr uint64_t supported_capabilities = uint64_t(fb::ProtocolCapability::MultiMessageFrames);
+
+    void set_capabilities(uint64_t capabilities) {
+        m_multi_message_frames = capabilities & uint64_t(fb::ProtocolCapability::MultiMessageFrames);
+    }
+
+    std::size_t max_messages_per_write() const {
+        return m_multi_message_frames ? std::numeric_limits<std::size_t>::max() : 1;
+    }
+
+    // A frame must not be larger than what the client accepts
+    std::size_t max_bytes_per_write(std::size_t max_message_size) const {
+        return max_message_size;
+    }
+
+    void do_write_messages(const std::vector<app_message_queue::message>& messages) {
         auto that = this->shared_from_this();
         auto cb = boost::asio::bind_executor(m_strand, [that](boost::system::error_code ec, std::size_t) {
             static_cast<Self&>(*that).handle_write(ec);
         });
-        m_socket.async_write(boost::asio::buffer(buffer.data(), buffer.size()), std::move(cb));
+        if(!m_multi_message_frames) {
+            const auto& buffer = messages.front()->buffer;
+            m_socket.async_write(boost::asio::buffer(buffer.data(), buffer.size()), std::move(cb));
+            return;
+        }
+        // One frame with all the messages, each one prefixed by its size
+        m_write_sequence.assign(messages);
+        m_socket.async_write(m_write_sequence.buffers(), std::move(cb));
     }
+
     void start() {
         m_socket.binary(true);
         auto that = this->shared_from_this();
@@ -80,6 +110,11 @@ public:
         return m_socket.next_layer();
     }
 
+    void close() {
+        boost::system::error_code ec;
+        m_socket.next_layer().close(ec);
+    }
+
 protected:
     boost::asio::io_context& m_ctx;
     boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
@@ -87,6 +122,8 @@ protected:
 private:
     boost::beast::multi_buffer m_buffer;
     websocket_t m_socket;
+    flatbuffer_messages_sequence m_write_sequence;
+    bool m_multi_message_frames = false;
 };
 
 
@@ -100,17 +137,32 @@ public:
     void read_message(CB handle) {
         auto that = this->shared_from_this();
         auto cb = boost::asio::bind_executor(
-            m_strand, [that, handle = std::move(handle)](boost::system::error_code ec, fb_message_ptr&& msg) {
+            m_strand, [that, handle = std::move(handle)](boost::system::error_code ec, fb_message_ptr&& msg) mutable {
                 handle(ec, std::move(msg));
             });
         mobsya::async_read_flatbuffers_message(m_socket, std::move(cb));
     }
 
-    void do_write_message(const flatbuffers::DetachedBuffer& buffer) {
-        auto cb = boost::asio::bind_executor(m_strand, [that = this->shared_from_this()](boost::system::error_code ec) {
-            static_cast<Self&>(*that).handle_write(ec);
-        });
-        mobsya::async_write_flatbuffer_message(m_socket, buffer, std::move(cb));
+    static constexpr uint64_t supported_capabilities = 0;
+
+    void set_capabilities(uint64_t) {}
+
+    std::size_t max_messages_per_write() const {
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    std::size_t max_bytes_per_write(std::size_t) const {
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    // Write all the messages with a single gather write
+    void do_write_messages(const std::vector<app_message_queue::message>& messages) {
+        auto cb = boost::asio::bind_executor(
+            m_strand, [that = this->shared_from_this()](boost::system::error_code ec, std::size_t) {
+                static_cast<Self&>(*that).handle_write(ec);
+            });
+        m_write_sequence.assign(messages);
+        boost::asio::async_write(m_socket, m_write_sequence.buffers(), std::move(cb));
     }
 
     void start() {
@@ -121,12 +173,18 @@ public:
         return m_socket;
     }
 
+    void close() {
+        boost::system::error_code ec;
+        m_socket.close(ec);
+    }
+
 protected:
     boost::asio::io_context& m_ctx;
     boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
 
 private:
     tcp::socket m_socket;
+    flatbuffer_messages_sequence m_write_sequence;
 };
 
 template <typename Socket>
@@ -134,13 +192,29 @@ class application_endpoint : public application_endpoint_base<application_endpoi
                              public node_status_monitor {
 public:
     using base = application_endpoint_base<application_endpoint<Socket>, Socket>;
-    application_endpoint(boost::asio::io_context& ctx) : base(ctx), m_ctx(ctx), m_pings_timer(ctx) {}
+    application_endpoint(boost::asio::io_context& ctx)
+        : base(ctx)
+        , m_ctx(ctx)
+        , m_devices_strand(boost::asio::use_service<aseba_node_registery>(ctx).strand())
+        , m_pings_timer(ctx) {}
+
+    // The endpoint uses the nodes when it is destroyed, which must then happen on the strand of the registery
+    static std::shared_ptr<application_endpoint> create(boost::asio::io_context& ctx) {
+        auto strand = boost::asio::use_service<aseba_node_registery>(ctx).strand();
+        return std::shared_ptr<application_endpoint>(new application_endpoint(ctx), [strand](application_endpoint* e) {
+            boost::asio::dispatch(strand, [e] { delete e; });
+        });
+    }
 
     void set_local(bool is_local) {
         this->m_local_endpoint = is_local;
     }
 
     void start() {
+        if(!m_devices_strand.running_in_this_thread()) {
+            boost::asio::post(m_devices_strand, [that = shared_from_this()] { that->start(); });
+            return;
+        }
         mLogInfo("Starting app endpoint");
 
         // Prevent the system to go to sleep while an app is connected
@@ -160,9 +234,19 @@ public:
         start_node_monitoring(registery());
     }
 
+    // The socket is read on the strand of the endpoint, the requests are handled on the strand of the registery,
+    // along with the nodes they use
     template <typename CB>
     void read_message(CB&& handle) {
-        base::read_message(std::forward<CB>(handle));
+        boost::asio::dispatch(this->m_strand, [that = shared_from_this(), handle = std::forward<CB>(handle)]() mutable {
+            that->base::read_message([that, handle = std::move(handle)](boost::system::error_code ec,
+                                                                        fb_message_ptr&& msg) mutable {
+                boost::asio::post(that->m_devices_strand,
+                                  [that, handle = std::move(handle), ec, msg = std::move(msg)]() mutable {
+                                      handle(ec, std::move(msg));
+                                  });
+            });
+        });
     }
 
     void read_message() {
@@ -171,11 +255,16 @@ public:
     }
 
     void write_message(tagged_detached_flatbuffer&& buffer) {
-        m_queue.emplace(std::move(buffer));
-        if(m_queue.size() > 1 || m_protocol_version == 0)
-            return;
+        write_message(std::make_shared<tagged_detached_flatbuffer>(std::move(buffer)));
+    }
 
-        base::do_write_message(m_queue.front().buffer);
+    // Queue a message which may be shared with other endpoints, it is not copied.
+    // Can be called from any thread, the queue is only used on the strand of the endpoint
+    void write_message(std::shared_ptr<const tagged_detached_flatbuffer> buffer) {
+        boost::asio::dispatch(this->m_strand, [that = shared_from_this(), buffer = std::move(buffer)]() mutable {
+            that->m_queue.push(std::move(buffer));
+            that->on_message_queued();
+        });
     }
 
 
@@ -248,7 +337,8 @@ public:
             }
             case mobsya::fb::AnyMessage::WatchNode: {
                 auto req = msg.as<fb::WatchNode>();
-                this->watch_node_or_group(req->request_id(), req->node_or_group_id(), req->info_type());
+                this->watch_node_or_group(req->request_id(), req->node_or_group_id(), req->info_type(),
+                                          variables_watch(*req));
                 break;
             }
             case mobsya::fb::AnyMessage::SetBreakpoints: {
@@ -256,6 +346,11 @@ public:
                 this->set_breakpoints(req->request_id(), req->node_id(), breakpoints(*req));
                 break;
             }
+            case mobsya::fb::AnyMessage::RequestVMProfile: {
+                auto req = msg.as<fb::RequestVMProfile>();
+                this->fetch_vm_profile(req->request_id(), req->node_id());
+                break;
+            }
             case mobsya::fb::AnyMessage::ScratchpadUpdate: {
                 auto req = msg.as<fb::ScratchpadUpdate>();
                 if(!req->node_id()) {
@@ -293,7 +388,10 @@ public:
                 if(service.is_enabled() == req->enable())
                     break;
                 if(req->enable()) {
-                    service.wireless_dongles_changed.connect([this] { this->send_list_of_thymio2_dongles(); });
+                    service.wireless_dongles_changed.connect([ptr = weak_from_this()] {
+                        if(auto that = ptr.lock())
+                            that->send_list_of_thymio2_dongles();
+                    });
                     service.enable();
                 } else {
                     service.disable();
@@ -306,14 +404,14 @@ public:
     }
 
     void handle_write(boost::system::error_code ec) {
-        mLogTrace("<- {} : {} ", EnumNameAnyMessage(m_queue.front().tag), ec.message());
+        const auto queued = m_queue.size();
+        m_queue.finish_writing();
+        mLogTrace("<- {} messages : {} ({} queued)", queued - m_queue.size(), ec.message(), m_queue.size());
         if(ec) {
             mLogError("handle_write : error {}", ec.message());
         }
-        m_queue.pop();
-        if(!m_queue.empty()) {
-            base::do_write_message(m_queue.front().buffer);
-        }
+        flush_queue();
+        check_queue_budget();
     }
 
     ~application_endpoint() {
@@ -335,48 +433,54 @@ public:
         }
     }
 
+    // Called on the strand of the registery, the variables and events only go through the queue
     void node_changed(std::shared_ptr<aseba_node> node, const aseba_node_registery::node_id& id,
                       aseba_node::status status) {
-        boost::asio::post(this->m_strand, [that = this->shared_from_this(), node, id, status]() {
-            that->do_node_changed(node, id, status);
+        boost::asio::post(m_devices_strand, [ptr = weak_from_this(), node, id, status]() {
+            if(auto that = ptr.lock())
+                that->do_node_changed(node, id, status);
         });
     }
 
-    void node_variables_changed(std::shared_ptr<aseba_node> node, const variables_map& map,
-                                const std::chrono::system_clock::time_point& timestamp) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), node, map, timestamp]() {
-            that->do_node_variables_changed(node, map, timestamp);
+    void node_variables_changed(std::shared_ptr<aseba_node> node, shared_node_values_update update) {
+        boost::asio::defer(this->m_strand, [ptr = weak_from_this(), id = node->uuid(), update]() {
+            if(auto that = ptr.lock())
+                that->do_node_variables_changed(id, update);
         });
     }
 
     void group_variables_changed(std::shared_ptr<group> group, const variables_map& map) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), group, map]() {
-            that->do_group_variables_changed(group, map);
+        boost::asio::defer(this->m_strand, [ptr = weak_from_this(), id = group->uuid(), map]() {
+            if(auto that = ptr.lock())
+                that->do_group_variables_changed(id, map);
         });
     }
 
-    void node_emitted_events(std::shared_ptr<aseba_node> node, const variables_map& events,
-                             const std::chrono::system_clock::time_point& timestamp) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), node, events, timestamp]() {
-            that->do_node_emitted_events(node, events, timestamp);
+    void node_emitted_events(std::shared_ptr<aseba_node>, shared_node_values_update update) {
+        boost::asio::defer(this->m_strand, [ptr = weak_from_this(), update]() {
+            if(auto that = ptr.lock())
+                that->do_node_emitted_events(update);
         });
     }
 
     void events_description_changed(std::shared_ptr<group> group, const events_table& events) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), group, events]() {
-            that->do_events_description_changed(group, events);
+        boost::asio::defer(m_devices_strand, [ptr = weak_from_this(), group, events]() {
+            if(auto that = ptr.lock())
+                that->do_events_description_changed(group, events);
         });
     }
 
     void scratchpad_changed(std::shared_ptr<group> group, const group::scratchpad& scratchpad) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), group, scratchpad]() {
-            that->do_scratchpad_changed(group, scratchpad);
+        boost::asio::defer(m_devices_strand, [ptr = weak_from_this(), group, scratchpad]() {
+            if(auto that = ptr.lock())
+                that->do_scratchpad_changed(group, scratchpad);
         });
     }
 
     void node_execution_state_changed(std::shared_ptr<aseba_node> node, const aseba_node::vm_execution_state& state) {
-        boost::asio::defer(this->m_strand, [that = this->shared_from_this(), node, state]() {
-            that->do_node_execution_state_changed(node, state);
+        boost::asio::defer(m_devices_strand, [ptr = weak_from_this(), node, state]() {
+            if(auto that = ptr.lock())
+                that->do_node_execution_state_changed(node, state);
         });
     }
 
@@ -407,24 +511,66 @@ private:
         }
     }
 
-    void do_node_variables_changed(std::shared_ptr<aseba_node> node, const variables_map& map,
-                                   const std::chrono::system_clock::time_point& timestamp) {
-        if(!node)
-            return;
-        write_message(serialize_changed_variables(*node, map, timestamp));
+    void do_node_variables_changed(const node_id& id, const shared_node_values_update& update) {
+        // The values are only converted to properties if the update gets merged
+        auto source = [update] { return update->values.to_variables_map(); };
+        m_queue.push_variables(id, shared_message(update), app_message_queue::variables_source(source),
+                               [id, timestamp = update->timestamp](const variables_map& values) {
+                                   return std::make_shared<tagged_detached_flatbuffer>(
+                                       serialize_changed_variables(id, values, timestamp));
+                               });
+        on_message_queued();
+    }
+
+    void do_group_variables_changed(const node_id& id, const variables_map& map) {
+        auto serialize = [id](const variables_map& values) {
+            return std::make_shared<tagged_detached_flatbuffer>(serialize_changed_variables(id, values));
+        };
+        m_queue.push_variables(id, serialize(map), std::make_shared<variables_map>(map), serialize);
+        on_message_queued();
+    }
+
+    void do_node_emitted_events(const shared_node_values_update& update) {
+        m_queue.push_droppable(shared_message(update));
+        on_message_queued();
+    }
+
+    void on_message_queued() {
+        flush_queue();
+        check_queue_budget();
     }
 
-    void do_group_variables_changed(std::shared_ptr<group> grp, const variables_map& map) {
-        if(!grp)
+    // Unless a write is in progress, write as many queued messages at once as the transport allows
+    void flush_queue() {
+        if(m_queue.empty() || m_queue.writing() || m_protocol_version == 0)
             return;
-        write_message(serialize_changed_variables(*grp, map));
+        const std::size_t max_message_size =
+            m_max_out_going_packet_size ? m_max_out_going_packet_size : tdm::maxAppEndPointMessageSize;
+        base::do_write_messages(m_queue.start_writing(base::max_messages_per_write(),
+                                                      base::max_bytes_per_write(max_message_size),
+                                                      sizeof(uint32_t)));
     }
 
-    void do_node_emitted_events(std::shared_ptr<aseba_node> node, const variables_map& events,
-                                const std::chrono::system_clock::time_point& timestamp) {
-        if(!node)
+    void check_queue_budget() {
+        if(!m_queue.over_budget()) {
+            if(m_lagging_since) {
+                mLogInfo("Application caught up, {} messages queued", m_queue.size());
+                m_lagging_since.reset();
+            }
             return;
-        write_message(serialize_events(*node, events, timestamp));
+        }
+        const auto& stats = m_queue.statistics();
+        const auto now = std::chrono::steady_clock::now();
+        if(!m_lagging_since) {
+            mLogWarn("Application is too slow, {} messages ({} bytes) queued, dropping its events",
+                     stats.messages, stats.bytes);
+            m_lagging_since = now;
+        } else if(now - *m_lagging_since > tdm::maxAppEndPointQueueLag && !m_closing) {
+            mLogError("Application stayed too far behind, disconnecting it ({} bytes queued, {} merged, {} dropped)",
+                      stats.bytes, stats.merged, stats.dropped);
+            m_closing = true;
+            base::close();
+        }
     }
 
     void do_events_description_changed(std::shared_ptr<group> group, const events_table& events) {
@@ -657,7 +803,10 @@ private:
                 if(!that)
                     return;
                 if(ec) {
-                    that->write_message(create_error_response(request_id, fb::ErrorType::unknown_node));
+                    // superseded by a newer compilation of the same node
+                    const auto error = ec == boost::asio::error::operation_aborted ? fb::ErrorType::unknown_error :
+                                                                                     fb::ErrorType::unknown_node;
+                    that->write_message(create_error_response(request_id, error));
                     return;
                 }
                 that->write_message(create_compilation_result_response(request_id, result));
@@ -707,6 +856,31 @@ private:
         n->set_breakpoints(breakpoints, callback);
     }
 
+    void fetch_vm_profile(uint32_t request_id, aseba_node_registery::node_id id) {
+        auto n = get_locked_node(id);
+        if(!n) {
+            mLogWarn("fetch_vm_profile: node {} not locked", id);
+            write_message(create_error_response(request_id, fb::ErrorType::unknown_node));
+            return;
+        }
+        auto callback = [request_id, strand = m_devices_strand, ptr = weak_from_this(),
+                         node = std::weak_ptr<aseba_node>(n)](boost::system::error_code ec,
+                                                              aseba_node::vm_profile profile) {
+            boost::asio::post(strand, [ec, profile = std::move(profile), request_id, ptr, node]() {
+                auto that = ptr.lock();
+                auto n = node.lock();
+                if(!that)
+                    return;
+                if(ec || !n) {
+                    that->write_message(create_error_response(request_id, fb::ErrorType::unknown_error));
+                    return;
+                }
+                that->write_message(create_vm_profile_response(request_id, *n, profile));
+            });
+        };
+        n->fetch_profile(callback);
+    }
+
     void update_node_scratchpad(uint32_t request_id, node_id id, std::string_view content,
                                 fb::ProgrammingLanguage language) {
         const auto n = get_locked_node(id);
@@ -789,7 +963,8 @@ private:
             fb::CreateThymio2WirelessDonglePairingResponse(builder, request_id, dongle.network_id, dongle.channel)));
     }
 
-    void watch_node_or_group(uint32_t request_id, const aseba_node_registery::node_id& id, uint32_t flags) {
+    void watch_node_or_group(uint32_t request_id, const aseba_node_registery::node_id& id, uint32_t flags,
+                             aseba_node::variables_watch watch) {
         auto group = registery().group_from_id(id);
         auto node = registery().node_from_id(id);
         if(!node && !group) {
@@ -845,20 +1020,20 @@ private:
         if(node) {
             if(flags & uint32_t(fb::WatchableInfo::Variables)) {
                 if(!m_watch_nodes[fb::WatchableInfo::Variables].count(id)) {
-                    auto variables = node->variables();
-                    this->node_variables_changed(node, variables, std::chrono::system_clock::now());
+                    this->node_variables_changed(node, make_variables_update(*node, node->snapshot_variables(),
+                                                                             std::chrono::system_clock::now()));
                 }
                 m_watch_nodes[fb::WatchableInfo::Variables][id] = node->connect_to_variables_changes(
                     std::bind(&application_endpoint::node_variables_changed, this, std::placeholders::_1,
-                              std::placeholders::_2, std::placeholders::_3));
+                              std::placeholders::_2),
+                    std::move(watch));
             } else {
                 m_watch_nodes[fb::WatchableInfo::Variables].erase(id);
             }
 
             if(flags & uint32_t(fb::WatchableInfo::Events)) {
-                m_watch_nodes[fb::WatchableInfo::Events][id] = node->connect_to_events(
-                    std::bind(&application_endpoint::node_emitted_events, this, std::placeholders::_1,
-                              std::placeholders::_2, std::placeholders::_3));
+                m_watch_nodes[fb::WatchableInfo::Events][id] = node->connect_to_events(std::bind(
+                    &application_endpoint::node_emitted_events, this, std::placeholders::_1, std::placeholders::_2));
             } else {
                 m_watch_nodes[fb::WatchableInfo::Events].erase(id);
             }
@@ -937,24 +1112,42 @@ private:
             return;
         }
         auto hs = msg.as<fb::ConnectionHandshake>();
+        uint16_t protocol_version = 0;
+        uint32_t max_out_going_packet_size = 0;
+        uint64_t capabilities = 0;
         if(hs->protocolVersion() < tdm::minProtocolVersion || tdm::protocolVersion < hs->minProtocolVersion()) {
             mLogError("Client protocol version ({}) is not compatible with this server({}+)", hs->protocolVersion(),
                       tdm::minProtocolVersion);
         } else {
-            m_protocol_version = std::min(hs->protocolVersion(), tdm::protocolVersion);
-            m_max_out_going_packet_size = hs->maxMessageSize();
+            protocol_version = std::min(hs->protocolVersion(), tdm::protocolVersion);
+            max_out_going_packet_size = hs->maxMessageSize();
+            capabilities = hs->capabilities() & base::supported_capabilities;
             auto& token_manager = boost::asio::use_service<app_token_manager>(m_ctx);
             // TODO ?
             if(hs->token())
                 token_manager.check_token(app_token_manager::token_view{hs->token()->data(), hs->token()->size()});
         }
-        flatbuffers::FlatBufferBuilder builder;
-        write_message(wrap_fb(builder,
-                              fb::CreateConnectionHandshake(builder, tdm::minProtocolVersion, m_protocol_version,
-                                                            tdm::maxAppEndPointMessageSize, 0, m_local_endpoint)));
+        // The state of the connection belongs to the strand of the endpoint, it is updated before
+        // any message queued below is written
+        boost::asio::dispatch(this->m_strand, [that = shared_from_this(), protocol_version, max_out_going_packet_size,
+                                               capabilities]() {
+            that->m_protocol_version = protocol_version;
+            that->m_max_out_going_packet_size = max_out_going_packet_size;
+            // The handshake must be the first message the client receives, the list of nodes sent below
+            // covers the status changes that may have been queued until now
+            that->m_queue.clear();
+            flatbuffers::FlatBufferBuilder builder;
+            that->m_queue.push(std::make_shared<tagged_detached_flatbuffer>(
+                wrap_fb(builder, fb::CreateConnectionHandshake(builder, tdm::minProtocolVersion, protocol_version,
+                                                               tdm::maxAppEndPointMessageSize, 0,
+                                                               that->m_local_endpoint, capabilities))));
+            that->on_message_queued();
+            // The handshake itself is written without the negotiated capabilities
+            that->base::set_capabilities(capabilities);
+        });
 
         // the client do not have a compatible protocol version, bailing out
-        if(m_protocol_version == 0) {
+        if(protocol_version == 0) {
             return;
         }
 
@@ -968,35 +1161,41 @@ private:
 
     void start_sending_pings() {
         m_pings_timer.expires_from_now(boost::posix_time::milliseconds(2500));
-        m_pings_timer.async_wait([ptr = weak_from_this()](boost::system::error_code ec) {
-            if(ec)
-                return;
-            if(auto that = ptr.lock()) {
-                flatbuffers::FlatBufferBuilder builder;
-                that->write_message(wrap_fb(builder, fb::CreatePing(builder)));
-                that->start_sending_pings();
-            }
-        });
+        m_pings_timer.async_wait(
+            boost::asio::bind_executor(this->m_strand, [ptr = weak_from_this()](boost::system::error_code ec) {
+                if(ec)
+                    return;
+                if(auto that = ptr.lock()) {
+                    flatbuffers::FlatBufferBuilder builder;
+                    that->write_message(wrap_fb(builder, fb::CreatePing(builder)));
+                    that->start_sending_pings();
+                }
+            }));
     }
 
     std::shared_ptr<application_endpoint<Socket>> shared_from_this() {
         return std::static_pointer_cast<application_endpoint<Socket>>(base::shared_from_this());
     }
 
+    // Unlike shared_from_this, can be called while the endpoint is waiting to be destroyed
     std::weak_ptr<application_endpoint<Socket>> weak_from_this() {
-        return std::static_pointer_cast<application_endpoint<Socket>>(this->shared_from_this());
+        return std::static_pointer_cast<application_endpoint<Socket>>(base::weak_from_this().lock());
     }
 
     boost::asio::io_context& m_ctx;
+    // Strand of the registery, on which the nodes and groups are used
+    aseba_node_registery::strand_type m_devices_strand;
     boost::asio::deadline_timer m_pings_timer;
-    std::queue<tagged_detached_flatbuffer> m_queue;
+    app_message_queue m_queue{tdm::maxAppEndPointQueueSize};
+    std::optional<std::chrono::steady_clock::time_point> m_lagging_since;
+    bool m_closing = false;
     std::unordered_map<aseba_node_registery::node_id, std::weak_ptr<aseba_node>, boost::hash<boost::uuids::uuid>>
         m_locked_nodes;
     std::unordered_map<fb::WatchableInfo,
                        std::unordered_map<aseba_node_registery::node_id, boost::signals2::scoped_connection>>
         m_watch_nodes;
     uint16_t m_protocol_version = 0;
-    uint16_t m_max_out_going_packet_size = 0;
+    uint32_t m_max_out_going_packet_size = 0;
     bool m_local_endpoint = false;
 };
 
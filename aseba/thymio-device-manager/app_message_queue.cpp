@@ -0,0 +1,98 @@
+#include "app_message_queue.h"
+#include <algorithm>
+
+namespace mobsya {
+
+void app_message_queue::push(message m) {
+    append({std::move(m), {}, {}, {}});
+}
+
+bool app_message_queue::push_droppable(message m) {
+    if(m_stats.bytes + m->buffer.size() > m_byte_budget) {
+        m_stats.dropped++;
+        return false;
+    }
+    push(std::move(m));
+    return true;
+}
+
+void app_message_queue::push_variables(const node_id& id, message m, shared_variables values,
+                                       variables_serializer serialize) {
+    push_variables(id, std::move(m), variables_source([values = std::move(values)] { return *values; }),
+                   std::move(serialize));
+}
+
+void app_message_queue::push_variables(const node_id& id, message m, variables_source values,
+                                       variables_serializer serialize) {
+    auto it = m_pending_variables.find(id);
+    if(it == m_pending_variables.end()) {
+        append({std::move(m), id, std::move(values), std::move(serialize)});
+        return;
+    }
+
+    // The merged message replaces the pending one at the end of the queue,
+    // so that the values it carries are never sent before older ones
+    auto merged = std::make_shared<variables_map>(it->second->values());
+    for(auto&& v : values()) {
+        merged->insert_or_assign(v.first, std::move(v.second));
+    }
+    erase(it->second);
+    m_stats.merged++;
+    auto msg = serialize(*merged);
+    append({std::move(msg), id, [merged] { return *merged; }, std::move(serialize)});
+}
+
+std::vector<app_message_queue::message> app_message_queue::start_writing(std::size_t max_messages,
+                                                                         std::size_t max_bytes,
+                                                                         std::size_t header_size) {
+    std::vector<message> messages;
+    std::size_t bytes = 0;
+    for(auto& e : m_entries) {
+        const auto size = e.msg->buffer.size() + header_size;
+        if(!messages.empty() && (messages.size() == max_messages || bytes + size > max_bytes))
+            break;
+        // The message is about to be written, it can not be merged anymore
+        if(e.variables_of)
+            m_pending_variables.erase(*e.variables_of);
+        messages.push_back(e.msg);
+        bytes += size;
+    }
+    m_writing = messages.size();
+    return messages;
+}
+
+void app_message_queue::finish_writing() {
+    for(; m_writing > 0; m_writing--) {
+        erase(m_entries.begin());
+    }
+}
+
+void app_message_queue::clear() {
+    m_entries.clear();
+    m_pending_variables.clear();
+    m_stats.messages = 0;
+    m_stats.bytes = 0;
+}
+
+void app_message_queue::append(entry&& e) {
+    m_stats.messages++;
+    m_stats.bytes += e.msg->buffer.size();
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.bytes);
+    auto it = m_entries.insert(m_entries.end(), std::move(e));
+    if(it->variables_of) {
+        m_pending_variables[*it->variables_of] = it;
+    }
+}
+
+void app_message_queue::erase(entries::iterator it) {
+    m_stats.messages--;
+    m_stats.bytes -= it->msg->buffer.size();
+    if(it->variables_of) {
+        auto pending = m_pending_variables.find(*it->variables_of);
+        if(pending != m_pending_variables.end() && pending->second == it)
+            m_pending_variables.erase(pending);
+    }
+    m_entries.erase(it);
+}
+
+}  // namespace mobsya
@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "common_types.h"
+#include "node_id.h"
+
+namespace mobsya {
+
+/*
+ * Messages waiting to be sent to an application.
+ *
+ * The queue has a byte budget: when a client does not read fast enough, pending variables updates of a node or group
+ * are merged into a single message, latest value wins, and events are dropped while the budget is exceeded.
+ * Other messages, like responses to requests, are always queued.
+ * Messages being written are never modified.
+ */
+class app_message_queue {
+public:
+    using message = std::shared_ptr<const tagged_detached_flatbuffer>;
+    using shared_variables = std::shared_ptr<const variables_map>;
+    // Provide the values of an update, only called when the update is merged
+    using variables_source = std::function<variables_map()>;
+    // Build the message notifying the given values of a node or group
+    using variables_serializer = std::function<message(const variables_map&)>;
+
+    struct stats {
+        std::size_t messages = 0;    // queued messages, including the ones being written
+        std::size_t bytes = 0;       // total size of the queued messages
+        std::size_t peak_bytes = 0;  // largest value of bytes so far
+        std::size_t merged = 0;      // variables updates merged into a pending one
+        std::size_t dropped = 0;     // messages dropped because the budget was exceeded
+    };
+
+    explicit app_message_queue(std::size_t byte_budget) : m_byte_budget(byte_budget) {}
+
+    // Queue a message which must be delivered
+    void push(message m);
+    // Queue a message which can be skipped if the client is too far behind, return whether it was queued
+    bool push_droppable(message m);
+    // Queue a message notifying the variables of a node or group, merging it with a pending one of the same id.
+    // serialize is only called to build the merged message.
+    void push_variables(const node_id& id, message m, shared_variables values, variables_serializer serialize);
+    void push_variables(const node_id& id, message m, variables_source values, variables_serializer serialize);
+
+    // Mark the oldest messages as being written and return them, at least one and at most max_messages,
+    // as long as their total size does not exceed max_bytes, each message counting for header_size more bytes.
+    // The queue must not be empty nor being written.
+    std::vector<message> start_writing(std::size_t max_messages, std::size_t max_bytes, std::size_t header_size = 0);
+    // Remove the messages returned by start_writing
+    void finish_writing();
+    // Remove all messages, the queue must not be being written
+    void clear();
+    bool writing() const {
+        return m_writing > 0;
+    }
+
+    bool empty() const {
+        return m_entries.empty();
+    }
+    std::size_t size() const {
+        return m_entries.size();
+    }
+    bool over_budget() const {
+        return m_stats.bytes > m_byte_budget;
+    }
+    const stats& statistics() const {
+        return m_stats;
+    }
+
+private:
+    struct entry {
+        message msg;
+        std::optional<node_id> variables_of;
+        variables_source values;
+        variables_serializer serialize;
+    };
+    using entries = std::list<entry>;
+
+    void append(entry&& e);
+    void erase(entries::iterator it);
+
+    entries m_entries;
+    // pending variables updates, by node or group, never one being written
+    std::unordered_map<node_id, entries::iterator> m_pending_variables;
+    std::size_t m_writing = 0;
+    std::size_t m_byte_budget;
+    stats m_stats;
+};
+
+}  // namespace mobsya
@@ -24,7 +24,7 @@ public:
     }
 
     void accept() {
-        auto endpoint = std::make_shared<application_endpoint<socket_type>>(m_io_context);
+        auto endpoint = application_endpoint<socket_type>::create(m_io_context);
         m_acceptor.async_accept(endpoint->tcp_socket(), [this, endpoint](const boost::system::error_code& error) {
             mLogInfo("New connection from {} {}", endpoint->tcp_socket().remote_endpoint().address().to_string(),
                      error.message());
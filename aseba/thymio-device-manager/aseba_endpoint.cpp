@@ -24,7 +24,7 @@ void aseba_endpoint::destroy() {
         return;
     mLogInfo("Destroying endpoint");
     std::for_each(std::begin(m_nodes), std::end(m_nodes), [](auto&& node) { node.second.node->disconnect(); });
-    boost::asio::post([ctx = &m_io_context]() {
+    boost::asio::post(m_strand, [ctx = &m_io_context]() {
         auto& registery = boost::asio::use_service<aseba_node_registery>(*ctx);
         registery.unregister_expired_endpoints();
     });
@@ -45,7 +45,7 @@ void aseba_endpoint::cancel_all_ops() {
 
 aseba_endpoint::aseba_endpoint(boost::asio::io_context& io_context, aseba_device&& e, endpoint_type type)
     : m_endpoint(std::move(e))
-    , m_strand(io_context.get_executor())
+    , m_strand(boost::asio::use_service<aseba_node_registery>(io_context).strand())
     , m_io_context(io_context)
     , m_endpoint_type(type)
     , m_uuid(boost::asio::use_service<uuid_generator>(io_context).generate()) {}
@@ -65,6 +65,11 @@ aseba_endpoint::pointer aseba_endpoint::create_for_tcp(boost::asio::io_context&
 
 
 void aseba_endpoint::start() {
+    // Acceptors may run on other threads
+    if(!m_strand.running_in_this_thread()) {
+        boost::asio::post(m_strand, [that = shared_from_this()] { that->start(); });
+        return;
+    }
 
     auto& registery = boost::asio::use_service<aseba_node_registery>(m_io_context);
     registery.register_endpoint(shared_from_this());
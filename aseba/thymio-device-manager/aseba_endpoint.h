@@ -6,6 +6,7 @@
 #include <boost/asio.hpp>
 #include <chrono>
 #include "aseba_message_parser.h"
+#include "aseba_message_queue.h"
 #include "aseba_message_writer.h"
 #include "aseba_node.h"
 #include "log.h"
@@ -120,29 +121,17 @@ public:
     void stop();
     void cancel_all_ops();
 
+    // Return false if the messages were not queued, being empty or a duplicate poll
     template <typename CB = write_callback>
-    void write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& messages, CB&& cb = {}) {
+    bool write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& messages, CB&& cb = {}) {
         if(messages.empty())
-            return;
+            return false;
         std::unique_lock<std::mutex> _(m_msg_queue_lock);
-
-        auto it = m_msg_queue.end();
-        for(; it != m_msg_queue.begin(); --it) {
-            if(it == m_msg_queue.end())
-                break;
-            if(it->first->type != ASEBA_MESSAGE_LIST_NODES && it->first->type != ASEBA_MESSAGE_GET_EXECUTION_STATE &&
-               it->first->type != ASEBA_MESSAGE_GET_CHANGED_VARIABLES)
-                break;
-        }
-        for(auto&& m : messages) {
-            it = m_msg_queue.insert(it, {std::move(m), write_callback{}});
-        }
-        if(cb) {
-            it->second = std::move(cb);
-        }
-        if(m_msg_queue.size() > messages.size())
-            return;
-        write_next();
+        if(!m_msg_queue.push(std::move(messages), std::forward<CB>(cb)))
+            return false;
+        if(!m_msg_queue.writing())
+            write_next();
+        return true;
     }
 
     template <typename CB = write_callback>
@@ -201,20 +190,19 @@ private:
     }
 
     void handle_write(boost::system::error_code ec) {
-        if(m_msg_queue.empty())
-            return;
         std::unique_lock<std::mutex> _(m_msg_queue_lock);
-        mLogDebug("Message '{}' sent : {}", m_msg_queue.front().first->message_name(), ec.message());
+        if(!m_msg_queue.writing())
+            return;
+        mLogDebug("Message '{}' sent : {}", (*m_msg_queue.being_written())->message_name(), ec.message());
         if(ec) {
-            m_msg_queue = {};
+            m_msg_queue.clear();
             return;
         }
 
-        auto cb = m_msg_queue.front().second;
+        auto cb = m_msg_queue.finish_writing();
         if(cb) {
-            boost::asio::post(m_io_context.get_executor(), std::bind(std::move(cb), ec));
+            boost::asio::post(m_strand, std::bind(std::move(cb), ec));
         }
-        m_msg_queue.erase(m_msg_queue.begin());
         write_next();
     }
 
@@ -228,7 +216,7 @@ private:
             auto cb =
                 boost::asio::bind_executor(m_strand, [that](boost::system::error_code ec) { that->handle_write(ec); });
 
-            auto& message = *(m_msg_queue.front().first);
+            auto& message = *m_msg_queue.start_writing();
             variant_ns::visit(overloaded{[](variant_ns::monostate&) {},
                                          [&cb, &message](auto& underlying) {
                                              mobsya::async_write_aseba_message(underlying, message, std::move(cb));
@@ -267,7 +255,7 @@ private:
     std::mutex m_msg_queue_lock;
     std::unordered_map<aseba_node::node_id_t, node_info> m_nodes;
     std::shared_ptr<mobsya::group> m_group;
-    std::vector<std::pair<std::shared_ptr<Aseba::Message>, write_callback>> m_msg_queue;
+    aseba_message_queue m_msg_queue;
     Aseba::CommonDefinitions m_defs;
 
     node_id m_uuid;
@@ -0,0 +1,136 @@
+#include "aseba_message_queue.h"
+#include <algorithm>
+
+namespace mobsya {
+
+bool aseba_message_queue::push(std::vector<message>&& messages, write_callback cb) {
+    if(messages.empty())
+        return false;
+    std::optional<uint32_t> poll;
+    if(!cb) {
+        poll = poll_key(messages);
+        if(poll && !m_pending_polls.insert(*poll).second) {
+            m_stats.deduplicated_polls++;
+            return false;
+        }
+    }
+    auto p = priority_of(messages);
+    // an upload resets the vm, what follows it for the same node must stay behind it
+    if(p < priority::upload) {
+        const bool behind_upload = std::any_of(messages.begin(), messages.end(), [this](const message& m) {
+            const auto dest = destination(*m);
+            return dest && m_pending_uploads.count(*dest);
+        });
+        if(behind_upload)
+            p = priority::upload;
+    }
+    auto& queue = m_queues[std::size_t(p)];
+    for(auto&& m : messages) {
+        if(p == priority::upload) {
+            if(const auto dest = destination(*m))
+                m_pending_uploads[*dest]++;
+        }
+        queue.push_back({std::move(m), {}, {}});
+    }
+    // the poll is pending until its last message is written
+    queue.back().cb = std::move(cb);
+    queue.back().poll = poll;
+    m_stats.messages += messages.size();
+    return true;
+}
+
+const aseba_message_queue::message& aseba_message_queue::start_writing() {
+    auto queue = std::find_if(m_queues.begin(), m_queues.end(), [](const auto& q) { return !q.empty(); });
+    m_writing = std::move(queue->front());
+    queue->pop_front();
+    if(queue == m_queues.begin() + std::size_t(priority::upload)) {
+        if(const auto dest = destination(*m_writing->msg)) {
+            auto it = m_pending_uploads.find(*dest);
+            if(--it->second == 0)
+                m_pending_uploads.erase(it);
+        }
+    }
+    return m_writing->msg;
+}
+
+aseba_message_queue::write_callback aseba_message_queue::finish_writing() {
+    auto cb = std::move(m_writing->cb);
+    if(m_writing->poll)
+        m_pending_polls.erase(*m_writing->poll);
+    m_writing.reset();
+    m_stats.messages--;
+    return cb;
+}
+
+void aseba_message_queue::clear() {
+    for(auto& queue : m_queues) {
+        queue.clear();
+    }
+    m_writing.reset();
+    m_pending_polls.clear();
+    m_pending_uploads.clear();
+    m_stats.messages = 0;
+}
+
+bool aseba_message_queue::empty() const {
+    return std::all_of(m_queues.begin(), m_queues.end(), [](const auto& q) { return q.empty(); });
+}
+
+aseba_message_queue::priority aseba_message_queue::priority_of(const std::vector<message>& messages) {
+    bool polling = true;
+    bool control = false;
+    for(const auto& m : messages) {
+        switch(m->type) {
+            case ASEBA_MESSAGE_SET_BYTECODE: return priority::upload;
+            case ASEBA_MESSAGE_LIST_NODES:
+            case ASEBA_MESSAGE_GET_EXECUTION_STATE:
+            case ASEBA_MESSAGE_GET_CHANGED_VARIABLES:
+            case ASEBA_MESSAGE_GET_VARIABLES:
+            case ASEBA_MESSAGE_GET_PROFILE_DATA: break;
+            case ASEBA_MESSAGE_RESET:
+            case ASEBA_MESSAGE_RUN:
+            case ASEBA_MESSAGE_PAUSE:
+            case ASEBA_MESSAGE_STEP:
+            case ASEBA_MESSAGE_STOP:
+            case ASEBA_MESSAGE_REBOOT:
+            case ASEBA_MESSAGE_SUSPEND_TO_RAM: control = true; [[fallthrough]];
+            default: polling = false;
+        }
+    }
+    if(control)
+        return priority::control;
+    return polling ? priority::polling : priority::user;
+}
+
+// Polls sent periodically, the same one is useless while another one is pending.
+// The variables are polled with one GetVariables message by range, which make a single poll.
+std::optional<uint32_t> aseba_message_queue::poll_key(const std::vector<message>& messages) {
+    const auto key = poll_key(*messages.front());
+    if(!key)
+        return {};
+    if(messages.size() > 1 && messages.front()->type != ASEBA_MESSAGE_GET_VARIABLES)
+        return {};
+    const bool same = std::all_of(messages.begin() + 1, messages.end(),
+                                  [&key](const message& m) { return poll_key(*m) == key; });
+    return same ? key : std::nullopt;
+}
+
+std::optional<uint32_t> aseba_message_queue::poll_key(const Aseba::Message& m) {
+    switch(m.type) {
+        case ASEBA_MESSAGE_LIST_NODES: return uint32_t(m.type) << 16;
+        case ASEBA_MESSAGE_GET_EXECUTION_STATE:
+        case ASEBA_MESSAGE_GET_CHANGED_VARIABLES:
+        case ASEBA_MESSAGE_GET_VARIABLES:
+            return uint32_t(m.type) << 16 | static_cast<const Aseba::CmdMessage&>(m).dest;
+        default: return {};
+    }
+}
+
+// Node a message is sent to, if it is a command to a single node
+std::optional<uint16_t> aseba_message_queue::destination(const Aseba::Message& m) {
+    if(const auto cmd = dynamic_cast<const Aseba::CmdMessage*>(&m))
+        return cmd->dest;
+    return {};
+}
+
+}  // namespace mobsya
@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include "aseba/common/msg/msg.h"
+
+namespace mobsya {
+
+/*
+ * Messages waiting to be written to an aseba device, one at a time.
+ *
+ * Messages are written by order of priority, then in the order they were queued, so that commands of the users
+ * do not wait behind a bytecode upload or the periodic polls of the nodes.
+ * The messages queued together keep their order and share a priority: upload if they upload bytecode, control if
+ * they control the execution of the vm, polling if they only read the state of the nodes, user otherwise.
+ * A poll is not queued again while the same one is waiting to be written for the same node. Several GetVariables
+ * queued together for a node, whatever their ranges, make one poll, pending until the last of them is written.
+ * Messages queued with a callback are never considered as polls.
+ * Messages to a node whose upload is waiting to be written are queued after it whatever their priority, as an upload
+ * resets the vm: a Run or Stop written before the end of the upload would be lost.
+ */
+class aseba_message_queue {
+public:
+    using message = std::shared_ptr<Aseba::Message>;
+    using write_callback = std::function<void(boost::system::error_code)>;
+
+    enum class priority { control, user, upload, polling };
+
+    struct stats {
+        std::size_t messages = 0;           // queued messages, including the one being written
+        std::size_t deduplicated_polls = 0;  // polls not queued because the same one was pending
+    };
+
+    // Queue messages to be written in order, cb being invoked once the last one is written.
+    // Return false if the messages were not queued, being a duplicate poll.
+    bool push(std::vector<message>&& messages, write_callback cb = {});
+
+    // Mark the next message as being written and return it. The queue must not be empty nor being written.
+    const message& start_writing();
+    // Remove the message being written, returning its callback if it was the last of its batch
+    write_callback finish_writing();
+    // Remove all messages, including the one being written. Their callbacks are not invoked.
+    void clear();
+
+    bool writing() const {
+        return m_writing.has_value();
+    }
+    // Message being written, if any
+    const message* being_written() const {
+        return m_writing ? &m_writing->msg : nullptr;
+    }
+    // Whether no message is waiting to be written
+    bool empty() const;
+    const stats& statistics() const {
+        return m_stats;
+    }
+
+    static priority priority_of(const std::vector<message>& messages);
+
+private:
+    struct entry {
+        message msg;
+        write_callback cb;
+        std::optional<uint32_t> poll;  // key of the poll ending with this message, see m_pending_polls
+    };
+
+    static std::optional<uint32_t> poll_key(const std::vector<message>& messages);
+    static std::optional<uint32_t> poll_key(const Aseba::Message& m);
+    static std::optional<uint16_t> destination(const Aseba::Message& m);
+
+    // one fifo by priority
+    std::array<std::deque<entry>, 4> m_queues;
+    std::optional<entry> m_writing;
+    // polls queued or being written, by type and destination
+    std::unordered_set<uint32_t> m_pending_polls;
+    // number of messages waiting in the upload fifo, by destination
+    std::unordered_map<uint16_t, std::size_t> m_pending_uploads;
+    stats m_stats;
+};
+
+}  // namespace mobsya
@@ -4,9 +4,11 @@
 #include <aseba/common/utils/utils.h>
 #include <aseba/compiler/compiler.h>
 #include <fmt/format.h>
+#include <iterator>
 #include "aesl_parser.h"
 #include "group.h"
 #include "aseba_property.h"
+#include "flatbuffers_messages.h"
 
 namespace mobsya {
 
@@ -32,9 +34,11 @@ aseba_node::aseba_node(boost::asio::io_context& ctx, node_id_t id, uint16_t prot
     , m_connected_app(nullptr)
     , m_endpoint(std::move(endpoint))
     , m_io_ctx(ctx)
+    , m_strand(boost::asio::use_service<aseba_node_registery>(ctx).strand())
     , m_variables_timer(ctx)
     , m_status_timer(ctx)
-    , m_resend_timer(ctx) {}
+    , m_resend_timer(ctx)
+    , m_profile_timer(ctx) {}
 
 std::shared_ptr<aseba_node> aseba_node::create(boost::asio::io_context& ctx, node_id_t id, uint16_t protocol_version,
                                                std::weak_ptr<mobsya::aseba_endpoint> endpoint) {
@@ -49,14 +53,17 @@ std::shared_ptr<mobsya::aseba_endpoint> aseba_node::endpoint() const {
 }
 
 void aseba_node::disconnect() {
+    m_uploaded_bytecode.reset();
     cancel_pending_step_request();
     cancel_pending_breakpoint_request();
+    cancel_pending_profile_request();
     set_status(status::disconnected);
 }
 
 aseba_node::~aseba_node() {
     cancel_pending_step_request();
     cancel_pending_breakpoint_request();
+    cancel_pending_profile_request();
     if(m_status.load() != status::disconnected) {
         mLogWarn("Node destroyed before being disconnected");
     }
@@ -93,6 +100,7 @@ void aseba_node::on_message(const Aseba::Message& msg) {
         case ASEBA_MESSAGE_BREAKPOINT_SET_RESULT:
             on_breakpoint_set_result(static_cast<const Aseba::BreakpointSetResult&>(msg));
             break;
+        case ASEBA_MESSAGE_PROFILE_DATA: on_profile_data(static_cast<const Aseba::ProfileData&>(msg)); break;
 
         case ASEBA_MESSAGE_DESCRIPTION:
         case ASEBA_MESSAGE_NAMED_VARIABLE_DESCRIPTION:
@@ -120,7 +128,7 @@ void aseba_node::set_status(status s) {
     // When the status of a node change, reassign the scratchpad of the associated group
     // because set_status can be called while the endpoint is being destroyed,
     // we need to postpone the call
-    boost::asio::post(m_io_ctx, [g = group()]() {
+    boost::asio::post(m_strand, [g = group()]() {
         if(g)
             g->assign_scratchpads();
     });
@@ -152,113 +160,178 @@ void aseba_node::write_message(std::shared_ptr<Aseba::Message> message, write_ca
     write_messages({{std::move(message)}}, std::move(cb));
 }
 
-void aseba_node::write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& messages, write_callback&& cb) {
+bool aseba_node::write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& messages, write_callback&& cb) {
     auto endpoint = m_endpoint.lock();
     if(!endpoint) {
-        return;
+        return false;
     }
-    endpoint->write_messages(std::move(messages), std::move(cb));
+    return endpoint->write_messages(std::move(messages), std::move(cb));
 }
 
-void aseba_node::compile_program(fb::ProgrammingLanguage language, const std::string& program,
-                                 compilation_callback&& cb) {
-    Aseba::CommonDefinitions defs = endpoint()->aseba_compiler_definitions();
-    Aseba::TargetDescription desc = m_description;
+// State of a compilation, shared between the io_context and a compilation thread.
+// The compilation uses copies of the description and definitions, so that the node can change meanwhile.
+struct aseba_node::compilation_job {
+    compilation_job(const Aseba::TargetDescription& description, Aseba::CommonDefinitions definitions)
+        : description(description), defs(std::move(definitions)) {}
 
-    Aseba::Compiler compiler;
-    compiler.setTargetDescription(&desc);
-    compiler.setCommonDefinitions(&defs);
+    Aseba::TargetDescription description;
+    Aseba::CommonDefinitions defs;
+    tl::expected<std::shared_ptr<const compiled_program>, boost::system::error_code> result;
+};
 
+void aseba_node::start_compilation(fb::ProgrammingLanguage language, const std::string& program,
+                                   compilation_service::cancellation_token& token, compilation_done_callback&& done) {
+    auto job = std::make_shared<compilation_job>(m_description, endpoint()->aseba_compiler_definitions());
+    if(!m_compiler)
+        m_compiler = std::make_shared<incremental_compiler>();
+    auto& service = boost::asio::use_service<compilation_service>(m_io_ctx);
+    // Only the latest compilation matters
+    service.start(
+        token, m_strand,
+        [job, id = m_id, language, program, &service, compiler = m_compiler]() {
+            return do_compile_program(id, job->description, job->defs, language, program, service.cache(), *compiler);
+        },
+        [job, done = std::move(done)](auto result) {
+            job->result = std::move(result);
+            done(*job);
+        });
+}
 
-    Aseba::BytecodeVector bytecode;
-    auto result = do_compile_program(compiler, defs, language, program, bytecode);
-    if(!result)
-        boost::asio::post(m_io_ctx.get_executor(), std::bind(std::move(cb), result.error(), compilation_result{}));
-    else
-        boost::asio::post(m_io_ctx.get_executor(),
-                          std::bind(std::move(cb), boost::system::error_code{}, result.value()));
+void aseba_node::compile_program(fb::ProgrammingLanguage language, const std::string& program,
+                                 compilation_callback&& cb) {
+    start_compilation(language, program, m_pending_compilation, [cb = std::move(cb)](compilation_job& job) {
+        if(!job.result)
+            cb(job.result.error(), compilation_result{});
+        else
+            cb(boost::system::error_code{}, job.result.value()->result);
+    });
 }
 
 void aseba_node::compile_and_send_program(fb::ProgrammingLanguage language, const std::string& program,
                                           compilation_callback&& cb) {
-    m_breakpoints.clear();
-    cancel_pending_step_request();
-    cancel_pending_breakpoint_request();
-    Aseba::Compiler compiler;
-    Aseba::CommonDefinitions defs = endpoint()->aseba_compiler_definitions();
+    start_compilation(language, program, m_pending_upload,
+                      [that = shared_from_this(), cb = std::move(cb)](compilation_job& job) mutable {
+                          that->send_compiled_program(job, std::move(cb));
+                      });
+}
 
-    compiler.setTargetDescription(&m_description);
-    compiler.setCommonDefinitions(&defs);
-    auto result = do_compile_program(compiler, defs, language, program, m_bytecode);
-    if(!result) {
-        cb(result.error(), {});
+void aseba_node::send_compiled_program(compilation_job& job, compilation_callback&& cb) {
+    if(!job.result) {
+        cb(job.result.error(), {});
         return;
     }
-    std::vector<std::shared_ptr<Aseba::Message>> messages;
-    Aseba::sendBytecode(messages, native_id(), std::vector<uint16_t>(m_bytecode.begin(), m_bytecode.end()));
-    reset_known_variables(*compiler.getVariablesMap());
-    write_messages(std::move(messages),
-                   [that = shared_from_this(), cb = std::move(cb), result](boost::system::error_code ec) {
-                       if(ec)
-                           cb(ec, result.value());
-                       else
-                           that->m_callbacks_pending_execution_state_change.push(std::bind(cb, ec, result.value()));
-                   });
+    const auto& program = *job.result.value();
+    m_breakpoints.clear();
+    cancel_pending_step_request();
+    cancel_pending_breakpoint_request();
+    m_bytecode = program.bytecode;
+    set_code_regions(program.subroutines, job.defs);
+    reset_known_variables(program.variables);
+    upload_bytecode(
+        [that = shared_from_this(), cb = std::move(cb), result = program.result](boost::system::error_code ec) {
+            if(ec)
+                cb(ec, result);
+            else
+                that->m_callbacks_pending_execution_state_change.push(std::bind(cb, ec, result));
+        });
 
-    m_variables_changed_signal(shared_from_this(), this->variables(), std::chrono::system_clock::now());
+    notify_variables_changed(snapshot_variables());
 }
 
-tl::expected<aseba_node::compilation_result, boost::system::error_code>
-aseba_node::do_compile_program(Aseba::Compiler& compiler, Aseba::CommonDefinitions&, fb::ProgrammingLanguage language,
-                               const std::string& program, Aseba::BytecodeVector& bytecode) {
+tl::expected<std::shared_ptr<const compiled_program>, boost::system::error_code>
+aseba_node::do_compile_program(node_id_t id, const Aseba::TargetDescription& description,
+                               const Aseba::CommonDefinitions& defs, fb::ProgrammingLanguage language,
+                               const std::string& program, compilation_service::cache_type& cache,
+                               incremental_compiler& incremental) {
 
     if(language == fb::ProgrammingLanguage::Aesl) {
         return tl::make_unexpected(make_error_code(mobsya::error_code::unsupported_language));
     }
 
-    std::wstring code = Aseba::UTF8ToWString(program);
-    compilation_result result;
-    std::wistringstream is(code);
+    const compilation_key key{program, target_layout(description), definitions_layout(defs)};
+    if(auto cached = cache.find(key)) {
+        const auto stats = cache.statistics();
+        mLogTrace("Compilation cache hit for node {} ({} hits, {} misses)", id, stats.hits, stats.misses);
+        return *cached;
+    }
+
+    // Successive programs of a node mostly differ by the event being edited, whose code alone is compiled again
+    std::lock_guard<std::mutex> lock(incremental.mutex);
+    Aseba::Compiler& compiler = incremental.compiler;
+    compiler.setTargetDescription(&description);
+    compiler.setCommonDefinitions(&defs);
+
+    auto compiled = std::make_shared<compiled_program>();
     Aseba::Error error;
-    bytecode.clear();
     unsigned allocatedVariablesCount;
-    bool success = compiler.compile(is, bytecode, allocatedVariablesCount, error);
+    bool success = compiler.compile(std::string_view(program), compiled->bytecode, allocatedVariablesCount, error);
     if(!success) {
-        mLogWarn("Compilation failed on node {} : {}", m_id, Aseba::WStringToUTF8(error.message));
+        mLogWarn("Compilation failed on node {} : {}", id, Aseba::WStringToUTF8(error.message));
         compilation_result::error_data err{error.pos.character, error.pos.row, error.pos.column,
                                            Aseba::WStringToUTF8(error.message)};
-        result.error = err;
-        return result;
+        compiled->result.error = err;
+    } else {
+        compilation_result::result_data data;
+        data.bytecode_size = compiled->bytecode.size();
+        data.variables_size = allocatedVariablesCount;
+        data.bytecode_total_size = description.bytecodeSize;
+        data.variables_total_size = description.variablesSize;
+        compiled->result.result = data;
     }
-    compilation_result::result_data data;
-    data.bytecode_size = bytecode.size();
-    data.variables_size = allocatedVariablesCount;
-    data.bytecode_total_size = compiler.getTargetDescription()->bytecodeSize;
-    data.variables_total_size = compiler.getTargetDescription()->variablesSize;
-    result.result = data;
-    return result;
+    compiled->variables = *compiler.getVariablesMap();
+    compiled->subroutines = *compiler.getSubroutineTable();
+    cache.insert(key, compiled);
+    return compiled;
 }
 
-void aseba_node::compile_and_send_aseba_command(const std::string& program) {
+// The messages in then are written in the same batch as the upload, cb is called once they are all written
+void aseba_node::compile_and_send_aseba_command(const std::string& program,
+                                                std::vector<std::shared_ptr<Aseba::Message>>&& then,
+                                                write_callback&& cb) {
+    // The command must not be overwritten by a program compiled before it
+    if(m_pending_upload) {
+        *m_pending_upload = true;
+        m_pending_upload.reset();
+    }
+
     Aseba::Compiler compiler;
     Aseba::CommonDefinitions defs = endpoint()->aseba_compiler_definitions();
 
     compiler.setTargetDescription(&m_description);
     compiler.setCommonDefinitions(&defs);
 
-    std::wstring code = Aseba::UTF8ToWString(program);
     compilation_result result;
-    std::wistringstream is(code);
     Aseba::Error error;
     m_bytecode.clear();
     unsigned allocatedVariablesCount;
 
-    compiler.compile(is, m_bytecode, allocatedVariablesCount, error);
+    compiler.compile(std::string_view(program), m_bytecode, allocatedVariablesCount, error);
+    set_code_regions(*compiler.getSubroutineTable(), defs);
 
-    std::vector<std::shared_ptr<Aseba::Message>> messages;
-    Aseba::sendBytecode(messages, native_id(), std::vector<uint16_t>(m_bytecode.begin(), m_bytecode.end()));
+    upload_bytecode(std::move(cb), std::move(then));
+}
 
-    write_messages(std::move(messages));
+void aseba_node::upload_bytecode(write_callback&& cb, std::vector<std::shared_ptr<Aseba::Message>>&& then) {
+    std::vector<uint16_t> bytecode(m_bytecode.begin(), m_bytecode.end());
+    std::vector<std::shared_ptr<Aseba::Message>> messages;
+    if(m_uploaded_bytecode) {
+        Aseba::sendBytecodeChanges(messages, native_id(), *m_uploaded_bytecode, bytecode);
+        // SetBytecode resets the vm, which must also happen when the bytecode did not change
+        if(messages.empty())
+            messages.push_back(std::make_shared<Aseba::Reset>(native_id()));
+        mLogTrace("Uploading {} messages of bytecode changes to node {}", messages.size(), m_id);
+    } else {
+        Aseba::sendBytecode(messages, native_id(), bytecode);
+    }
+    m_uploaded_bytecode = std::move(bytecode);
+    std::move(then.begin(), then.end(), std::back_inserter(messages));
+    write_messages(std::move(messages), [that = shared_from_this(), cb = std::move(cb)](boost::system::error_code ec) {
+        // The node may have received only a part of the bytecode
+        if(ec)
+            that->m_uploaded_bytecode.reset();
+        if(cb)
+            cb(ec);
+    });
 }
 
 void aseba_node::set_vm_execution_state(vm_execution_state_command state, write_callback&& cb) {
@@ -270,11 +343,13 @@ void aseba_node::set_vm_execution_state(vm_execution_state_command state, write_
             write_message(std::make_shared<Aseba::Reset>(native_id()), std::move(cb));
             break;
         case vm_execution_state_command::Stop:
+            // Run the program stopping the motors, then stop; one batch, as nothing may be written in between
             compile_and_send_aseba_command(R"(
                                          motor.left.target = 0
-                                         motor.right.target = 0 )");
-            write_message(std::make_shared<Aseba::Run>(native_id()), std::move(cb));
-            write_message(std::make_shared<Aseba::Stop>(native_id()), std::move(cb));
+                                         motor.right.target = 0 )",
+                                           {std::make_shared<Aseba::Run>(native_id()),
+                                            std::make_shared<Aseba::Stop>(native_id())},
+                                           std::move(cb));
             break;
         case vm_execution_state_command::Pause:
             write_message(std::make_shared<Aseba::Pause>(native_id()), std::move(cb));
@@ -287,6 +362,7 @@ void aseba_node::set_vm_execution_state(vm_execution_state_command state, write_
             write_message(std::make_shared<Aseba::Sleep>(native_id()), std::move(cb));
             break;
         case vm_execution_state_command::Reboot:
+            m_uploaded_bytecode.reset();
             write_message(std::make_shared<Aseba::Reboot>(native_id()), std::move(cb));
             break;
         case vm_execution_state_command::WriteProgramToDeviceMemory:
@@ -300,14 +376,14 @@ void aseba_node::schedule_execution_state_update() {
     request_execution_state();
     m_status_timer.expires_from_now(boost::posix_time::seconds(1));
     std::weak_ptr<aseba_node> ptr = shared_from_this();
-    m_status_timer.async_wait([ptr](boost::system::error_code ec) {
+    m_status_timer.async_wait(boost::asio::bind_executor(m_strand, [ptr](boost::system::error_code ec) {
         if(ec)
             return;
         auto that = ptr.lock();
         if(!that || that->get_status() == status::disconnected)
             return;
         that->schedule_execution_state_update();
-    });
+    }));
 }
 
 void aseba_node::request_execution_state() {
@@ -319,7 +395,7 @@ void aseba_node::on_execution_state_message(const Aseba::ExecutionStateChanged&
     vm_execution_state state;
 
     while(!m_callbacks_pending_execution_state_change.empty()) {
-        boost::asio::post(m_io_ctx.get_executor(), std::move(m_callbacks_pending_execution_state_change.front()));
+        boost::asio::post(m_strand, std::move(m_callbacks_pending_execution_state_change.front()));
         m_callbacks_pending_execution_state_change.pop();
     }
 
@@ -391,6 +467,28 @@ unsigned aseba_node::line_from_pc(unsigned pc) const {
     return (pc >= 5 && pc < m_bytecode.size()) ? m_bytecode[pc].line + 1 : 0;
 }
 
+void aseba_node::set_code_regions(const Aseba::Compiler::SubroutineTable& subroutines,
+                                  const Aseba::CommonDefinitions& defs) {
+    m_code_regions.clear();
+    if(m_bytecode.empty())
+        return;
+    for(const auto& [address, id] : m_bytecode.getEventAddressesToIds()) {
+        const int local_index = ASEBA_EVENT_LOCAL_EVENTS_START - int(id);
+        std::string name;
+        if(id == ASEBA_EVENT_INIT)
+            name = "init";
+        else if(id < 0x1000 && id < defs.events.size())
+            name = "onevent " + Aseba::WStringToUTF8(defs.events[id].name);
+        else if(id >= 0x1000 && local_index < int(m_description.localEvents.size()))
+            name = "onevent " + Aseba::WStringToUTF8(m_description.localEvents[local_index].name);
+        else
+            name = fmt::format("onevent {}", id);
+        m_code_regions.insert_or_assign(address, std::move(name));
+    }
+    for(const auto& subroutine : subroutines)
+        m_code_regions.insert_or_assign(subroutine.address, "sub " + Aseba::WStringToUTF8(subroutine.name));
+}
+
 void aseba_node::step_to_next_line(write_callback&& cb) {
     cancel_pending_step_request();
     m_pending_step_request = std::make_shared<step_cb_data>();
@@ -408,7 +506,7 @@ void aseba_node::handle_step_request() {
         return;
     }
     if(m_vm_state.line != m_pending_step_request->current_line) {
-        boost::asio::post(m_io_ctx.get_executor(),
+        boost::asio::post(m_strand,
                           std::bind(std::move(m_pending_step_request->cb), m_pending_step_request->error));
         m_pending_step_request.reset();
         return;
@@ -433,12 +531,129 @@ void aseba_node::cancel_pending_step_request() {
             m_pending_step_request->error =
                 boost::system::errc::make_error_code(boost::system::errc::operation_canceled);
 
-        boost::asio::post(m_io_ctx.get_executor(),
+        boost::asio::post(m_strand,
                           std::bind(std::move(m_pending_step_request->cb), m_pending_step_request->error));
     }
     m_pending_step_request.reset();
 }
 
+void aseba_node::fetch_profile(profile_callback&& cb) {
+    cancel_pending_profile_request();
+    auto data = std::make_shared<profile_cb_data>();
+    data->cb = std::move(cb);
+
+    // request every counter of the current program, in chunks fitting in a message
+    const std::size_t events = m_bytecode.empty() ? 0 : m_bytecode[0].bytecode / 2;
+    const std::array<std::size_t, 4> sizes{m_bytecode.size(), m_bytecode.size(), events, events};
+    std::vector<std::shared_ptr<Aseba::Message>> messages;
+    for(uint16_t counters = 0; counters < sizes.size(); counters++) {
+        data->counters[counters].resize(sizes[counters]);
+        for(std::size_t start = 0; start < sizes[counters]; start += ASEBA_MAX_PROFILE_DATA_COUNT) {
+            const auto length = std::min<std::size_t>(ASEBA_MAX_PROFILE_DATA_COUNT, sizes[counters] - start);
+            messages.push_back(
+                std::make_shared<Aseba::GetProfileData>(native_id(), counters, uint16_t(start), uint16_t(length)));
+            data->pending++;
+        }
+    }
+    if(messages.empty()) {
+        boost::asio::post(m_strand,
+                          std::bind(std::move(data->cb), boost::system::error_code{}, make_profile(data->counters)));
+        return;
+    }
+    m_pending_profile_request = data;
+
+    auto write_cb = [that = shared_from_this(),
+                     ptr = std::weak_ptr<profile_cb_data>(m_pending_profile_request)](boost::system::error_code ec) {
+        auto data = ptr.lock();
+        if(!ec || !data)
+            return;
+        that->cancel_pending_profile_request(ec);
+    };
+    write_messages(std::move(messages), std::move(write_cb));
+
+    // nodes without profiler never answer
+    m_profile_timer.expires_from_now(boost::posix_time::seconds(2));
+    auto ptr = weak_from_this();
+    m_profile_timer.async_wait(boost::asio::bind_executor(m_strand, [ptr](boost::system::error_code ec) {
+        if(ec)
+            return;
+        auto that = ptr.lock();
+        if(!that)
+            return;
+        that->cancel_pending_profile_request(boost::system::errc::make_error_code(boost::system::errc::timed_out));
+    }));
+}
+
+void aseba_node::on_profile_data(const Aseba::ProfileData& msg) {
+    auto data = m_pending_profile_request;
+    if(!data || msg.counters >= data->counters.size())
+        return;
+    auto& counters = data->counters[msg.counters];
+    for(std::size_t i = 0; i < msg.values.size() && msg.start + i < counters.size(); i++)
+        counters[msg.start + i] = msg.values[i];
+    if(data->pending == 0 || --data->pending > 0)
+        return;
+
+    m_profile_timer.cancel();
+    m_pending_profile_request.reset();
+    boost::asio::post(m_strand,
+                      std::bind(std::move(data->cb), boost::system::error_code{}, make_profile(data->counters)));
+}
+
+void aseba_node::cancel_pending_profile_request(boost::system::error_code ec) {
+    if(m_pending_profile_request && m_pending_profile_request->cb) {
+        if(!ec)
+            ec = boost::system::errc::make_error_code(boost::system::errc::operation_canceled);
+        boost::asio::post(m_strand, std::bind(std::move(m_pending_profile_request->cb), ec, vm_profile{}));
+    }
+    m_pending_profile_request.reset();
+}
+
+aseba_node::vm_profile aseba_node::make_profile(const std::array<std::vector<uint32_t>, 4>& counters) const {
+    vm_profile profile;
+
+    // name of the event handler or subroutine containing pc
+    const auto handler_at = [this](unsigned pc) -> std::string {
+        auto it = m_code_regions.upper_bound(pc);
+        return it == m_code_regions.begin() ? std::string{} : std::prev(it)->second;
+    };
+
+    const auto& steps = counters[ASEBA_PROFILE_PC_STEPS];
+    const auto& native_time = counters[ASEBA_PROFILE_PC_NATIVE_TIME];
+    std::map<std::pair<std::string, uint32_t>, vm_profile::line_data> lines;
+    for(unsigned pc = 0; pc < steps.size() && pc < native_time.size(); pc++) {
+        if(steps[pc] == 0 && native_time[pc] == 0)
+            continue;
+        auto handler = handler_at(pc);
+        const uint32_t line = line_from_pc(pc);
+        auto& data = lines[{handler, line}];
+        data.handler = std::move(handler);
+        data.line = line;
+        data.steps += steps[pc];
+        data.native_time += native_time[pc];
+    }
+    for(auto& entry : lines)
+        profile.lines.push_back(std::move(entry.second));
+
+    const auto& runs = counters[ASEBA_PROFILE_EVENT_RUNS];
+    const auto& event_steps = counters[ASEBA_PROFILE_EVENT_STEPS];
+    for(std::size_t i = 0; i < runs.size() && i < event_steps.size() && 2 + 2 * i < m_bytecode.size(); i++) {
+        const auto it = m_code_regions.find(m_bytecode[2 + 2 * i].bytecode);
+        profile.events.push_back(
+            {it == m_code_regions.end() ? std::string{} : it->second, runs[i], event_steps[i]});
+    }
+    return profile;
+}
+
+std::string aseba_node::vm_profile::folded_stacks() const {
+    std::string stacks;
+    for(const auto& line : lines) {
+        if(line.steps)
+            stacks += fmt::format("{};line {} {}\n", line.handler, line.line, line.steps);
+    }
+    return stacks;
+}
+
 void aseba_node::set_breakpoints(std::vector<breakpoint> breakpoints, breakpoints_callback&& cb) {
     std::vector<std::shared_ptr<Aseba::Message>> messages;
     auto cb_data = std::make_shared<break_point_cb_data>();
@@ -489,13 +704,13 @@ void aseba_node::set_breakpoints(std::vector<breakpoint> breakpoints, breakpoint
         if(ec || data->pending.empty()) {
             that->m_breakpoints = data->set;
             that->m_pending_breakpoint_request.reset();
-            boost::asio::post(that->m_io_ctx.get_executor(), std::bind(std::move(data->cb), data->error, data->set));
+            boost::asio::post(that->m_strand, std::bind(std::move(data->cb), data->error, data->set));
         }
     };
     if(messages.empty()) {
         m_breakpoints = cb_data->set;
         m_pending_breakpoint_request.reset();
-        boost::asio::post(m_io_ctx.get_executor(), std::bind(std::move(cb_data->cb), cb_data->error, cb_data->set));
+        boost::asio::post(m_strand, std::bind(std::move(cb_data->cb), cb_data->error, cb_data->set));
     }
     write_messages(std::move(messages), std::move(write_cb));
 }
@@ -512,14 +727,14 @@ void aseba_node::on_breakpoint_set_result(const Aseba::BreakpointSetResult& res)
     r.pending.erase(it);
     if(r.pending.empty()) {
         m_breakpoints = r.set;
-        boost::asio::post(m_io_ctx.get_executor(), std::bind(std::move(r.cb), r.error, r.set));
+        boost::asio::post(m_strand, std::bind(std::move(r.cb), r.error, r.set));
         m_pending_breakpoint_request.reset();
     }
 }
 
 void aseba_node::cancel_pending_breakpoint_request() {
     if(m_pending_breakpoint_request && m_pending_breakpoint_request->cb) {
-        boost::asio::post(m_io_ctx.get_executor(),
+        boost::asio::post(m_strand,
                           std::bind(std::move(m_pending_breakpoint_request->cb),
                                     boost::system::errc::make_error_code(boost::system::errc::operation_canceled),
                                     breakpoints{}));
@@ -533,14 +748,14 @@ aseba_node::vm_execution_state aseba_node::execution_state() const {
 
 void aseba_node::on_event_received(const std::unordered_map<std::string, property>& events,
                                    const std::chrono::system_clock::time_point& timestamp) {
-    m_events_signal(shared_from_this(), events, timestamp);
+    if(!m_events_signal.empty())
+        m_events_signal(shared_from_this(), make_events_update(*this, events, timestamp));
 }
 
 
 boost::system::error_code aseba_node::set_node_variables(const variables_map& map, write_callback&& cb) {
     std::vector<std::shared_ptr<Aseba::Message>> messages;
     messages.reserve(map.size());
-    variables_map modified;
     for(auto&& var : map) {
         auto it = std::find_if(m_variables.begin(), m_variables.end(),
                                [name = var.first](const aseba_vm_variable& v) { return v.name == name; });
@@ -557,9 +772,6 @@ boost::system::error_code aseba_node::set_node_variables(const variables_map& ma
     }
 
     write_messages(std::move(messages), std::move(cb));
-    if(!modified.empty()) {
-        m_variables_changed_signal(shared_from_this(), modified, std::chrono::system_clock::now());
-    }
     return {};
 }
 
@@ -572,6 +784,8 @@ void aseba_node::on_description_received() {
     mLogInfo("Got description for {} [{} variables, {} functions, {} events - protocol {}]", native_id(),
              m_description.namedVariables.size(), m_description.nativeFunctions.size(),
              m_description.localEvents.size(), m_description.protocolVersion);
+    // The node (re)started, its bytecode is not the one we uploaded anymore
+    m_uploaded_bytecode.reset();
     unsigned count;
     reset_known_variables(m_description.getVariablesMap(count));
     schedule_variables_update();
@@ -580,7 +794,9 @@ void aseba_node::on_description_received() {
     auto it = std::find_if(m_variables.begin(), m_variables.end(),
                            [](const aseba_vm_variable& var) { return var.name == "_fwversion"; });
     if(it != m_variables.end()) {
-        write_message(std::make_shared<Aseba::GetVariables>(native_id(), it->start, it->size));
+        // Not a poll of the variables, which would make it a duplicate of a pending one
+        write_message(std::make_shared<Aseba::GetVariables>(native_id(), it->start, it->size),
+                      [](boost::system::error_code) {});
     }
 
     if(m_description.protocolVersion >= 6 &&
@@ -603,23 +819,33 @@ void aseba_node::request_device_info() {
     write_message(std::make_shared<Aseba::GetDeviceInfo>(native_id(), DEVICE_INFO_UUID));
 
     m_resend_timer.expires_from_now(boost::posix_time::seconds(1));
-    m_resend_timer.async_wait([ptr = weak_from_this()](boost::system::error_code ec) {
+    auto ptr = weak_from_this();
+    m_resend_timer.async_wait(boost::asio::bind_executor(m_strand, [ptr](boost::system::error_code ec) {
         if(ec)
             return;
         auto that = ptr.lock();
         if(!that)
             return;
         that->request_device_info();
-    });
+    }));
 }
 
 // ask the node to dump its memory.
 void aseba_node::request_variables() {
 
     std::vector<std::shared_ptr<Aseba::Message>> messages;
+    std::vector<uint16_t> ranges;
     messages.reserve(3);
 
-    {
+    update_variables_watches();
+    bool all_variables = false;
+    if(m_watched_ranges) {
+        // Only the variables the watchers need
+        for(auto&& range : *m_watched_ranges) {
+            messages.emplace_back(std::make_shared<Aseba::GetVariables>(native_id(), range.first, range.second));
+            ranges.push_back(range.first);
+        }
+    } else {
         if(!m_resend_all_variables && m_description.protocolVersion >= 7) {
             messages.emplace_back(std::make_shared<Aseba::GetChangedVariables>(native_id()));
         } else {
@@ -628,25 +854,101 @@ void aseba_node::request_variables() {
             for(const auto& var : m_variables) {
                 if(size + var.size > ASEBA_MAX_EVENT_ARG_COUNT - 2) {  // cut at variable boundaries
                     messages.emplace_back(std::make_shared<Aseba::GetVariables>(native_id(), start, size));
+                    ranges.push_back(start);
                     start += size;
                     size = 0;
                 }
                 size += var.size;
             }
-            if(size > 0)
+            if(size > 0) {
                 messages.emplace_back(std::make_shared<Aseba::GetVariables>(native_id(), start, size));
-            m_resend_all_variables = false;
+                ranges.push_back(start);
+            }
+            all_variables = true;
         }
     }
-    write_messages(std::move(messages));
+    // The previous poll is still waiting to be written
+    if(!write_messages(std::move(messages)))
+        return;
+    if(all_variables)
+        m_resend_all_variables = false;
+    m_variables_requested_at = std::chrono::steady_clock::now();
+    m_variables_pending_ranges = std::move(ranges);
+    m_variables_poll_changed = false;
+}
+
+void aseba_node::update_variables_watches() {
+    m_variables_watches.erase(std::remove_if(m_variables_watches.begin(), m_variables_watches.end(),
+                                             [](const auto& watch) { return !watch.first.connected(); }),
+                              m_variables_watches.end());
+
+    bool all_variables = m_variables_watches.empty();
+    std::unordered_set<std::string> names;
+    m_variables_update_interval = m_variables_watches.empty() ? tdm::defaultVariablesUpdateInterval :
+                                                                tdm::maxVariablesUpdateInterval;
+    for(auto&& watch : m_variables_watches) {
+        m_variables_update_interval = std::min(m_variables_update_interval, watch.second.interval);
+        if(watch.second.variables.empty())
+            all_variables = true;
+        names.insert(watch.second.variables.begin(), watch.second.variables.end());
+    }
+    m_variables_update_interval = std::max(m_variables_update_interval, tdm::minVariablesUpdateInterval);
+
+    m_watched_ranges.reset();
+    if(all_variables)
+        return;
+    // Adjacent variables are requested together, cut at variable boundaries
+    m_watched_ranges.emplace();
+    for(const auto& var : m_variables) {
+        if(var.size == 0 || !names.count(var.name))
+            continue;
+        auto& ranges = *m_watched_ranges;
+        if(!ranges.empty() && ranges.back().first + ranges.back().second == var.start &&
+           ranges.back().second + var.size <= ASEBA_MAX_EVENT_ARG_COUNT - 2) {
+            ranges.back().second += var.size;
+        } else {
+            ranges.emplace_back(var.start, var.size);
+        }
+    }
+}
+
+// A poll is answered by one Variables message by range requested, or by a single ChangedVariables message.
+// The rate is adapted once all the replies came, a variable having changed if any of them changed one.
+void aseba_node::on_variables_poll_reply(bool changed) {
+    m_variables_poll_changed = m_variables_poll_changed || changed;
+    if(!m_variables_pending_ranges.empty())
+        return;
+    adapt_variables_update_rate(m_variables_poll_changed);
+    m_variables_poll_changed = false;
+    schedule_variables_update();
+}
+
+// Poll less often while the variables do not change, or when the answer comes after the next poll was due,
+// which means the link is saturated. The requested rate is restored as soon as a variable changes.
+void aseba_node::adapt_variables_update_rate(bool changed) {
+    const auto delay = std::chrono::milliseconds(variables_update_delay().total_milliseconds());
+    const bool saturated =
+        m_variables_requested_at && std::chrono::steady_clock::now() - *m_variables_requested_at > delay;
+    m_variables_requested_at.reset();
+    if(changed && !saturated) {
+        m_variables_backoff = 0;
+    } else if(delay < tdm::maxVariablesUpdateInterval) {
+        m_variables_backoff++;
+    }
+}
+
+boost::posix_time::time_duration aseba_node::variables_update_delay() const {
+    const auto delay = std::min<std::chrono::milliseconds>(m_variables_update_interval * (1 << m_variables_backoff),
+                                                           tdm::maxVariablesUpdateInterval);
+    return boost::posix_time::milliseconds(delay.count());
 }
 
 void aseba_node::reset_known_variables(const Aseba::VariablesMap& variables) {
 
     // Set all the variables to null
-    variables_map removed;
+    std::unordered_set<std::string> removed;
     for(auto&& var : m_variables) {
-        removed.emplace(var.name, property{});
+        removed.insert(var.name);
     }
 
     m_variables.clear();
@@ -664,8 +966,20 @@ void aseba_node::reset_known_variables(const Aseba::VariablesMap& variables) {
         }
     }
 
+    m_variables_by_address.clear();
+    for(std::size_t i = 0; i < m_variables.size(); i++) {
+        const auto& var = m_variables[i];
+        if(m_variables_by_address.size() < std::size_t(var.start + var.size))
+            m_variables_by_address.resize(var.start + var.size, no_variable);
+        std::fill_n(m_variables_by_address.begin() + var.start, var.size, uint16_t(i));
+    }
+
     // Signal the removed variables to watching applications
-    m_variables_changed_signal(shared_from_this(), removed, std::chrono::system_clock::now());
+    variables_snapshot removed_variables;
+    for(auto&& name : removed) {
+        removed_variables.add_null(name);
+    }
+    notify_variables_changed(std::move(removed_variables));
 
     // Ask the device for all variables
     // This will sync up the value of non-removed variables
@@ -673,44 +987,75 @@ void aseba_node::reset_known_variables(const Aseba::VariablesMap& variables) {
 }
 
 void aseba_node::on_variables_message(const Aseba::Variables& msg) {
-    variables_map changed;
+    std::vector<std::size_t> changed;
     set_variables(msg.start, msg.variables, changed);
-    m_variables_changed_signal(shared_from_this(), changed, std::chrono::system_clock::now());
-    schedule_variables_update();
+    // Not every Variables message answers a poll, see on_description_received
+    auto range = std::find(m_variables_pending_ranges.begin(), m_variables_pending_ranges.end(), msg.start);
+    const bool polled = range != m_variables_pending_ranges.end();
+    if(polled)
+        m_variables_pending_ranges.erase(range);
+    const bool any_changed = !changed.empty();
+    notify_variables_changed(std::move(changed));
+    if(polled)
+        on_variables_poll_reply(any_changed);
 }
 
 void aseba_node::on_variables_message(const Aseba::ChangedVariables& msg) {
-    variables_map changed;
+    std::vector<std::size_t> changed;
     for(const auto& area : msg.variables) {
         set_variables(area.start, area.variables, changed);
     }
-    m_variables_changed_signal(shared_from_this(), changed, std::chrono::system_clock::now());
-    schedule_variables_update();
+    m_variables_pending_ranges.clear();
+    const bool any_changed = !changed.empty();
+    notify_variables_changed(std::move(changed));
+    on_variables_poll_reply(any_changed);
 }
 
-void aseba_node::set_variables(uint16_t start, const std::vector<int16_t>& data, variables_map& vars) {
+void aseba_node::notify_variables_changed(std::vector<std::size_t>&& changed) {
+    if(changed.empty() || m_variables_changed_signal.empty())
+        return;
+    // A variable can be part of several areas of a ChangedVariables message
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    variables_snapshot vars;
+    for(auto i : changed) {
+        const auto& var = m_variables[i];
+        vars.add(var.name, var.value.data(), var.value.size());
+    }
+    notify_variables_changed(std::move(vars));
+}
+
+void aseba_node::notify_variables_changed(variables_snapshot&& vars) {
+    // Serialize the notification once for all the watching applications, and only if there are some
+    if(m_variables_changed_signal.empty())
+        return;
+    m_variables_changed_signal(shared_from_this(),
+                               make_variables_update(*this, std::move(vars), std::chrono::system_clock::now()));
+}
+
+void aseba_node::set_variables(uint16_t start, const std::vector<int16_t>& data, std::vector<std::size_t>& changed) {
 
     auto data_it = std::begin(data);
-    auto it = m_variables.begin();
     while(data_it != std::end(data)) {
-        it = std::find_if(it, m_variables.end(), [start](const aseba_vm_variable& var) {
-            return start >= var.start && start < var.start + var.size;
-        });
-        if(it == std::end(m_variables))
+        if(start >= m_variables_by_address.size())
             return;
-        auto& var = *it;
+        const auto index = m_variables_by_address[start];
+        if(index == no_variable) {  // not a variable, skip that word
+            ++data_it;
+            ++start;
+            continue;
+        }
+        auto& var = m_variables[index];
         const auto var_start = start - var.start;
         bool force_change = var.size != var.value.size();
         var.value.resize(var.size, 0);
         const auto count = std::min(std::ptrdiff_t(var.size - var_start), std::distance(data_it, std::end(data)));
-        if(count < 0)
-            break;
         if(force_change ||
            !std::equal(std::begin(var.value) + var_start, std::begin(var.value) + var_start + count, data_it,
                        data_it + count)) {
             std::copy(data_it, data_it + count, std::begin(var.value) + var_start);
-            vars.insert(std::pair{var.name, detail::aseba_variable_from_range(var.value)});
-            mLogTrace("Variable changed {} : {}", var.name, detail::aseba_variable_from_range(var.value));
+            changed.push_back(index);
+            mLogTrace("Variable changed {}", var.name);
             if(var.name == "_fwversion" && m_firmware_version != var.value[0]) {
                 m_firmware_version = var.value[0];
                 set_status(m_status);
@@ -723,18 +1068,25 @@ void aseba_node::set_variables(uint16_t start, const std::vector<int16_t>& data,
 
 
 variables_map aseba_node::variables() const {
-    variables_map map;
-    map.reserve(m_variables.size());
+    return snapshot_variables().to_variables_map();
+}
+
+variables_snapshot aseba_node::snapshot_variables() const {
+    variables_snapshot snapshot;
     for(auto& var : m_variables) {
-        map.emplace(var.name, detail::aseba_variable_from_range(var.value));
+        snapshot.add(var.name, var.value.data(), var.value.size());
     }
-    return map;
+    return snapshot;
+}
+
+void aseba_node::schedule_variables_update() {
+    schedule_variables_update(variables_update_delay());
 }
 
 void aseba_node::schedule_variables_update(boost::posix_time::time_duration delay) {
     m_variables_timer.expires_from_now(delay);
     std::weak_ptr<aseba_node> ptr = shared_from_this();
-    m_variables_timer.async_wait([ptr](boost::system::error_code ec) {
+    m_variables_timer.async_wait(boost::asio::bind_executor(m_strand, [ptr](boost::system::error_code ec) {
         if(ec)
             return;
         auto that = ptr.lock();
@@ -746,11 +1098,11 @@ void aseba_node::schedule_variables_update(boost::posix_time::time_duration dela
             that->request_variables();
 
         // schedule_variables_update is called in on_variables_message
-        // every 100ms or so
+        // at the rate the watchers requested
         // However, the packet might be dropped, so this is a fail safe to make
         // sure we ask for variables at least once every second
         that->schedule_variables_update(boost::posix_time::seconds(1));
-    });
+    }));
 }
 
 void aseba_node::on_device_info(const Aseba::DeviceInfo& info) {
@@ -807,6 +1159,7 @@ bool aseba_node::set_rf_settings(uint16_t network, uint16_t node, uint8_t channe
 
     write_message(std::make_shared<Aseba::SetDeviceInfo>(native_id(), DEVICE_INFO_THYMIO2_RF_SETTINGS, data));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    m_uploaded_bytecode.reset();
     write_message(std::make_shared<Aseba::Reboot>(native_id()));
     write_message(std::make_shared<Aseba::Reboot>(native_id()));
     return true;
@@ -864,6 +1217,7 @@ bool aseba_node::upgrade_firmware(
     if(is_wirelessly_connected() || m_status != aseba_node::status::available)
         return false;
     set_status(status::upgrading);
+    m_uploaded_bytecode.reset();
     if(auto ptr = m_endpoint.lock())
         return ptr->upgrade_firmware(m_id, cb);
     return false;
@@ -940,14 +1294,15 @@ void aseba_node::request_next_description_fragment() {
 
     // retrigger a description fragment message in case it's dropped by the wireless key
     m_resend_timer.expires_from_now(boost::posix_time::seconds(1));
-    m_resend_timer.async_wait([ptr = weak_from_this()](boost::system::error_code ec) {
+    auto ptr = weak_from_this();
+    m_resend_timer.async_wait(boost::asio::bind_executor(m_strand, [ptr](boost::system::error_code ec) {
         if(ec)
             return;
         auto that = ptr.lock();
         if(!that)
             return;
         that->request_next_description_fragment();
-    });
+    }));
 }
 
 }  // namespace mobsya
@@ -1,8 +1,12 @@
 #pragma once
+#include <array>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <boost/asio/post.hpp>
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
 #include <boost/asio/deadline_timer.hpp>
 #include <atomic>
 #include <aseba/flatbuffers/thymio_generated.h>
@@ -16,6 +20,8 @@
 #include "property.h"
 #include "events.h"
 #include "common_types.h"
+#include "compilation_service.h"
+#include "tdm.h"
 
 namespace mobsya {
 class group;
@@ -76,22 +82,48 @@ public:
         std::optional<result_data> result;
     };
 
+    // Execution counters of a node running a VM built with ASEBA_VM_PROFILER, mapped back to the source code
+    struct vm_profile {
+        struct line_data {
+            std::string handler;  // "onevent <name>" or "sub <name>"
+            uint32_t line;
+            uint64_t steps = 0;
+            uint64_t native_time = 0;  // in the time unit of the node, typically microseconds
+        };
+        struct event_data {
+            std::string name;  // "onevent <name>", as in lines
+            uint32_t runs = 0;
+            uint32_t steps = 0;
+        };
+        std::vector<line_data> lines;
+        std::vector<event_data> events;
+
+        // One "handler;line steps" entry per line, the folded stacks format of flamegraph.pl
+        std::string folded_stacks() const;
+    };
+
     using breakpoints = std::unordered_set<breakpoint>;
-    using variables_watch_signal_t = boost::signals2::signal<void(std::shared_ptr<aseba_node>, variables_map,
-                                                                  std::chrono::system_clock::time_point)>;
+    using variables_watch_signal_t =
+        boost::signals2::signal<void(std::shared_ptr<aseba_node>, shared_node_values_update)>;
 
-    using events_watch_signal_t = boost::signals2::signal<void(std::shared_ptr<aseba_node>, variables_map,
-                                                               std::chrono::system_clock::time_point)>;
+    using events_watch_signal_t = boost::signals2::signal<void(std::shared_ptr<aseba_node>, shared_node_values_update)>;
 
     using vm_state_watch_signal_t = boost::signals2::signal<void(std::shared_ptr<aseba_node>, vm_execution_state)>;
     using vm_execution_state_command = fb::VMExecutionStateCommand;
 
+    // What a watcher of the variables needs, the node is polled for all its watchers at once
+    struct variables_watch {
+        std::chrono::milliseconds interval = tdm::defaultVariablesUpdateInterval;
+        std::vector<std::string> variables;  // all of them if empty
+    };
+
 
     aseba_node(boost::asio::io_context& ctx, node_id_t id, uint16_t protocol_version,
                std::weak_ptr<mobsya::aseba_endpoint> endpoint);
     using write_callback = std::function<void(boost::system::error_code)>;
     using breakpoints_callback = std::function<void(boost::system::error_code, breakpoints)>;
     using compilation_callback = std::function<void(boost::system::error_code, compilation_result)>;
+    using profile_callback = std::function<void(boost::system::error_code, vm_profile)>;
 
     ~aseba_node();
 
@@ -128,11 +160,13 @@ public:
     std::shared_ptr<mobsya::group> group() const;
 
     variables_map variables() const;
+    variables_snapshot snapshot_variables() const;
     events_table events_description() const;
     vm_execution_state execution_state() const;
 
-    // Write n messages to the enpoint owning that node, then invoke cb when all message have been written
-    void write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& message, write_callback&& cb = {});
+    // Write n messages to the enpoint owning that node, then invoke cb when all message have been written.
+    // Return false if they were not queued, see aseba_endpoint::write_messages
+    bool write_messages(std::vector<std::shared_ptr<Aseba::Message>>&& message, write_callback&& cb = {});
     // Write a message to the enpoint owning that node, then invoke cb
     void write_message(std::shared_ptr<Aseba::Message> message, write_callback&& cb = {});
 
@@ -142,6 +176,8 @@ public:
                                   compilation_callback&& cb = {});
     void set_vm_execution_state(vm_execution_state_command state, write_callback&& cb = {});
     void set_breakpoints(std::vector<breakpoint> breakpoints, breakpoints_callback&& cb = {});
+    // Fetch the execution counters of the node, nodes which are not profiling fail with a timeout
+    void fetch_profile(profile_callback&& cb);
 
     boost::system::error_code set_node_variables(const variables_map& map, write_callback&& cb = {});
 
@@ -149,11 +185,15 @@ public:
     bool lock(void* app);
     bool unlock(void* app);
 
-    template <typename... ConnectionArgs>
-    auto connect_to_variables_changes(ConnectionArgs... args) {
+    template <typename Slot>
+    auto connect_to_variables_changes(Slot&& slot, variables_watch watch = {}) {
+        auto connection = m_variables_changed_signal.connect(std::forward<Slot>(slot));
+        m_variables_watches.emplace_back(connection, std::move(watch));
+        update_variables_watches();
+        m_variables_backoff = 0;
         m_resend_all_variables = true;
         schedule_variables_update();
-        return m_variables_changed_signal.connect(std::forward<ConnectionArgs>(args)...);
+        return connection;
     }
 
     template <typename... ConnectionArgs>
@@ -177,9 +217,28 @@ private:
     friend class group;
 
     void set_status(status);
-    tl::expected<compilation_result, boost::system::error_code>
-    do_compile_program(Aseba::Compiler& compiler, Aseba::CommonDefinitions& defs, fb::ProgrammingLanguage language,
-                       const std::string& program, Aseba::BytecodeVector& bytecode);
+    // Compiler of the node, keeping the compiled events and subroutines between the compilations of its program
+    struct incremental_compiler {
+        incremental_compiler() {
+            compiler.setIncrementalCompilation(true);
+        }
+        std::mutex mutex;
+        Aseba::Compiler compiler;
+    };
+    // Called from the compilation threads, must not access the node
+    static tl::expected<std::shared_ptr<const compiled_program>, boost::system::error_code>
+    do_compile_program(node_id_t id, const Aseba::TargetDescription& description,
+                       const Aseba::CommonDefinitions& defs, fb::ProgrammingLanguage language,
+                       const std::string& program, compilation_service::cache_type& cache,
+                       incremental_compiler& incremental);
+
+    struct compilation_job;
+    using compilation_done_callback = std::function<void(compilation_job&)>;
+    // Compile on the compilation_service, cancelling the pending compilation tracked by token, if any.
+    // done is called on the io_context, with an operation_aborted error if the compilation was superseded.
+    void start_compilation(fb::ProgrammingLanguage language, const std::string& program,
+                           compilation_service::cancellation_token& token, compilation_done_callback&& done);
+    void send_compiled_program(compilation_job& job, compilation_callback&& cb);
 
     // Must be called before destructor !
     void disconnect();
@@ -193,8 +252,15 @@ private:
     void request_variables();
     void on_variables_message(const Aseba::Variables& msg);
     void on_variables_message(const Aseba::ChangedVariables& msg);
-    void set_variables(uint16_t start, const std::vector<int16_t>& data, variables_map& vars);
-    void schedule_variables_update(boost::posix_time::time_duration delay = boost::posix_time::milliseconds(100));
+    void set_variables(uint16_t start, const std::vector<int16_t>& data, std::vector<std::size_t>& changed);
+    void notify_variables_changed(std::vector<std::size_t>&& changed);
+    void notify_variables_changed(variables_snapshot&& vars);
+    void schedule_variables_update();
+    void schedule_variables_update(boost::posix_time::time_duration delay);
+    void update_variables_watches();
+    void on_variables_poll_reply(bool changed);
+    void adapt_variables_update_rate(bool changed);
+    boost::posix_time::time_duration variables_update_delay() const;
     void on_execution_state_message(const Aseba::ExecutionStateChanged&);
     void on_vm_runtime_error(const Aseba::Message&);
     void schedule_execution_state_update();
@@ -202,7 +268,15 @@ private:
 
     void on_breakpoint_set_result(const Aseba::BreakpointSetResult&);
     void cancel_pending_breakpoint_request();
-    void compile_and_send_aseba_command(const std::string& program);
+    void on_profile_data(const Aseba::ProfileData&);
+    void cancel_pending_profile_request(boost::system::error_code ec = {});
+    void set_code_regions(const Aseba::Compiler::SubroutineTable& subroutines, const Aseba::CommonDefinitions& defs);
+    vm_profile make_profile(const std::array<std::vector<uint32_t>, 4>& counters) const;
+    void compile_and_send_aseba_command(const std::string& program,
+                                        std::vector<std::shared_ptr<Aseba::Message>>&& then = {},
+                                        write_callback&& cb = {});
+    // Send m_bytecode, only the parts differing from the bytecode last uploaded when it is known
+    void upload_bytecode(write_callback&& cb = {}, std::vector<std::shared_ptr<Aseba::Message>>&& then = {});
 
     void step_to_next_line(write_callback&& cb);
     void handle_step_request();
@@ -229,8 +303,15 @@ private:
         uint16_t variables{0}, events{0}, functions{0};
     } m_description_message_counter;
     Aseba::BytecodeVector m_bytecode;
+    // Bytecode on the node, unknown until the first upload and after the node restarts
+    std::optional<std::vector<uint16_t>> m_uploaded_bytecode;
     breakpoints m_breakpoints;
+    compilation_service::cancellation_token m_pending_compilation;
+    compilation_service::cancellation_token m_pending_upload;
+    std::shared_ptr<incremental_compiler> m_compiler;
     boost::asio::io_context& m_io_ctx;
+    // The strand of the registery, shared by all nodes
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
 
     struct {
         int pc = 0;
@@ -254,14 +335,31 @@ private:
         aseba_vm_variable(const std::string& name, uint16_t start, uint16_t size)
             : name(name), start(start), size(size) {}
     };
+    // sorted by address
     std::vector<aseba_vm_variable> m_variables;
+    // index in m_variables of the variable at each address of the memory of the vm
+    std::vector<uint16_t> m_variables_by_address;
+    static constexpr uint16_t no_variable = std::numeric_limits<uint16_t>::max();
     boost::asio::deadline_timer m_variables_timer;
     boost::asio::deadline_timer m_status_timer;
     variables_watch_signal_t m_variables_changed_signal;
     events_watch_signal_t m_events_signal;
     vm_state_watch_signal_t m_vm_state_watch_signal;
     std::atomic<bool> m_resend_all_variables = true;
+    std::vector<std::pair<boost::signals2::connection, variables_watch>> m_variables_watches;
+    // What the watchers need, see update_variables_watches
+    std::chrono::milliseconds m_variables_update_interval = tdm::defaultVariablesUpdateInterval;
+    // (start, size) of the variables to request, all of them if not set
+    std::optional<std::vector<std::pair<uint16_t, uint16_t>>> m_watched_ranges;
+    // The polling interval is doubled this number of times
+    unsigned m_variables_backoff = 0;
+    std::optional<std::chrono::steady_clock::time_point> m_variables_requested_at;
+    // Start of the ranges requested by the last poll whose Variables reply did not come yet
+    std::vector<uint16_t> m_variables_pending_ranges;
+    // Whether a reply to the last poll changed a variable
+    bool m_variables_poll_changed = false;
     boost::asio::deadline_timer m_resend_timer;
+    boost::asio::deadline_timer m_profile_timer;
 
 
     unsigned line_from_pc(unsigned pc) const;
@@ -274,6 +372,16 @@ private:
         breakpoints_callback cb;
     };
     std::shared_ptr<break_point_cb_data> m_pending_breakpoint_request;
+
+    // Start address in the bytecode -> name of the event handler or subroutine starting there
+    std::map<unsigned, std::string> m_code_regions;
+
+    struct profile_cb_data {
+        std::array<std::vector<uint32_t>, 4> counters;  // indexed by AsebaProfileCounters
+        std::size_t pending = 0;
+        profile_callback cb;
+    };
+    std::shared_ptr<profile_cb_data> m_pending_profile_request;
     std::queue<std::function<void()>> m_callbacks_pending_execution_state_change;
 
     struct step_cb_data {
@@ -286,4 +394,12 @@ private:
     std::shared_ptr<step_cb_data> m_pending_step_request;
 };
 
+// What a compilation produces, cached and shared by the nodes the same program is compiled for
+struct compiled_program {
+    aseba_node::compilation_result result;
+    Aseba::BytecodeVector bytecode;
+    Aseba::VariablesMap variables;
+    Aseba::Compiler::SubroutineTable subroutines;
+};
+
 }  // namespace mobsya
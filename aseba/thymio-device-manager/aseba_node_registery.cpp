@@ -7,11 +7,14 @@
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/asio/ip/host_name.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
 
 namespace mobsya {
 
 aseba_node_registery::aseba_node_registery(boost::asio::execution_context& io_context)
     : boost::asio::detail::service_base<aseba_node_registery>(static_cast<boost::asio::io_context&>(io_context))
+    , m_strand(static_cast<boost::asio::io_context&>(io_context).get_executor())
     , m_service_uid(boost::asio::use_service<uuid_generator>(io_context).generate())
     , m_discovery_socket(static_cast<boost::asio::io_context&>(io_context))
     , m_nodes_service_desc("mobsya") {
@@ -128,7 +131,8 @@ void aseba_node_registery::update_discovery() {
     m_updating_discovery = true;
     m_discovery_socket.async_announce(
         m_nodes_service_desc,
-        std::bind(&aseba_node_registery::on_update_discovery_complete, this, std::placeholders::_1));
+        boost::asio::bind_executor(
+            m_strand, std::bind(&aseba_node_registery::on_update_discovery_complete, this, std::placeholders::_1)));
 }
 
 void aseba_node_registery::on_update_discovery_complete(const boost::system::error_code& ec) {
@@ -139,8 +143,7 @@ void aseba_node_registery::on_update_discovery_complete(const boost::system::err
     }
     m_updating_discovery = false;
     if(m_discovery_needs_update) {
-        boost::asio::post(boost::asio::get_associated_executor(this),
-                          boost::bind(&aseba_node_registery::update_discovery, this));
+        boost::asio::post(m_strand, boost::bind(&aseba_node_registery::update_discovery, this));
     }
 }
 
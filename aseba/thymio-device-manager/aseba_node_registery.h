@@ -1,5 +1,6 @@
 #pragma once
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
 #include <unordered_map>
 #include <random>
 #include <chrono>
@@ -20,9 +21,17 @@ public:
     using node_id = mobsya::node_id;
     using node_map = std::unordered_map<node_id, std::weak_ptr<aseba_node>>;
     using group_map = std::unordered_map<node_id, std::shared_ptr<group>>;
+    using strand_type = boost::asio::strand<boost::asio::io_context::executor_type>;
 
     aseba_node_registery(boost::asio::execution_context& ctx);
 
+    // When the io_context runs on several threads, the registery, the nodes, their groups and their
+    // aseba endpoints must only be used from this strand.
+    // There is a single strand for all devices, so the traffic of different robots is never handled in parallel
+    strand_type strand() const {
+        return m_strand;
+    }
+
     void add_node(std::shared_ptr<aseba_node> node);
     void remove_node(const std::shared_ptr<aseba_node>& node);
     void set_node_status(const std::shared_ptr<aseba_node>& node, aseba_node::status);
@@ -53,6 +62,7 @@ private:
 
     node_map::const_iterator find(const std::shared_ptr<aseba_node>& node) const;
     node_map::const_iterator find_from_native_id(aseba_node::node_id_t id) const;
+    strand_type m_strand;
     boost::uuids::uuid m_service_uid;
 
     node_map m_aseba_nodes;
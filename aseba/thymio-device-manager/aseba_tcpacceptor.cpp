@@ -2,6 +2,7 @@
 #include <iostream>
 #include <regex>
 #include "aseba_endpoint.h"
+#include "aseba_node_registery.h"
 #include "log.h"
 #include "interfaces.h"
 
@@ -14,6 +15,7 @@ static const std::map<std::string, aseba_endpoint::endpoint_type> endpoint_type_
 aseba_tcp_acceptor::aseba_tcp_acceptor(boost::asio::io_context& io_context)
     : boost::asio::detail::service_base<aseba_tcp_acceptor>(io_context)
     , m_iocontext(io_context)
+    , m_strand(boost::asio::use_service<aseba_node_registery>(io_context).strand())
     , m_stopped(false)
     , m_contact("aseba")
     , m_monitor(m_monitor_ctx)
@@ -36,7 +38,7 @@ void aseba_tcp_acceptor::free_endpoint(const aseba_device* ep) {
     if(it != m_known_contacts.end()) {
         m_disconnected_contacts.insert(it->second);
         m_known_contacts.erase(it);
-        boost::asio::post(m_iocontext, boost::bind(&aseba_tcp_acceptor::do_accept, this));
+        boost::asio::post(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
     }
 }
 
@@ -53,7 +55,7 @@ void aseba_tcp_acceptor::monitor_next() {
         }
         mLogTrace("New contact {} : {}", m_contact.name(), m_contact.domain());
         this->push_contact(m_contact);
-        boost::asio::post(m_iocontext, boost::bind(&aseba_tcp_acceptor::do_accept, this));
+        boost::asio::post(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
         if(!m_stopped.load())
             monitor_next();
     });
@@ -61,7 +63,7 @@ void aseba_tcp_acceptor::monitor_next() {
 
 void aseba_tcp_acceptor::accept() {
     mLogInfo("Waiting for aseba node on tcp");
-    do_accept();
+    boost::asio::dispatch(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
 }
 
 std::string remove_host_from_name(const std::string& str) {
@@ -83,14 +85,14 @@ void aseba_tcp_acceptor::do_accept() {
 void aseba_tcp_acceptor::do_accept_contact(aware::contact contact) {
     auto session = aseba_endpoint::create_for_tcp(m_iocontext);
     if(contact.empty() || contact.type() != "aseba") {
-        boost::asio::post(m_iocontext, boost::bind(&aseba_tcp_acceptor::do_accept, this));
+        boost::asio::post(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
         return;
     }
 
     if(!mobsya::endpoint_is_local(contact.endpoint()) && contact.name().find("Not A Thymio 3") != 0) {
         mLogTrace("Ignoring remote endoint {} ({}) (expected: {})", contact.name(),
                   contact.endpoint().address().to_string(), boost::asio::ip::host_name());
-        boost::asio::post(m_iocontext, boost::bind(&aseba_tcp_acceptor::do_accept, this));
+        boost::asio::post(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
         return;
     }
 
@@ -100,14 +102,16 @@ void aseba_tcp_acceptor::do_accept_contact(aware::contact contact) {
         auto it = m_connected_endpoints.find(key);
         if(it != std::end(m_connected_endpoints) && !it->second.expired()) {
             mLogTrace("[tcp] {} already connected", contact.endpoint());
-            boost::asio::post(m_iocontext, boost::bind(&aseba_tcp_acceptor::do_accept, this));
+            boost::asio::post(m_strand, boost::bind(&aseba_tcp_acceptor::do_accept, this));
             return;
         }
     }
 
     m_known_contacts.emplace(session->device(), contact);
     session->tcp().async_connect(
-        contact.endpoint(), [this, contact = std::move(contact), session, key = key](boost::system::error_code ec) {
+        contact.endpoint(),
+        boost::asio::bind_executor(m_strand, [this, contact = std::move(contact), session,
+                                              key = key](boost::system::error_code ec) {
             const auto& properties = contact.properties();
             int protocol_version = 5;
             aseba_endpoint::endpoint_type type = aseba_endpoint::endpoint_type::unknown;
@@ -115,7 +119,7 @@ void aseba_tcp_acceptor::do_accept_contact(aware::contact contact) {
             if(ec) {
                 mLogWarn("[tcp] Fail to connect to aseba node {} {} : {}", contact.name(),
                          contact.endpoint().address().to_string(), ec.message());
-                boost::asio::post(m_iocontext, [this] { this->accept(); });
+                boost::asio::post(m_strand, [this] { this->accept(); });
                 return;
             }
 
@@ -133,7 +137,7 @@ void aseba_tcp_acceptor::do_accept_contact(aware::contact contact) {
                 auto it = m_connected_endpoints.find(key);
                 if(it != std::end(m_connected_endpoints) && !it->second.expired()) {
                     mLogTrace("[tcp] {} already connected", contact.endpoint());
-                    boost::asio::post(m_iocontext, [this] { this->accept(); });
+                    boost::asio::post(m_strand, [this] { this->accept(); });
                     return;
                 }
                 m_connected_endpoints[key] = session;
@@ -155,8 +159,8 @@ void aseba_tcp_acceptor::do_accept_contact(aware::contact contact) {
             session->set_endpoint_name(remove_host_from_name(contact.name()));
             session->set_endpoint_type(type);
             session->start();
-            boost::asio::post(m_iocontext, [this] { this->accept(); });
-        });
+            boost::asio::post(m_strand, [this] { this->accept(); });
+        }));
 }  // namespace mobsya
 
 void aseba_tcp_acceptor::push_contact(aware::contact contact) {
@@ -7,6 +7,7 @@
 #include <queue>
 #include <thread>
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/strand.hpp>
 
 namespace mobsya {
 class aseba_endpoint;
@@ -33,6 +34,8 @@ private:
     std::set<aware::contact> m_disconnected_contacts;
 
     boost::asio::io_context& m_iocontext;
+    // Strand of the registery, the endpoints are created and freed on it
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
     std::thread m_monitor_thread;
     std::atomic_bool m_stopped;
     aware::contact m_contact;
@@ -1,7 +1,27 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <aseba/flatbuffers/fb_message_ptr.h>
 #include "property.h"
 #include "events.h"
+#include "variables_snapshot.h"
 
 namespace mobsya {
-using variables_map = std::unordered_map<std::string, property>;
 using events_table = std::vector<mobsya::event>;
+
+// Variables or events received from a node at once, along with the message notifying applications of them.
+// The message is serialized once per update, and the same immutable buffer is queued by every watching application.
+// The values of variables are kept to merge the pending updates of slow applications, events are never merged
+// and carry none.
+struct node_values_update {
+    variables_snapshot values;
+    std::chrono::system_clock::time_point timestamp;
+    tagged_detached_flatbuffer message;
+};
+using shared_node_values_update = std::shared_ptr<const node_values_update>;
+
+// Share the message of an update, which keeps the whole update alive while the message is queued
+inline std::shared_ptr<const tagged_detached_flatbuffer> shared_message(const shared_node_values_update& update) {
+    return {update, &update->message};
+}
 }  // namespace mobsya
\ No newline at end of file
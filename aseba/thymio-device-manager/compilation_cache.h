@@ -0,0 +1,154 @@
+#pragma once
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <aseba/compiler/compiler.h>
+
+namespace mobsya {
+
+// Identifies a compilation: the same source compiled for the same target with the same common definitions
+// always produces the same result.
+// The key holds all the inputs of the compiler rather than their hashes, so that two keys are only equal when
+// their compilations are, whatever the collisions of the hashes used to find them.
+struct compilation_key {
+    std::string source;
+    std::wstring target;       // target_layout()
+    std::wstring definitions;  // definitions_layout()
+
+    bool operator==(const compilation_key& other) const {
+        return source == other.source && target == other.target && definitions == other.definitions;
+    }
+};
+
+namespace detail {
+    // Fields are terminated by a null character, which names cannot contain, and lists are prefixed by their size
+    inline void append_field(std::wstring& layout, const std::wstring& field) {
+        layout += field;
+        layout += L'\0';
+    }
+    inline void append_field(std::wstring& layout, long long field) {
+        append_field(layout, std::to_wstring(field));
+    }
+}  // namespace detail
+
+// The parts of a target description read by the compiler, in a comparable form
+inline std::wstring target_layout(const Aseba::TargetDescription& description) {
+    std::wstring layout;
+    detail::append_field(layout, description.bytecodeSize);
+    detail::append_field(layout, description.variablesSize);
+    detail::append_field(layout, description.stackSize);
+    detail::append_field(layout, description.namedVariables.size());
+    for(const auto& variable : description.namedVariables) {
+        detail::append_field(layout, variable.name);
+        detail::append_field(layout, variable.size);
+    }
+    detail::append_field(layout, description.localEvents.size());
+    for(const auto& event : description.localEvents)
+        detail::append_field(layout, event.name);
+    detail::append_field(layout, description.nativeFunctions.size());
+    for(const auto& function : description.nativeFunctions) {
+        detail::append_field(layout, function.name);
+        detail::append_field(layout, function.parameters.size());
+        for(const auto& parameter : function.parameters) {
+            detail::append_field(layout, parameter.name);
+            detail::append_field(layout, parameter.size);
+        }
+    }
+    return layout;
+}
+
+// Common definitions in a comparable form
+inline std::wstring definitions_layout(const Aseba::CommonDefinitions& defs) {
+    std::wstring layout;
+    for(const auto* values : {&defs.events, &defs.constants}) {
+        detail::append_field(layout, values->size());
+        for(const auto& value : *values) {
+            detail::append_field(layout, value.name);
+            detail::append_field(layout, value.value);
+        }
+    }
+    return layout;
+}
+
+inline std::size_t hash_combine(std::size_t seed, std::size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+struct compilation_key_hash {
+    std::size_t operator()(const compilation_key& key) const {
+        std::size_t seed = std::hash<std::string>()(key.source);
+        seed = hash_combine(seed, std::hash<std::wstring>()(key.target));
+        return hash_combine(seed, std::hash<std::wstring>()(key.definitions));
+    }
+};
+
+/*
+ * Bounded cache of compilation results, evicting the least recently used ones.
+ * Clients compile the same programs over and over, and a classroom uploads the same program
+ * to identical robots. It is shared by the compilation threads.
+ */
+template <typename Result>
+class compilation_cache {
+public:
+    struct stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t entries = 0;
+    };
+
+    explicit compilation_cache(std::size_t capacity) : m_capacity(capacity) {}
+
+    // Return the result cached for key, counting a hit or a miss
+    std::optional<Result> find(const compilation_key& key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if(it == m_index.end()) {
+            m_stats.misses++;
+            return {};
+        }
+        m_stats.hits++;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->second;
+    }
+
+    void insert(const compilation_key& key, Result result) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_capacity == 0)
+            return;
+        auto it = m_index.find(key);
+        if(it != m_index.end()) {
+            it->second->second = std::move(result);
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return;
+        }
+        if(m_entries.size() == m_capacity) {
+            m_index.erase(m_entries.back().first);
+            m_entries.pop_back();
+        }
+        m_entries.emplace_front(key, std::move(result));
+        m_index.emplace(key, m_entries.begin());
+    }
+
+    stats statistics() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats s = m_stats;
+        s.entries = m_entries.size();
+        return s;
+    }
+
+private:
+    // most recently used first
+    using entries = std::list<std::pair<compilation_key, Result>>;
+
+    mutable std::mutex m_mutex;
+    entries m_entries;
+    std::unordered_map<compilation_key, typename entries::iterator, compilation_key_hash> m_index;
+    std::size_t m_capacity;
+    stats m_stats;
+};
+
+}  // namespace mobsya
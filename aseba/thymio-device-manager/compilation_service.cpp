@@ -0,0 +1,32 @@
+#include "compilation_service.h"
+#include <algorithm>
+#include <thread>
+#include "log.h"
+#include "tdm.h"
+
+namespace mobsya {
+
+static std::size_t compilation_threads() {
+    // Keep a core for the io_context
+    const std::size_t cores = std::thread::hardware_concurrency();
+    return std::clamp<std::size_t>(cores > 1 ? cores - 1 : 1, 1, 4);
+}
+
+compilation_service::compilation_service(boost::asio::execution_context& ctx)
+    : boost::asio::detail::service_base<compilation_service>(static_cast<boost::asio::io_context&>(ctx))
+    , m_pool(compilation_threads())
+    , m_cache(tdm::maxCompilationCacheEntries) {
+    mLogTrace("Compiling on {} threads", compilation_threads());
+}
+
+compilation_service::~compilation_service() {
+    shutdown();
+}
+
+void compilation_service::shutdown() {
+    // Pending compilations are not worth waiting for
+    m_pool.stop();
+    m_pool.join();
+}
+
+}  // namespace mobsya
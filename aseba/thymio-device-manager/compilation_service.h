@@ -0,0 +1,73 @@
+#pragma once
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <tl/expected.hpp>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "compilation_cache.h"
+
+namespace mobsya {
+
+struct compiled_program;
+
+/*
+ * Runs the compilation of Aseba programs on a pool of threads, so that compiling a large program
+ * does not stall the io_context serving the robots and the applications.
+ * Jobs must not touch the state of the nodes, they post their results back to the io_context instead.
+ */
+class compilation_service : public boost::asio::detail::service_base<compilation_service> {
+public:
+    // Set when a compilation is superseded by a newer one, the pending job can then be skipped
+    using cancellation_token = std::shared_ptr<std::atomic<bool>>;
+
+    compilation_service(boost::asio::execution_context& ctx);
+    ~compilation_service() override;
+
+    static cancellation_token make_cancellation_token() {
+        return std::make_shared<std::atomic<bool>>(false);
+    }
+
+    using cache_type = compilation_cache<std::shared_ptr<const compiled_program>>;
+    cache_type& cache() {
+        return m_cache;
+    }
+
+    template <typename Job>
+    void post(Job&& job) {
+        boost::asio::post(m_pool, std::forward<Job>(job));
+    }
+
+    // Run work, which returns a tl::expected<T, boost::system::error_code>, on the pool, and pass its result to
+    // done on executor. This supersedes the job previously started with token, if any: its work is skipped if it
+    // has not started yet, and it completes with operation_aborted even if its result was already posted.
+    template <typename Executor, typename Work, typename Done>
+    void start(cancellation_token& token, const Executor& executor, Work&& work, Done&& done) {
+        if(token)
+            *token = true;
+        token = make_cancellation_token();
+        post([cancelled = token, executor, work = std::forward<Work>(work), done = std::forward<Done>(done)]() mutable {
+            using result_type = std::decay_t<decltype(work())>;
+            result_type result = *cancelled ? result_type(tl::make_unexpected(aborted())) : work();
+            boost::asio::post(executor, [cancelled, result = std::move(result), done = std::move(done)]() mutable {
+                if(*cancelled)
+                    result = tl::make_unexpected(aborted());
+                done(std::move(result));
+            });
+        });
+    }
+
+private:
+    void shutdown() override;
+    static boost::system::error_code aborted() {
+        return boost::asio::error::make_error_code(boost::asio::error::operation_aborted);
+    }
+
+    boost::asio::thread_pool m_pool;
+    cache_type m_cache;
+};
+
+}  // namespace mobsya
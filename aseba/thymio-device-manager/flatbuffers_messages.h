@@ -41,6 +41,27 @@ inline tagged_detached_flatbuffer create_set_breakpoint_response(uint32_t reques
     return wrap_fb(fb, offset);
 }
 
+inline tagged_detached_flatbuffer create_vm_profile_response(uint32_t request_id, const mobsya::aseba_node& n,
+                                                             const aseba_node::vm_profile& profile) {
+    flatbuffers::FlatBufferBuilder fb;
+    std::vector<flatbuffers::Offset<fb::VMProfileLine>> lines;
+    for(const auto& line : profile.lines) {
+        lines.push_back(mobsya::fb::CreateVMProfileLine(fb, fb.CreateString(line.handler), line.line, line.steps,
+                                                        line.native_time));
+    }
+    std::vector<flatbuffers::Offset<fb::VMProfileEvent>> events;
+    for(const auto& event : profile.events) {
+        events.push_back(mobsya::fb::CreateVMProfileEvent(fb, fb.CreateString(event.name), event.runs, event.steps));
+    }
+    auto idOffset = n.uuid().fb(fb);
+    auto linesOffset = fb.CreateVector(lines);
+    auto eventsOffset = fb.CreateVector(events);
+    auto stacksOffset = fb.CreateString(profile.folded_stacks());
+    auto offset =
+        mobsya::fb::CreateVMProfile(fb, request_id, idOffset, linesOffset, eventsOffset, stacksOffset);
+    return wrap_fb(fb, offset);
+}
+
 inline tagged_detached_flatbuffer create_compilation_result_response(uint32_t request_id,
                                                                      const aseba_node::compilation_result& result) {
     flatbuffers::FlatBufferBuilder fb;
@@ -110,6 +131,30 @@ namespace detail {
         }
         return fb.CreateVectorOfSortedTables(&varsOffsets);
     }
+    // Same encoding as the properties of a variables_map, without building them
+    inline auto serialize_variables(flatbuffers::FlatBufferBuilder& fb, const mobsya::variables_snapshot& vars) {
+        flexbuffers::Builder flexbuilder;
+        std::vector<flatbuffers::Offset<fb::NodeVariable>> varsOffsets;
+        varsOffsets.reserve(vars.size());
+        vars.for_each([&](const std::string& name, const variables_snapshot::words& values) {
+            if(values.empty()) {
+                flexbuilder.Null();
+            } else {
+                auto start = flexbuilder.StartVector();
+                for(auto v : values) {
+                    flexbuilder.Int(v);
+                }
+                flexbuilder.EndVector(start, false, false);
+            }
+            flexbuilder.Finish();
+            auto& vec = flexbuilder.GetBuffer();
+            auto vecOffset = fb.CreateVector(vec);
+            auto keyOffset = fb.CreateString(name);
+            varsOffsets.push_back(fb::CreateNodeVariable(fb, keyOffset, vecOffset));
+            flexbuilder.Clear();
+        });
+        return fb.CreateVectorOfSortedTables(&varsOffsets);
+    }
     inline auto serialize_events(flatbuffers::FlatBufferBuilder& fb, const mobsya::group::properties_map& events) {
         flexbuffers::Builder flexbuilder;
         std::vector<flatbuffers::Offset<fb::NamedValue>> eventsOffsets;
@@ -126,26 +171,36 @@ namespace detail {
     }
 }  // namespace detail
 
-inline tagged_detached_flatbuffer serialize_changed_variables(const mobsya::aseba_node& n,
-                                                              const mobsya::variables_map& vars,
-                                                              const std::chrono::system_clock::time_point& timestamp) {
+template <typename Variables>
+tagged_detached_flatbuffer serialize_changed_variables(const node_id& id, const Variables& vars,
+                                                       const std::chrono::system_clock::time_point& timestamp) {
     flatbuffers::FlatBufferBuilder fb;
-    auto idOffset = n.uuid().fb(fb);
+    auto idOffset = id.fb(fb);
     auto varsOffset = detail::serialize_variables(fb, vars);
     const auto ms = std::chrono::time_point_cast<std::chrono::milliseconds>(timestamp).time_since_epoch().count();
     auto offset = fb::CreateVariablesChanged(fb, idOffset, varsOffset, ms);
     return wrap_fb(fb, offset);
 }
 
-inline tagged_detached_flatbuffer serialize_changed_variables(const mobsya::group& n,
-                                                              const mobsya::variables_map& vars) {
+inline tagged_detached_flatbuffer serialize_changed_variables(const mobsya::aseba_node& n,
+                                                              const mobsya::variables_map& vars,
+                                                              const std::chrono::system_clock::time_point& timestamp) {
+    return serialize_changed_variables(n.uuid(), vars, timestamp);
+}
+
+inline tagged_detached_flatbuffer serialize_changed_variables(const node_id& id, const mobsya::variables_map& vars) {
     flatbuffers::FlatBufferBuilder fb;
-    auto idOffset = n.uuid().fb(fb);
+    auto idOffset = id.fb(fb);
     auto varsOffset = detail::serialize_variables(fb, vars);
     auto offset = fb::CreateVariablesChanged(fb, idOffset, varsOffset);
     return wrap_fb(fb, offset);
 }
 
+inline tagged_detached_flatbuffer serialize_changed_variables(const mobsya::group& n,
+                                                              const mobsya::variables_map& vars) {
+    return serialize_changed_variables(n.uuid(), vars);
+}
+
 inline tagged_detached_flatbuffer serialize_events(const mobsya::aseba_node& n, const mobsya::variables_map& vars,
                                                    const std::chrono::system_clock::time_point& timestamp) {
     flatbuffers::FlatBufferBuilder fb;
@@ -156,6 +211,18 @@ inline tagged_detached_flatbuffer serialize_events(const mobsya::aseba_node& n,
     return wrap_fb(fb, offset);
 }
 
+inline shared_node_values_update make_variables_update(const mobsya::aseba_node& n, variables_snapshot&& vars,
+                                                       const std::chrono::system_clock::time_point& timestamp) {
+    auto message = serialize_changed_variables(n.uuid(), vars, timestamp);
+    return std::make_shared<node_values_update>(node_values_update{std::move(vars), timestamp, std::move(message)});
+}
+
+inline shared_node_values_update make_events_update(const mobsya::aseba_node& n, const variables_map& events,
+                                                    const std::chrono::system_clock::time_point& timestamp) {
+    auto message = serialize_events(n, events, timestamp);
+    return std::make_shared<node_values_update>(node_values_update{{}, timestamp, std::move(message)});
+}
+
 inline tagged_detached_flatbuffer serialize_events_descriptions(const mobsya::group& n,
                                                                 const mobsya::events_table& descs) {
     flatbuffers::FlatBufferBuilder fb;
@@ -264,6 +331,20 @@ inline mobsya::events_table events_description(const fb::RegisterEvents& msg) {
 }
 
 
+inline aseba_node::variables_watch variables_watch(const fb::WatchNode& msg) {
+    aseba_node::variables_watch watch;
+    // the node bounds the interval
+    if(msg.variables_update_rate() > 0)
+        watch.interval = std::chrono::milliseconds(long(std::min(1000.f / msg.variables_update_rate(), 3600000.f)));
+    if(msg.variables()) {
+        for(auto&& name : *msg.variables()) {
+            if(name)
+                watch.variables.push_back(name->str());
+        }
+    }
+    return watch;
+}
+
 inline std::vector<mobsya::breakpoint> breakpoints(const fb::SetBreakpoints& msg) {
     if(!msg.breakpoints())
         return {};
@@ -100,7 +100,7 @@ void firmware_update_service::update_nodes_versions(mobsya::aseba_node::node_typ
             if(type != node_type)
                 continue;
             if(n->firwmware_version() != it->second)
-                boost::asio::post([n, v = it->second] { n->set_available_firmware_version(v); });
+                boost::asio::post(registery.strand(), [n, v = it->second] { n->set_available_firmware_version(v); });
         }
     }
     auto pit = m_waiting.find(type);
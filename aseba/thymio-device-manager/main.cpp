@@ -5,6 +5,8 @@
 #include <boost/thread.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <errno.h>
+#include <algorithm>
+#include <iostream>
 #include "log.h"
 #include "interfaces.h"
 #include "aseba_node_registery.h"
@@ -27,7 +29,7 @@
 
 static const auto lock_file_path = boost::filesystem::temp_directory_path() / "mobsya-tdm-0accdcbf-eeb2";
 
-void run_service(boost::asio::io_context& ctx) {
+void run_service(boost::asio::io_context& ctx, unsigned threads) {
 
     // Gather a list of local ips so that we can detect connections from
     // the same machine.
@@ -75,11 +77,20 @@ void run_service(boost::asio::io_context& ctx) {
 #endif
     aseba_tcp_acceptor.accept();
 
+    // The devices are handled on the single strand of the registery, because nodes of different endpoints
+    // share groups and are used directly by the applications endpoints. Additional threads serve the
+    // applications connections concurrently, but do not handle several devices in parallel
+    mLogInfo("Running on {} threads", threads);
+    boost::thread_group pool;
+    for(unsigned i = 1; i < threads; i++) {
+        pool.create_thread([&ctx] { ctx.run(); });
+    }
     ctx.run();
+    pool.join_all();
 }
 
 
-int start() {
+int start(unsigned threads) {
     mLogInfo("Starting...");
     boost::asio::io_context ctx;
     boost::asio::signal_set sig(ctx);
@@ -113,14 +124,37 @@ int start() {
         std::exit(0);
     });
 
-    run_service(ctx);
+    run_service(ctx, threads);
     return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    namespace po = boost::program_options;
+    unsigned threads = 1;
+    po::options_description desc("Options");
+    desc.add_options()("help", "Show this message")(
+        "threads", po::value<unsigned>(&threads)->default_value(1),
+        "Number of threads running the device manager, 0 to use one per core. The robots are all handled on a "
+        "single strand, so additional threads do not speed up the robots: they only serve the applications and "
+        "compile programs concurrently");
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << e.what() << "\n" << desc << "\n";
+        return 1;
+    }
+    if(vm.count("help")) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+    if(threads == 0) {
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+    }
 
     try {
-        return start();
+        return start(threads);
     } catch(boost::system::system_error& e) {
         mLogError("Exception thrown: {}", e.what());
         std::exit(e.code().value());
@@ -2,6 +2,7 @@
 #include "log.h"
 #include "aseba_endpoint.h"
 #include "wireless_configurator_service.h"
+#include "aseba_node_registery.h"
 
 namespace mobsya {
 serial_server::serial_server(boost::asio::io_context& io_service, std::initializer_list<usb_device_identifier> devices)
@@ -44,18 +45,22 @@ void serial_server::register_configurable_dongle(aseba_device&& d) const {
 
 void serial_server::accept() {
     auto session = aseba_endpoint::create_for_serial(m_io_ctx);
-    m_acceptor.accept_async(session->serial(), [session, this](boost::system::error_code ec) {
-        if(ec) {
-            mLogError("system_error: %s", ec.message());
-        }
-        mLogInfo("New Aseba endpoint over USB device connected");
-        usb_serial_port& d = session->serial();
-        if(should_open_for_configuration(d)) {
-            register_configurable_dongle(std::move(*session->device()));
-        } else {
-            create_endpoint(session, d);
-        }
-        accept();
+    // Dongles and endpoints are set up on the strand of the registery
+    auto strand = boost::asio::use_service<aseba_node_registery>(m_io_ctx).strand();
+    m_acceptor.accept_async(session->serial(), [session, this, strand](boost::system::error_code ec) {
+        boost::asio::post(strand, [session, this, ec]() {
+            if(ec) {
+                mLogError("system_error: %s", ec.message());
+            }
+            mLogInfo("New Aseba endpoint over USB device connected");
+            usb_serial_port& d = session->serial();
+            if(should_open_for_configuration(d)) {
+                register_configurable_dongle(std::move(*session->device()));
+            } else {
+                create_endpoint(session, d);
+            }
+            accept();
+        });
     });
 }
 
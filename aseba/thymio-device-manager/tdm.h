@@ -1,7 +1,20 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
 
 namespace mobsya::tdm {
 constexpr const unsigned protocolVersion = 1;
 constexpr const unsigned minProtocolVersion = 1;
 constexpr const unsigned maxAppEndPointMessageSize = 102400;  // 100k ought to be enough for anyone
+// Bytes queued for an application before its updates get merged or dropped
+constexpr const std::size_t maxAppEndPointQueueSize = 4 * 1024 * 1024;
+// Time an application can stay over its queue budget before being disconnected
+constexpr const std::chrono::seconds maxAppEndPointQueueLag{30};
+// Compilation results kept for programs compiled again
+constexpr const std::size_t maxCompilationCacheEntries = 64;
+// Polling of the variables of watched nodes: default and fastest intervals,
+// slowest one reached by backing off when the variables do not change or the link is saturated
+constexpr const std::chrono::milliseconds defaultVariablesUpdateInterval{100};
+constexpr const std::chrono::milliseconds minVariablesUpdateInterval{20};
+constexpr const std::chrono::milliseconds maxVariablesUpdateInterval{1000};
 }  // namespace mobsya::tdm
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/range/iterator_range.hpp>
+#include "aseba_property.h"
+
+namespace mobsya {
+using variables_map = std::unordered_map<std::string, property>;
+
+/*
+ * Values of some variables of a node, as the words read from its memory.
+ * All the values share a single buffer, they are only converted to properties by the consumers which need them.
+ * A variable without any word is null, which notifies that the variable was removed.
+ */
+class variables_snapshot {
+public:
+    using words = boost::iterator_range<std::vector<int16_t>::const_iterator>;
+
+    void add(std::string name, const int16_t* first, std::size_t size) {
+        m_variables.push_back({std::move(name), m_words.size(), size});
+        m_words.insert(m_words.end(), first, first + size);
+    }
+
+    void add_null(std::string name) {
+        m_variables.push_back({std::move(name), m_words.size(), 0});
+    }
+
+    bool empty() const {
+        return m_variables.empty();
+    }
+
+    std::size_t size() const {
+        return m_variables.size();
+    }
+
+    // Call f(name, words) for each variable
+    template <typename F>
+    void for_each(F&& f) const {
+        for(const auto& v : m_variables) {
+            f(v.name, words(m_words.begin() + v.offset, m_words.begin() + v.offset + v.size));
+        }
+    }
+
+    variables_map to_variables_map() const {
+        variables_map map;
+        map.reserve(m_variables.size());
+        for_each([&map](const std::string& name, const words& values) {
+            map.insert_or_assign(name, detail::aseba_variable_from_range(values));
+        });
+        return map;
+    }
+
+private:
+    struct variable {
+        std::string name;
+        std::size_t offset;
+        std::size_t size;
+    };
+    std::vector<variable> m_variables;
+    std::vector<int16_t> m_words;
+};
+
+}  // namespace mobsya
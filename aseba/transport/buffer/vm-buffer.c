@@ -24,8 +24,17 @@
 #include <string.h>
 #include <assert.h>
 
+// Hosted builds may run several VMs in parallel, each thread then builds its messages in its own buffer
+#if defined(ASEBA_VM_BUFFER_THREAD_LOCAL) && defined(__GNUC__)
+static __thread unsigned char buffer[ASEBA_MAX_INNER_PACKET_SIZE];
+static __thread unsigned buffer_pos;
+#elif defined(ASEBA_VM_BUFFER_THREAD_LOCAL) && defined(_MSC_VER)
+static __declspec(thread) unsigned char buffer[ASEBA_MAX_INNER_PACKET_SIZE];
+static __declspec(thread) unsigned buffer_pos;
+#else
 static unsigned char buffer[ASEBA_MAX_INNER_PACKET_SIZE];
 static unsigned buffer_pos;
+#endif
 
 static void buffer_add(const uint8_t* data, const uint16_t len) {
     uint16_t i = 0;
@@ -120,6 +129,12 @@ void AsebaSendVariables(AsebaVMState* vm, uint16_t start, uint16_t length) {
 #endif
 }
 
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+static int is_block_dirty(const AsebaVMState* vm, uint16_t block) {
+    return (vm->variablesDirty[block >> 4] >> (block & 15)) & 1;
+}
+#endif
+
 void AsebaSendChangedVariables(AsebaVMState* vm) {
 
    /*
@@ -145,6 +160,18 @@ void AsebaSendChangedVariables(AsebaVMState* vm) {
 
         int at_end = idx == vm->variablesSize;
 
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+        // blocks not written since the last call are unchanged; once no range nor packet is left to close,
+        // going through their variables would not change the output, so skip them
+        if(vm->variablesDirty && !at_end && has_header && !has_modified && buffer_pos < MAX_PACKET_SIZE &&
+           idx % ASEBA_VM_DIRTY_BLOCK_SIZE == 0 && !is_block_dirty(vm, idx / ASEBA_VM_DIRTY_BLOCK_SIZE)) {
+            idx += ASEBA_VM_DIRTY_BLOCK_SIZE - 1;
+            if(idx >= vm->variablesSize)
+                idx = vm->variablesSize - 1;
+            continue;
+        }
+#endif
+
         if(!has_header) {
             if(buffer_pos == 0)
                 buffer_add_uint16(ASEBA_MESSAGE_CHANGED_VARIABLES);
@@ -185,6 +212,12 @@ void AsebaSendChangedVariables(AsebaVMState* vm) {
         }
     }
     buffer_pos = 0;
+
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    // variablesOld is now equal to variables
+    if(vm->variablesOld && vm->variablesDirty)
+        memset(vm->variablesDirty, 0, ASEBA_VM_DIRTY_WORDS(vm->variablesSize) * sizeof(uint16_t));
+#endif
 }
 
 static void AsebaSendDescriptionHead(AsebaVMState* vm) {
@@ -308,14 +341,19 @@ void AsebaSendDescription(AsebaVMState* vm) {
 
 void AsebaProcessIncomingEvents(AsebaVMState* vm) {
     uint16_t source;
-    const AsebaVMDescription* desc = AsebaGetVMDescription(vm);
-
     uint16_t amount = AsebaGetBuffer(vm, buffer, ASEBA_MAX_INNER_PACKET_SIZE, &source);
 
-    if(amount > 0) {
-        uint16_t type = bswap16(((uint16_t*)buffer)[0]);
-        uint16_t* payload = (uint16_t*)(buffer + 2);
-        uint16_t payloadSize = (amount - 2) / 2;
+    if(amount > 0)
+        AsebaProcessIncomingBuffer(vm, buffer, amount, source);
+}
+
+void AsebaProcessIncomingBuffer(AsebaVMState* vm, const uint8_t* data, uint16_t length, uint16_t source) {
+    const AsebaVMDescription* desc = AsebaGetVMDescription(vm);
+
+    if(length >= 2) {
+        uint16_t type = bswap16(((const uint16_t*)data)[0]);
+        uint16_t* payload = (uint16_t*)(data + 2);
+        uint16_t payloadSize = (length - 2) / 2;
         if(type < 0x8000) {
             // user message, only process if we are not stepping inside an event
             if(AsebaMaskIsClear(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK) ||
@@ -328,6 +366,7 @@ void AsebaProcessIncomingEvents(AsebaVMState* vm) {
                 vm->variables[argPos++] = source;
                 for(i = 0; (i < argsSize) && (i < payloadSize); i++)
                     vm->variables[argPos + i] = bswap16(payload[i]);
+                AsebaVMSetVariablesDirty(vm, argPos - 1, i + 1);
                 AsebaVMSetupEvent(vm, type);
             }
         } else {
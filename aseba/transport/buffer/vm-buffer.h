@@ -58,6 +58,11 @@ extern "C" {
 /*! Read messages and process messages from transport layer, if any */
 void AsebaProcessIncomingEvents(AsebaVMState* vm);
 
+/*! Process a message already in memory, as given to AsebaSendBuffer: its type followed by its payload.
+    Transport layers running in the same process as the VM can use it instead of providing AsebaGetBuffer.
+    data must be aligned on 2 bytes and is not modified, although debug messages access it as uint16_t*. */
+void AsebaProcessIncomingBuffer(AsebaVMState* vm, const uint8_t* data, uint16_t length, uint16_t source);
+
 // functions this helper needs
 
 extern void AsebaSendBuffer(AsebaVMState* vm, const uint8_t* data, uint16_t length);
@@ -21,6 +21,9 @@
 #include "common/consts.h"
 #include "common/types.h"
 #include "natives.h"
+#ifdef ASEBA_VM_SIMD
+#    include "natives_simd.h"
+#endif
 #include <string.h>
 
 #include <assert.h>
@@ -285,6 +288,169 @@ void aseba_comb_sort(int16_t* input, uint16_t size) {
 }
 
 
+#ifdef ASEBA_VM_INTROSORT
+// compare-exchange used by the sorting networks, written so that compilers emit conditional moves
+#    define ASEBA_SORT_EXCHANGE(i, j)          \
+        do {                                   \
+            const int16_t a = input[i];        \
+            const int16_t b = input[j];        \
+            input[i] = a < b ? a : b;          \
+            input[j] = a < b ? b : a;          \
+        } while(0)
+
+// largest arrays sorted by a sorting network, and by insertion sort
+#    define ASEBA_SORT_NETWORK_MAX 8
+#    define ASEBA_SORT_INSERTION_MAX 16
+
+// sort up to ASEBA_SORT_NETWORK_MAX elements with optimal sorting networks (Batcher's odd-even merge sort)
+static void aseba_network_sort(int16_t* input, uint16_t size) {
+    switch(size) {
+        // clang-format off
+        case 8:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(2, 3); ASEBA_SORT_EXCHANGE(4, 5); ASEBA_SORT_EXCHANGE(6, 7);
+            ASEBA_SORT_EXCHANGE(0, 2); ASEBA_SORT_EXCHANGE(1, 3); ASEBA_SORT_EXCHANGE(4, 6); ASEBA_SORT_EXCHANGE(5, 7);
+            ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(5, 6); ASEBA_SORT_EXCHANGE(0, 4); ASEBA_SORT_EXCHANGE(1, 5);
+            ASEBA_SORT_EXCHANGE(2, 6); ASEBA_SORT_EXCHANGE(3, 7); ASEBA_SORT_EXCHANGE(2, 4); ASEBA_SORT_EXCHANGE(3, 5);
+            ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(3, 4); ASEBA_SORT_EXCHANGE(5, 6);
+            break;
+        case 7:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(2, 3); ASEBA_SORT_EXCHANGE(4, 5); ASEBA_SORT_EXCHANGE(0, 2);
+            ASEBA_SORT_EXCHANGE(1, 3); ASEBA_SORT_EXCHANGE(4, 6); ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(5, 6);
+            ASEBA_SORT_EXCHANGE(0, 4); ASEBA_SORT_EXCHANGE(1, 5); ASEBA_SORT_EXCHANGE(2, 6); ASEBA_SORT_EXCHANGE(2, 4);
+            ASEBA_SORT_EXCHANGE(3, 5); ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(3, 4); ASEBA_SORT_EXCHANGE(5, 6);
+            break;
+        case 6:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(2, 3); ASEBA_SORT_EXCHANGE(4, 5); ASEBA_SORT_EXCHANGE(0, 2);
+            ASEBA_SORT_EXCHANGE(1, 3); ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(0, 4); ASEBA_SORT_EXCHANGE(1, 5);
+            ASEBA_SORT_EXCHANGE(2, 4); ASEBA_SORT_EXCHANGE(3, 5); ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(3, 4);
+            break;
+        case 5:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(2, 3); ASEBA_SORT_EXCHANGE(0, 2); ASEBA_SORT_EXCHANGE(1, 3);
+            ASEBA_SORT_EXCHANGE(1, 2); ASEBA_SORT_EXCHANGE(0, 4); ASEBA_SORT_EXCHANGE(2, 4); ASEBA_SORT_EXCHANGE(1, 2);
+            ASEBA_SORT_EXCHANGE(3, 4);
+            break;
+        case 4:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(2, 3); ASEBA_SORT_EXCHANGE(0, 2); ASEBA_SORT_EXCHANGE(1, 3);
+            ASEBA_SORT_EXCHANGE(1, 2);
+            break;
+        case 3:
+            ASEBA_SORT_EXCHANGE(0, 1); ASEBA_SORT_EXCHANGE(0, 2); ASEBA_SORT_EXCHANGE(1, 2);
+            break;
+        case 2:
+            ASEBA_SORT_EXCHANGE(0, 1);
+            break;
+        // clang-format on
+        default: break;
+    }
+}
+
+// move element i down the heap of size elements
+static void aseba_heap_sift_down(int16_t* input, uint16_t i, uint16_t size) {
+    const int16_t value = input[i];
+    uint32_t child;
+    while((child = 2 * (uint32_t)i + 1) < size) {
+        if(child + 1 < size && input[child + 1] > input[child])
+            child++;
+        if(input[child] <= value)
+            break;
+        input[i] = input[child];
+        i = (uint16_t)child;
+    }
+    input[i] = value;
+}
+
+// heap sort, the fallback of introsort on adversarial inputs
+static void aseba_heap_sort(int16_t* input, uint16_t size) {
+    uint16_t i;
+    for(i = size / 2; i > 0; i--)
+        aseba_heap_sift_down(input, i - 1, size);
+    for(i = size - 1; i > 0; i--) {
+        const int16_t max = input[0];
+        input[0] = input[i];
+        input[i] = max;
+        aseba_heap_sift_down(input, 0, i);
+    }
+}
+
+// insertion sort, for partitions a bit too large for the networks but too small to be worth partitioning
+static void aseba_insertion_sort(int16_t* input, uint16_t size) {
+    uint16_t i, j;
+    for(i = 1; i < size; i++) {
+        const int16_t value = input[i];
+        for(j = i; j > 0 && input[j - 1] > value; j--)
+            input[j] = input[j - 1];
+        input[j] = value;
+    }
+}
+
+static void aseba_intro_sort_loop(int16_t* input, uint16_t size, uint16_t depth) {
+    while(size > ASEBA_SORT_INSERTION_MAX) {
+        uint16_t i = 0;
+        uint16_t j = size - 1;
+        int16_t pivot;
+
+        if(depth == 0) {
+            aseba_heap_sort(input, size);
+            return;
+        }
+        depth--;
+
+        // median of three, which also places sentinels at both ends for the partition loops
+        ASEBA_SORT_EXCHANGE(0, size / 2);
+        ASEBA_SORT_EXCHANGE(0, size - 1);
+        ASEBA_SORT_EXCHANGE(size / 2, size - 1);
+        pivot = input[size / 2];
+
+        // Hoare partition: [0, i) <= pivot <= [i, size), both parts non-empty
+        for(;;) {
+            while(input[++i] < pivot)
+                ;
+            while(input[--j] > pivot)
+                ;
+            if(i >= j)
+                break;
+            {
+                const int16_t swap = input[i];
+                input[i] = input[j];
+                input[j] = swap;
+            }
+        }
+
+        // recurse on the smaller part and iterate on the larger one, to bound the stack depth
+        if(i < size - i) {
+            aseba_intro_sort_loop(input, i, depth);
+            input += i;
+            size -= i;
+        } else {
+            aseba_intro_sort_loop(input + i, size - i, depth);
+            size = i;
+        }
+    }
+    if(size > ASEBA_SORT_NETWORK_MAX)
+        aseba_insertion_sort(input, size);
+    else
+        aseba_network_sort(input, size);
+}
+
+// introsort: quicksort falling back to heap sort when recursion gets too deep, with sorting networks for small arrays
+void aseba_intro_sort(int16_t* input, uint16_t size) {
+    uint16_t depth = 0;
+    uint16_t n;
+    for(n = size; n > 1; n >>= 1)
+        depth += 2;
+    aseba_intro_sort_loop(input, size, depth);
+}
+#endif  // ASEBA_VM_INTROSORT
+
+#ifdef ASEBA_VM_SIMD
+// whether a vectorized kernel can write dest while reading src: in-place and backward-overlapping
+// operations are fine, but a dest starting within src would feed the scalar loop with values it just wrote
+static int aseba_vector_kernel_usable(uint16_t dest, uint16_t src, uint16_t length) {
+    return dest <= src || dest >= (uint32_t)src + length;
+}
+#endif
+
+
 // standard natives functions
 
 void AsebaNative_veccopy(AsebaVMState* vm) {
@@ -297,6 +463,7 @@ void AsebaNative_veccopy(AsebaVMState* vm) {
 
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, dest, length);
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[src++];
     }
@@ -317,6 +484,7 @@ void AsebaNative_vecfill(AsebaVMState* vm) {
 
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, dest, length);
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[value];
     }
@@ -338,6 +506,7 @@ void AsebaNative_vecaddscalar(AsebaVMState* vm) {
 
     const int16_t scalarValue = vm->variables[scalar];
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, dest, length);
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[src++] + scalarValue;
     }
@@ -359,6 +528,16 @@ void AsebaNative_vecadd(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src1, length) && aseba_vector_kernel_usable(dest, src2, length)) {
+        AsebaGetVectorKernels()->add(&vm->variables[dest], &vm->variables[src1], &vm->variables[src2], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[src1++] + vm->variables[src2++];
     }
@@ -380,6 +559,16 @@ void AsebaNative_vecsub(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src1, length) && aseba_vector_kernel_usable(dest, src2, length)) {
+        AsebaGetVectorKernels()->sub(&vm->variables[dest], &vm->variables[src1], &vm->variables[src2], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[src1++] - vm->variables[src2++];
     }
@@ -401,6 +590,16 @@ void AsebaNative_vecmul(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src1, length) && aseba_vector_kernel_usable(dest, src2, length)) {
+        AsebaGetVectorKernels()->mul(&vm->variables[dest], &vm->variables[src1], &vm->variables[src2], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         vm->variables[dest++] = vm->variables[src1++] * vm->variables[src2++];
     }
@@ -422,6 +621,7 @@ void AsebaNative_vecdiv(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, dest, length);
     for(i = 0; i < length; i++) {
         int32_t dividend = (int32_t)vm->variables[src1++];
         int32_t divisor = (int32_t)vm->variables[src2++];
@@ -452,6 +652,16 @@ void AsebaNative_vecmin(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src1, length) && aseba_vector_kernel_usable(dest, src2, length)) {
+        AsebaGetVectorKernels()->min(&vm->variables[dest], &vm->variables[src1], &vm->variables[src2], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         int16_t v1 = vm->variables[src1++];
         int16_t v2 = vm->variables[src2++];
@@ -476,6 +686,16 @@ void AsebaNative_vecmax(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src1, length) && aseba_vector_kernel_usable(dest, src2, length)) {
+        AsebaGetVectorKernels()->max(&vm->variables[dest], &vm->variables[src1], &vm->variables[src2], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         int16_t v1 = vm->variables[src1++];
         int16_t v2 = vm->variables[src2++];
@@ -500,6 +720,18 @@ void AsebaNative_vecclamp(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+
+    AsebaVMSetVariablesDirty(vm, dest, length);
+
+#ifdef ASEBA_VM_SIMD
+    if(aseba_vector_kernel_usable(dest, src, length) && aseba_vector_kernel_usable(dest, low, length) &&
+       aseba_vector_kernel_usable(dest, high, length)) {
+        AsebaGetVectorKernels()->clamp(&vm->variables[dest], &vm->variables[src], &vm->variables[low],
+                                       &vm->variables[high], length);
+        return;
+    }
+#endif
+
     for(i = 0; i < length; i++) {
         int16_t v = vm->variables[src++];
         int16_t l = vm->variables[low++];
@@ -526,6 +758,8 @@ void AsebaNative_vecdot(AsebaVMState* vm) {
     int32_t res = 0;
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, dest, 1);
+
     if(shift > 32) {
         vm->variables[dest] = 0;
         return;
@@ -564,6 +798,11 @@ void AsebaNative_vecdot(AsebaVMState* vm) {
         res += __builtin_mulss(vm->variables[src1++], vm->variables[src2++]);
     res >>= shift;
     vm->variables[dest] = (int16_t)res;
+#elif defined(ASEBA_VM_SIMD)
+    ASEBA_UNUSED(i);
+    res = AsebaGetVectorKernels()->dot(&vm->variables[src1], &vm->variables[src2], length);
+    res >>= shift;
+    vm->variables[dest] = (int16_t)res;
 #else
     for(i = 0; i < length; i++) {
         res += (int32_t)vm->variables[src1++] * (int32_t)vm->variables[src2++];
@@ -592,6 +831,23 @@ void AsebaNative_vecstat(AsebaVMState* vm) {
     int32_t acc;
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, min, 1);
+    AsebaVMSetVariablesDirty(vm, max, 1);
+    AsebaVMSetVariablesDirty(vm, mean, 1);
+
+#ifdef ASEBA_VM_SIMD
+    // the scalar loop compares with the current min and max, so keep it if they alias src or each other
+    if(length && min != max && !(min >= src && min < (uint32_t)src + length) &&
+       !(max >= src && max < (uint32_t)src + length)) {
+        int16_t minValue, maxValue;
+        acc = AsebaGetVectorKernels()->stat(&vm->variables[src], length, &minValue, &maxValue);
+        vm->variables[min] = minValue;
+        vm->variables[max] = maxValue;
+        vm->variables[mean] = (int16_t)(acc / (int32_t)length);
+        return;
+    }
+#endif
+
     if(length) {
         val = vm->variables[src++];
         acc = val;
@@ -630,6 +886,23 @@ void AsebaNative_vecargbounds(AsebaVMState* vm) {
     int16_t val;
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, argmin, 1);
+    AsebaVMSetVariablesDirty(vm, argmax, 1);
+
+#ifdef ASEBA_VM_SIMD
+    // the scalar loop only writes an index when the value beats the initial bounds, mimic that
+    if(length && argmin != argmax && !(argmin >= src && argmin < (uint32_t)src + length) &&
+       !(argmax >= src && argmax < (uint32_t)src + length)) {
+        uint16_t minIndex, maxIndex;
+        AsebaGetVectorKernels()->argbounds(&vm->variables[src], length, &minIndex, &maxIndex);
+        if(vm->variables[src + minIndex] < min)
+            vm->variables[argmin] = minIndex;
+        if(vm->variables[src + maxIndex] > max)
+            vm->variables[argmax] = maxIndex;
+        return;
+    }
+#endif
+
     if(length) {
         for(i = 0; i < length; i++) {
             val = vm->variables[src++];
@@ -658,7 +931,13 @@ void AsebaNative_vecsort(AsebaVMState* vm) {
     // variable size
     uint16_t length = AsebaNativePopArg(vm);
 
+    AsebaVMSetVariablesDirty(vm, src, length);
+
+#ifdef ASEBA_VM_INTROSORT
+    aseba_intro_sort(&vm->variables[src], length);
+#else
     aseba_comb_sort(&vm->variables[src], length);
+#endif
 }
 
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecsort = {"math.sort",
@@ -677,6 +956,7 @@ void AsebaNative_mathmuldiv(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         int32_t a = (int32_t)vm->variables[aIndex++];
         int32_t b = (int32_t)vm->variables[bIndex++];
@@ -706,6 +986,7 @@ void AsebaNative_mathatan2(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         int16_t y = vm->variables[yIndex++];
         int16_t x = vm->variables[xIndex++];
@@ -727,6 +1008,7 @@ void AsebaNative_mathsin(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         int16_t x = vm->variables[xIndex++];
         vm->variables[destIndex++] = aseba_sin(x);
@@ -746,6 +1028,7 @@ void AsebaNative_mathcos(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         int16_t x = vm->variables[xIndex++];
         vm->variables[destIndex++] = aseba_cos(x);
@@ -773,6 +1056,7 @@ void AsebaNative_mathrot2(AsebaVMState* vm) {
     int16_t xp = (int16_t)(((int32_t)cos_a * (int32_t)x - (int32_t)sin_a * (int32_t)y) >> (int32_t)15);
     int16_t yp = (int16_t)(((int32_t)cos_a * (int32_t)y + (int32_t)sin_a * (int32_t)x) >> (int32_t)15);
 
+    AsebaVMSetVariablesDirty(vm, vectOutIndex, 2);
     vm->variables[vectOutIndex] = xp;
     vm->variables[vectOutIndex + 1] = yp;
 }
@@ -790,6 +1074,7 @@ void AsebaNative_mathsqrt(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         int16_t x = vm->variables[xIndex++];
         if(x < 0) {
@@ -822,6 +1107,8 @@ void AsebaNative_vecnonzerosequence(AsebaVMState* vm) {
     int16_t bestSeqIndex;
     int16_t seqLength;
 
+    AsebaVMSetVariablesDirty(vm, dest, 1);
+
     // search for a zero, then non-zero
     uint16_t nzFirstIndex = 0;
     while(vm->variables[src + nzFirstIndex] != 0) {
@@ -892,7 +1179,14 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecnonzerosequence =
     "not found or if smaller than minLength",
     {{1, "dest"}, {-1, "src"}, {1, "minLength"}, {0, 0}}};
 
+// Hosted builds may run several VMs in parallel, each thread then keeps its own random state
+#if defined(ASEBA_VM_THREAD_LOCAL_RANDOM) && defined(__GNUC__)
+static __thread uint16_t rnd_state;
+#elif defined(ASEBA_VM_THREAD_LOCAL_RANDOM) && defined(_MSC_VER)
+static __declspec(thread) uint16_t rnd_state;
+#else
 static uint16_t rnd_state;
+#endif
 
 void AsebaSetRandomSeed(uint16_t seed) {
     rnd_state = seed;
@@ -911,6 +1205,7 @@ void AsebaNative_rand(AsebaVMState* vm) {
     uint16_t length = AsebaNativePopArg(vm);
 
     uint16_t i;
+    AsebaVMSetVariablesDirty(vm, destIndex, length);
     for(i = 0; i < length; i++) {
         vm->variables[destIndex++] = (int16_t)AsebaGetRandom();
     }
@@ -977,6 +1272,7 @@ void AsebaNative_deqsize(AsebaVMState* vm) {
     // variable size
     (void)/* uint16_t deque_length = */ AsebaNativePopArg(vm);
 
+    AsebaVMSetVariablesDirty(vm, size, 1);
     vm->variables[size++] = vm->variables[deque++];
 }
 
@@ -1000,6 +1296,7 @@ static void _AsebaNative_deqget(AsebaVMState* vm, uint16_t dest, uint16_t deque,
     // copy elements from deque
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, dest, dest_length);
     for(i = 0; i < dest_length; i++) {
         vm->variables[dest++] = vm->variables[deque + 2 + ((dq_start + index_val + i) % dq_capacity)];
     }
@@ -1056,6 +1353,7 @@ void AsebaNative_deqset(AsebaVMState* vm) {
     // Copy elements into deque
     uint16_t i;
 
+    AsebaVMSetVariablesDirty(vm, deque, deque_length);
     for(i = 0; i < src_length; i++) {
         vm->variables[deque + 2 + ((dq_start + index_val + i) % dq_capacity)] = vm->variables[src++];
     }
@@ -1079,6 +1377,8 @@ static void _AsebaNative_deqinsert(AsebaVMState* vm, uint16_t deque, uint16_t sr
         return;
     }
 
+    AsebaVMSetVariablesDirty(vm, deque, deque_length);
+
     // Insert src elements as a block
     // if in left half, shift prefix elements left
     if(index_val < dq_size / 2) {
@@ -1140,6 +1440,8 @@ static void _AsebaNative_deqerase(AsebaVMState* vm, uint16_t deque, uint16_t ind
         return;
     }
 
+    AsebaVMSetVariablesDirty(vm, deque, deque_length);
+
     // Erase elements as a block
     // if in left half, shift prefix elements right
     if(index_val < dq_size / 2) {
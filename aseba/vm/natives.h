@@ -83,6 +83,14 @@ static inline int16_t AsebaNativePopArg(AsebaVMState* vm) {
     return vm->stack[vm->sp--];
 }
 
+/*! Sort an array in place using comb sort, which is compact enough for microcontrollers */
+void aseba_comb_sort(int16_t* input, uint16_t size);
+
+#ifdef ASEBA_VM_INTROSORT
+/*! Sort an array in place using introsort and sorting networks, faster than comb sort, without allocation */
+void aseba_intro_sort(int16_t* input, uint16_t size);
+#endif
+
 // standard natives functions
 
 /*! Function to copy a vector */
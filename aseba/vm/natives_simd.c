@@ -0,0 +1,525 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Created by Stéphane Magnenat <stephane at magnenat dot net> (http://stephane.magnenat.net)
+    with contributions from the community.
+    Copyright (C) 2007--2018 the authors, see authors.txt for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "natives_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    include <immintrin.h>
+#    define ASEBA_VECTOR_KERNELS_X86
+#    define ASEBA_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#    include <arm_neon.h>
+#    define ASEBA_VECTOR_KERNELS_NEON
+#endif
+
+/**
+    \file natives_simd.c
+    Implementation of the vectorized kernels behind the math natives on hosted builds.
+
+    Vectorized kernels process as many full vectors as possible, in increasing addresses,
+    loading all sources of a vector before storing it, and leave the remaining elements
+    to the scalar kernels. This gives the same results as the scalar loops of natives.c
+    as long as a destination does not start strictly inside one of its sources.
+    The 32-bit sums wrap around exactly as the scalar accumulator does.
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+// portable kernels
+
+static inline void scalar_add(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        dest[i] = src1[i] + src2[i];
+}
+
+static inline void scalar_sub(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        dest[i] = src1[i] - src2[i];
+}
+
+static inline void scalar_mul(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        dest[i] = src1[i] * src2[i];
+}
+
+static inline void scalar_min(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        dest[i] = src1[i] < src2[i] ? src1[i] : src2[i];
+}
+
+static inline void scalar_max(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        dest[i] = src1[i] > src2[i] ? src1[i] : src2[i];
+}
+
+static inline void scalar_clamp(int16_t* dest, const int16_t* src, const int16_t* low, const int16_t* high, uint16_t length) {
+    uint16_t i;
+    for(i = 0; i < length; i++) {
+        const int16_t v = src[i];
+        const int16_t l = low[i];
+        const int16_t h = high[i];
+        dest[i] = v > h ? h : (v < l ? l : v);
+    }
+}
+
+static inline int32_t scalar_dot(const int16_t* src1, const int16_t* src2, uint16_t length) {
+    // accumulate unsigned to get a well-defined wrap-around
+    uint32_t res = 0;
+    uint16_t i;
+    for(i = 0; i < length; i++)
+        res += (uint32_t)((int32_t)src1[i] * (int32_t)src2[i]);
+    return (int32_t)res;
+}
+
+static inline int32_t scalar_stat(const int16_t* src, uint16_t length, int16_t* min, int16_t* max) {
+    int16_t vmin = src[0];
+    int16_t vmax = src[0];
+    int32_t acc = src[0];
+    uint16_t i;
+    for(i = 1; i < length; i++) {
+        const int16_t v = src[i];
+        if(v < vmin)
+            vmin = v;
+        if(v > vmax)
+            vmax = v;
+        acc += v;
+    }
+    *min = vmin;
+    *max = vmax;
+    return acc;
+}
+
+static inline void scalar_argbounds(const int16_t* src, uint16_t length, uint16_t* argmin, uint16_t* argmax) {
+    uint16_t imin = 0;
+    uint16_t imax = 0;
+    uint16_t i;
+    for(i = 1; i < length; i++) {
+        if(src[i] < src[imin])
+            imin = i;
+        if(src[i] > src[imax])
+            imax = i;
+    }
+    *argmin = imin;
+    *argmax = imax;
+}
+
+const AsebaVectorKernels AsebaScalarVectorKernels = {
+    "scalar",
+    scalar_add,
+    scalar_sub,
+    scalar_mul,
+    scalar_min,
+    scalar_max,
+    scalar_clamp,
+    scalar_dot,
+    scalar_stat,
+    scalar_argbounds};
+
+// return the index of the first element of src equal to value, which must be present
+static inline uint16_t scalar_find(const int16_t* src, int16_t value) {
+    uint16_t i = 0;
+    while(src[i] != value)
+        i++;
+    return i;
+}
+
+#ifdef ASEBA_VECTOR_KERNELS_X86
+
+// SSE2, 8 elements per vector
+
+// horizontal minimum, maximum and sum of vectors
+static inline ASEBA_TARGET("sse2") int16_t sse2_hmin(__m128i v) {
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static inline ASEBA_TARGET("sse2") int16_t sse2_hmax(__m128i v) {
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static inline ASEBA_TARGET("sse2") uint32_t sse2_hsum(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+// sign-extend the 16-bit elements of v to 32 bits and add them to acc
+static inline ASEBA_TARGET("sse2") __m128i sse2_accumulate(__m128i acc, __m128i v) {
+    acc = _mm_add_epi32(acc, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    return _mm_add_epi32(acc, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+#    define ASEBA_SSE2_BINARY_KERNEL(name, intrinsic)                                                                  \
+        static ASEBA_TARGET("sse2") void sse2_##name(int16_t* dest, const int16_t* src1, const int16_t* src2,         \
+                                                     uint16_t length) {                                               \
+            unsigned i = 0;                                                                                            \
+            for(; i + 8 <= length; i += 8) {                                                                           \
+                const __m128i a = _mm_loadu_si128((const __m128i*)(src1 + i));                                         \
+                const __m128i b = _mm_loadu_si128((const __m128i*)(src2 + i));                                         \
+                _mm_storeu_si128((__m128i*)(dest + i), intrinsic(a, b));                                               \
+            }                                                                                                          \
+            scalar_##name(dest + i, src1 + i, src2 + i, length - i);                                                   \
+        }
+
+ASEBA_SSE2_BINARY_KERNEL(add, _mm_add_epi16)
+ASEBA_SSE2_BINARY_KERNEL(sub, _mm_sub_epi16)
+ASEBA_SSE2_BINARY_KERNEL(mul, _mm_mullo_epi16)
+ASEBA_SSE2_BINARY_KERNEL(min, _mm_min_epi16)
+ASEBA_SSE2_BINARY_KERNEL(max, _mm_max_epi16)
+
+static ASEBA_TARGET("sse2") void sse2_clamp(int16_t* dest, const int16_t* src, const int16_t* low,
+                                            const int16_t* high, uint16_t length) {
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i l = _mm_loadu_si128((const __m128i*)(low + i));
+        const __m128i h = _mm_loadu_si128((const __m128i*)(high + i));
+        // test high before low, as the scalar version does, to match it when bounds are inverted
+        const __m128i above = _mm_cmpgt_epi16(v, h);
+        const __m128i res = _mm_or_si128(_mm_and_si128(above, h), _mm_andnot_si128(above, _mm_max_epi16(v, l)));
+        _mm_storeu_si128((__m128i*)(dest + i), res);
+    }
+    scalar_clamp(dest + i, src + i, low + i, high + i, length - i);
+}
+
+static ASEBA_TARGET("sse2") int32_t sse2_dot(const int16_t* src1, const int16_t* src2, uint16_t length) {
+    __m128i acc = _mm_setzero_si128();
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src1 + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(src2 + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+    }
+    return (int32_t)(sse2_hsum(acc) + (uint32_t)scalar_dot(src1 + i, src2 + i, length - i));
+}
+
+static ASEBA_TARGET("sse2") int32_t sse2_stat(const int16_t* src, uint16_t length, int16_t* min, int16_t* max) {
+    __m128i vmin, vmax, acc;
+    int16_t smin, smax;
+    uint32_t sum;
+    unsigned i = 8;
+    if(length < 8)
+        return scalar_stat(src, length, min, max);
+    vmin = vmax = _mm_loadu_si128((const __m128i*)src);
+    acc = sse2_accumulate(_mm_setzero_si128(), vmin);
+    for(; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+        acc = sse2_accumulate(acc, v);
+    }
+    smin = sse2_hmin(vmin);
+    smax = sse2_hmax(vmax);
+    sum = sse2_hsum(acc);
+    for(; i < length; i++) {
+        if(src[i] < smin)
+            smin = src[i];
+        if(src[i] > smax)
+            smax = src[i];
+        sum += (uint32_t)src[i];
+    }
+    *min = smin;
+    *max = smax;
+    return (int32_t)sum;
+}
+
+static ASEBA_TARGET("sse2") uint16_t sse2_find(const int16_t* src, uint16_t length, int16_t value) {
+    const __m128i target = _mm_set1_epi16(value);
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(v, target)))
+            break;
+    }
+    return i + scalar_find(src + i, value);
+}
+
+static ASEBA_TARGET("sse2") void sse2_argbounds(const int16_t* src, uint16_t length, uint16_t* argmin,
+                                                uint16_t* argmax) {
+    int16_t min, max;
+    sse2_stat(src, length, &min, &max);
+    *argmin = sse2_find(src, length, min);
+    *argmax = sse2_find(src, length, max);
+}
+
+static const AsebaVectorKernels sse2VectorKernels = {
+    "SSE2",
+    sse2_add,
+    sse2_sub,
+    sse2_mul,
+    sse2_min,
+    sse2_max,
+    sse2_clamp,
+    sse2_dot,
+    sse2_stat,
+    sse2_argbounds};
+
+// AVX2, 16 elements per vector
+
+#    define ASEBA_AVX2_BINARY_KERNEL(name, intrinsic)                                                                  \
+        static ASEBA_TARGET("avx2") void avx2_##name(int16_t* dest, const int16_t* src1, const int16_t* src2,         \
+                                                     uint16_t length) {                                               \
+            unsigned i = 0;                                                                                            \
+            for(; i + 16 <= length; i += 16) {                                                                         \
+                const __m256i a = _mm256_loadu_si256((const __m256i*)(src1 + i));                                      \
+                const __m256i b = _mm256_loadu_si256((const __m256i*)(src2 + i));                                      \
+                _mm256_storeu_si256((__m256i*)(dest + i), intrinsic(a, b));                                            \
+            }                                                                                                          \
+            scalar_##name(dest + i, src1 + i, src2 + i, length - i);                                                   \
+        }
+
+ASEBA_AVX2_BINARY_KERNEL(add, _mm256_add_epi16)
+ASEBA_AVX2_BINARY_KERNEL(sub, _mm256_sub_epi16)
+ASEBA_AVX2_BINARY_KERNEL(mul, _mm256_mullo_epi16)
+ASEBA_AVX2_BINARY_KERNEL(min, _mm256_min_epi16)
+ASEBA_AVX2_BINARY_KERNEL(max, _mm256_max_epi16)
+
+static ASEBA_TARGET("avx2") void avx2_clamp(int16_t* dest, const int16_t* src, const int16_t* low,
+                                            const int16_t* high, uint16_t length) {
+    unsigned i = 0;
+    for(; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i l = _mm256_loadu_si256((const __m256i*)(low + i));
+        const __m256i h = _mm256_loadu_si256((const __m256i*)(high + i));
+        const __m256i above = _mm256_cmpgt_epi16(v, h);
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_blendv_epi8(_mm256_max_epi16(v, l), h, above));
+    }
+    scalar_clamp(dest + i, src + i, low + i, high + i, length - i);
+}
+
+static ASEBA_TARGET("avx2") int32_t avx2_dot(const int16_t* src1, const int16_t* src2, uint16_t length) {
+    __m256i acc = _mm256_setzero_si256();
+    unsigned i = 0;
+    for(; i + 16 <= length; i += 16) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(src1 + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(src2 + i));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a, b));
+    }
+    return (int32_t)(sse2_hsum(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1))) +
+                     (uint32_t)scalar_dot(src1 + i, src2 + i, length - i));
+}
+
+static ASEBA_TARGET("avx2") int32_t avx2_stat(const int16_t* src, uint16_t length, int16_t* min, int16_t* max) {
+    __m256i vmin, vmax, acc;
+    int16_t smin, smax;
+    uint32_t sum;
+    unsigned i = 16;
+    if(length < 16)
+        return scalar_stat(src, length, min, max);
+    vmin = vmax = _mm256_loadu_si256((const __m256i*)src);
+    acc = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(vmin));
+    acc = _mm256_add_epi32(acc, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(vmin, 1)));
+    for(; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        vmin = _mm256_min_epi16(vmin, v);
+        vmax = _mm256_max_epi16(vmax, v);
+        acc = _mm256_add_epi32(acc, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        acc = _mm256_add_epi32(acc, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    }
+    smin = sse2_hmin(_mm_min_epi16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1)));
+    smax = sse2_hmax(_mm_max_epi16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1)));
+    sum = sse2_hsum(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    for(; i < length; i++) {
+        if(src[i] < smin)
+            smin = src[i];
+        if(src[i] > smax)
+            smax = src[i];
+        sum += (uint32_t)src[i];
+    }
+    *min = smin;
+    *max = smax;
+    return (int32_t)sum;
+}
+
+static ASEBA_TARGET("avx2") uint16_t avx2_find(const int16_t* src, uint16_t length, int16_t value) {
+    const __m256i target = _mm256_set1_epi16(value);
+    unsigned i = 0;
+    for(; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, target)))
+            break;
+    }
+    return i + scalar_find(src + i, value);
+}
+
+static ASEBA_TARGET("avx2") void avx2_argbounds(const int16_t* src, uint16_t length, uint16_t* argmin,
+                                                uint16_t* argmax) {
+    int16_t min, max;
+    avx2_stat(src, length, &min, &max);
+    *argmin = avx2_find(src, length, min);
+    *argmax = avx2_find(src, length, max);
+}
+
+static const AsebaVectorKernels avx2VectorKernels = {
+    "AVX2",
+    avx2_add,
+    avx2_sub,
+    avx2_mul,
+    avx2_min,
+    avx2_max,
+    avx2_clamp,
+    avx2_dot,
+    avx2_stat,
+    avx2_argbounds};
+
+#endif  // ASEBA_VECTOR_KERNELS_X86
+
+#ifdef ASEBA_VECTOR_KERNELS_NEON
+
+// NEON, 8 elements per vector; always present on AArch64
+
+#    define ASEBA_NEON_BINARY_KERNEL(name, intrinsic)                                                                  \
+        static void neon_##name(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length) {            \
+            unsigned i = 0;                                                                                            \
+            for(; i + 8 <= length; i += 8)                                                                             \
+                vst1q_s16(dest + i, intrinsic(vld1q_s16(src1 + i), vld1q_s16(src2 + i)));                              \
+            scalar_##name(dest + i, src1 + i, src2 + i, length - i);                                                   \
+        }
+
+ASEBA_NEON_BINARY_KERNEL(add, vaddq_s16)
+ASEBA_NEON_BINARY_KERNEL(sub, vsubq_s16)
+ASEBA_NEON_BINARY_KERNEL(mul, vmulq_s16)
+ASEBA_NEON_BINARY_KERNEL(min, vminq_s16)
+ASEBA_NEON_BINARY_KERNEL(max, vmaxq_s16)
+
+static void neon_clamp(int16_t* dest, const int16_t* src, const int16_t* low, const int16_t* high, uint16_t length) {
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const int16x8_t v = vld1q_s16(src + i);
+        const int16x8_t l = vld1q_s16(low + i);
+        const int16x8_t h = vld1q_s16(high + i);
+        vst1q_s16(dest + i, vbslq_s16(vcgtq_s16(v, h), h, vmaxq_s16(v, l)));
+    }
+    scalar_clamp(dest + i, src + i, low + i, high + i, length - i);
+}
+
+static int32_t neon_dot(const int16_t* src1, const int16_t* src2, uint16_t length) {
+    int32x4_t acc = vdupq_n_s32(0);
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const int16x8_t a = vld1q_s16(src1 + i);
+        const int16x8_t b = vld1q_s16(src2 + i);
+        acc = vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b));
+        acc = vmlal_high_s16(acc, a, b);
+    }
+    return (int32_t)(vaddvq_u32(vreinterpretq_u32_s32(acc)) + (uint32_t)scalar_dot(src1 + i, src2 + i, length - i));
+}
+
+static int32_t neon_stat(const int16_t* src, uint16_t length, int16_t* min, int16_t* max) {
+    int16x8_t vmin = vdupq_n_s16(src[0]);
+    int16x8_t vmax = vmin;
+    int32x4_t acc = vdupq_n_s32(0);
+    int16_t smin, smax;
+    int32_t sum;
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        const int16x8_t v = vld1q_s16(src + i);
+        vmin = vminq_s16(vmin, v);
+        vmax = vmaxq_s16(vmax, v);
+        acc = vpadalq_s16(acc, v);
+    }
+    smin = vminvq_s16(vmin);
+    smax = vmaxvq_s16(vmax);
+    sum = (int32_t)vaddvq_u32(vreinterpretq_u32_s32(acc));
+    for(; i < length; i++) {
+        if(src[i] < smin)
+            smin = src[i];
+        if(src[i] > smax)
+            smax = src[i];
+        sum += src[i];
+    }
+    *min = smin;
+    *max = smax;
+    return sum;
+}
+
+static uint16_t neon_find(const int16_t* src, uint16_t length, int16_t value) {
+    const int16x8_t target = vdupq_n_s16(value);
+    unsigned i = 0;
+    for(; i + 8 <= length; i += 8) {
+        if(vmaxvq_u16(vceqq_s16(vld1q_s16(src + i), target)))
+            break;
+    }
+    return i + scalar_find(src + i, value);
+}
+
+static void neon_argbounds(const int16_t* src, uint16_t length, uint16_t* argmin, uint16_t* argmax) {
+    int16_t min, max;
+    neon_stat(src, length, &min, &max);
+    *argmin = neon_find(src, length, min);
+    *argmax = neon_find(src, length, max);
+}
+
+static const AsebaVectorKernels neonVectorKernels = {
+    "NEON",
+    neon_add,
+    neon_sub,
+    neon_mul,
+    neon_min,
+    neon_max,
+    neon_clamp,
+    neon_dot,
+    neon_stat,
+    neon_argbounds};
+
+#endif  // ASEBA_VECTOR_KERNELS_NEON
+
+unsigned AsebaGetAvailableVectorKernels(const AsebaVectorKernels** kernels, unsigned maxCount) {
+    unsigned count = 0;
+    if(count < maxCount)
+        kernels[count++] = &AsebaScalarVectorKernels;
+#ifdef ASEBA_VECTOR_KERNELS_X86
+    if(count < maxCount && __builtin_cpu_supports("sse2"))
+        kernels[count++] = &sse2VectorKernels;
+    if(count < maxCount && __builtin_cpu_supports("avx2"))
+        kernels[count++] = &avx2VectorKernels;
+#endif
+#ifdef ASEBA_VECTOR_KERNELS_NEON
+    if(count < maxCount)
+        kernels[count++] = &neonVectorKernels;
+#endif
+    return count;
+}
+
+const AsebaVectorKernels* AsebaGetVectorKernels(void) {
+#ifdef ASEBA_VECTOR_KERNELS_X86
+    // the processor features are read once at program start, so these checks are cheap
+    if(__builtin_cpu_supports("avx2"))
+        return &avx2VectorKernels;
+    if(__builtin_cpu_supports("sse2"))
+        return &sse2VectorKernels;
+#endif
+#ifdef ASEBA_VECTOR_KERNELS_NEON
+    return &neonVectorKernels;
+#endif
+    return &AsebaScalarVectorKernels;
+}
+
+/*@}*/
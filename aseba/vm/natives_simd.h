@@ -0,0 +1,78 @@
+/*
+    Aseba - an event-based framework for distributed robot control
+    Created by Stéphane Magnenat <stephane at magnenat dot net> (http://stephane.magnenat.net)
+    with contributions from the community.
+    Copyright (C) 2007--2018 the authors, see authors.txt for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ASEBA_NATIVES_SIMD_H
+#define __ASEBA_NATIVES_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common/types.h"
+
+/**
+    \file natives_simd.h
+    Vectorized kernels behind the math natives on hosted builds
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+/*! Kernels implementing the element-by-element math natives on raw arrays.
+    All kernels give exactly the same results as the scalar loops of natives.c.
+    Destinations may be equal to a source, but must not start strictly inside it. */
+typedef struct {
+    const char* name; /*!< name of the instruction set used by these kernels */
+    /*! dest = src1 + src2 */
+    void (*add)(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! dest = src1 - src2 */
+    void (*sub)(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! dest = src1 * src2 */
+    void (*mul)(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! dest = min(src1, src2) */
+    void (*min)(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! dest = max(src1, src2) */
+    void (*max)(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! dest = src > high ? high : (src < low ? low : src) */
+    void (*clamp)(int16_t* dest, const int16_t* src, const int16_t* low, const int16_t* high, uint16_t length);
+    /*! return the sum of src1 * src2, accumulated on 32 bits with wrap-around */
+    int32_t (*dot)(const int16_t* src1, const int16_t* src2, uint16_t length);
+    /*! write the minimum and maximum of src and return its sum; length must not be 0 */
+    int32_t (*stat)(const int16_t* src, uint16_t length, int16_t* min, int16_t* max);
+    /*! write the first indices of the minimum and of the maximum of src; length must not be 0 */
+    void (*argbounds)(const int16_t* src, uint16_t length, uint16_t* argmin, uint16_t* argmax);
+} AsebaVectorKernels;
+
+/*! Portable kernels, the reference for the vectorized ones */
+extern const AsebaVectorKernels AsebaScalarVectorKernels;
+
+/*! Return the fastest kernels supported by the processor we are running on */
+const AsebaVectorKernels* AsebaGetVectorKernels(void);
+
+/*! Fill kernels with up to maxCount kernel sets usable on the processor we are running on,
+    from the slowest to the fastest, and return their number */
+unsigned AsebaGetAvailableVectorKernels(const AsebaVectorKernels** kernels, unsigned maxCount);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,6 +41,241 @@
 
 void AsebaVMSendExecutionStateChanged(AsebaVMState* vm);
 
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+//! Record that the variable at index was written, if written variables are tracked
+#    define SET_VARIABLE_DIRTY(vm, index)                                        \
+        do {                                                                     \
+            const uint16_t dirtyBlock = (index) / ASEBA_VM_DIRTY_BLOCK_SIZE;     \
+            if((vm)->variablesDirty)                                             \
+                BIT_SET((vm)->variablesDirty[dirtyBlock >> 4], dirtyBlock & 15); \
+        } while(0)
+
+void AsebaVMSetVariablesDirty(AsebaVMState* vm, uint16_t start, uint16_t length) {
+    uint16_t block;
+    if(!vm->variablesDirty || length == 0)
+        return;
+    for(block = start / ASEBA_VM_DIRTY_BLOCK_SIZE; block <= (start + length - 1) / ASEBA_VM_DIRTY_BLOCK_SIZE; block++)
+        BIT_SET(vm->variablesDirty[block >> 4], block & 15);
+}
+#else
+#    define SET_VARIABLE_DIRTY(vm, index)
+#endif
+
+#ifdef ASEBA_VM_PREDECODE
+
+/*! Decode the bytecode word at pc as if it was the start of an instruction */
+static void AsebaVMDecodeInstruction(AsebaVMState* vm, uint16_t pc) {
+    const uint16_t bytecode = vm->bytecode[pc];
+    // operands that would lie past the end of the bytecode are read as 0
+    const uint16_t next = (pc + 1 < vm->bytecodeSize) ? vm->bytecode[pc + 1] : 0;
+    const uint16_t nextNext = (pc + 2 < vm->bytecodeSize) ? vm->bytecode[pc + 2] : 0;
+    AsebaVMDecodedInstruction* instruction = &vm->decoded[pc];
+
+    instruction->opcode = bytecode >> 12;
+    instruction->arg0 = 0;
+    instruction->arg1 = 0;
+    instruction->arg2 = 0;
+
+    switch(instruction->opcode) {
+        case ASEBA_BYTECODE_SMALL_IMMEDIATE: instruction->arg0 = (uint16_t)(((int16_t)(bytecode << 4)) >> 4); break;
+        case ASEBA_BYTECODE_LARGE_IMMEDIATE: instruction->arg0 = next; break;
+        case ASEBA_BYTECODE_LOAD:
+        case ASEBA_BYTECODE_STORE:
+        case ASEBA_BYTECODE_NATIVE_CALL:
+        case ASEBA_BYTECODE_SUB_CALL: instruction->arg0 = bytecode & 0x0fff; break;
+        case ASEBA_BYTECODE_LOAD_INDIRECT:
+        case ASEBA_BYTECODE_STORE_INDIRECT:
+            instruction->arg0 = bytecode & 0x0fff;
+            instruction->arg1 = next;
+            break;
+        case ASEBA_BYTECODE_UNARY_ARITHMETIC: instruction->arg0 = bytecode & ASEBA_UNARY_OPERATOR_MASK; break;
+        case ASEBA_BYTECODE_BINARY_ARITHMETIC: instruction->arg0 = bytecode & ASEBA_BINARY_OPERATOR_MASK; break;
+        case ASEBA_BYTECODE_JUMP: instruction->arg0 = (uint16_t)(pc + (((int16_t)(bytecode << 4)) >> 4)); break;
+        case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
+            // the when bits change at run time, they are read from the bytecode
+            instruction->arg0 = bytecode & ASEBA_BINARY_OPERATOR_MASK;
+            instruction->arg1 = (uint16_t)(pc + (int16_t)next);
+            break;
+        case ASEBA_BYTECODE_EMIT:
+            instruction->arg0 = bytecode & 0x0fff;
+            instruction->arg1 = next;
+            instruction->arg2 = nextNext;
+            break;
+        default: break;
+    }
+}
+
+#    ifndef ASEBA_VM_NGRAM_PROFILER
+// superinstructions are not used when profiling, as they would hide the sequences being counted
+
+/*! Return the id of the bytecode at pc, or 0xf, which is not a valid id, if pc is out of bounds */
+static uint16_t AsebaVMBytecodeIdAt(AsebaVMState* vm, uint32_t pc) {
+    return pc < vm->bytecodeSize ? vm->bytecode[pc] >> 12 : 0xf;
+}
+
+/*! Return true if the bytecode at pc is a load or a store (given by id) to a valid variable */
+static int AsebaVMIsVariableAccessAt(AsebaVMState* vm, uint32_t pc, uint16_t id) {
+    return AsebaVMBytecodeIdAt(vm, pc) == id && (vm->bytecode[pc] & 0x0fff) < vm->variablesSize;
+}
+
+/*! Return true if the bytecode at pc is an arithmetic or a branch (given by id) that cannot fail */
+static int AsebaVMIsSafeBinaryOperationAt(AsebaVMState* vm, uint32_t pc, uint16_t id) {
+    uint16_t op;
+    if(AsebaVMBytecodeIdAt(vm, pc) != id)
+        return 0;
+    op = vm->bytecode[pc] & ASEBA_BINARY_OPERATOR_MASK;
+    return op <= ASEBA_OP_AND && op != ASEBA_OP_DIV && op != ASEBA_OP_MOD;
+}
+
+#    endif  // ASEBA_VM_NGRAM_PROFILER
+
+/*! Set the opcode of the decoded instruction at pc, using a superinstruction if the sequence starting at pc allows */
+static void AsebaVMFuseInstruction(AsebaVMState* vm, uint16_t pc) {
+    uint16_t opcode = vm->bytecode[pc] >> 12;
+
+#    ifndef ASEBA_VM_NGRAM_PROFILER
+    if(AsebaVMIsVariableAccessAt(vm, pc, ASEBA_BYTECODE_LOAD) &&
+       AsebaVMBytecodeIdAt(vm, pc + 1) == ASEBA_BYTECODE_SMALL_IMMEDIATE) {
+        if(AsebaVMIsSafeBinaryOperationAt(vm, pc + 2, ASEBA_BYTECODE_BINARY_ARITHMETIC))
+            opcode = ASEBA_VM_SUPER_LOAD_IMMEDIATE_ARITHMETIC;
+        else if(AsebaVMIsSafeBinaryOperationAt(vm, pc + 2, ASEBA_BYTECODE_CONDITIONAL_BRANCH))
+            opcode = ASEBA_VM_SUPER_LOAD_IMMEDIATE_BRANCH;
+    } else if(opcode == ASEBA_BYTECODE_SMALL_IMMEDIATE &&
+              AsebaVMIsVariableAccessAt(vm, pc + 1, ASEBA_BYTECODE_STORE)) {
+        opcode = ASEBA_VM_SUPER_IMMEDIATE_STORE;
+    }
+#    endif  // ASEBA_VM_NGRAM_PROFILER
+
+    vm->decoded[pc].opcode = opcode;
+}
+
+/*! Update the decoded bytecode after words in [start, start + length) have changed.
+    As instructions can span up to three words, the two preceding words are decoded as well,
+    and as superinstructions span up to four words, the three preceding words are fused again. */
+static void AsebaVMDecodeBytecode(AsebaVMState* vm, uint16_t start, uint16_t length) {
+    uint32_t end = (uint32_t)start + length;
+    uint16_t pc;
+
+    if(!vm->decoded)
+        return;
+
+    if(end > vm->bytecodeSize)
+        end = vm->bytecodeSize;
+    for(pc = start >= 2 ? start - 2 : 0; pc < end; pc++)
+        AsebaVMDecodeInstruction(vm, pc);
+    for(pc = start >= 3 ? start - 3 : 0; pc < end; pc++)
+        AsebaVMFuseInstruction(vm, pc);
+}
+
+#endif  // ASEBA_VM_PREDECODE
+
+#ifdef ASEBA_VM_NGRAM_PROFILER
+
+// Counts of the sequences executed by all VMs, which may run in parallel (see VMScheduler).
+// The history of the last executed bytecodes is kept by each VM, so that sequences do not span several VMs,
+// and cleared when an event is set up, so that they do not span several events.
+static uint32_t ngramCounts2[1 << 8];
+static uint32_t ngramCounts3[1 << 12];
+static uint32_t ngramCounts4[1 << 16];
+
+#    if defined(__GNUC__)
+#        define AsebaVMCountNGram(counter) __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+#        define AsebaVMReadNGramCount(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#    elif defined(_MSC_VER)
+#        include <intrin.h>
+#        define AsebaVMCountNGram(counter) _InterlockedIncrement((volatile long*)&(counter))
+#        define AsebaVMReadNGramCount(counter) (*(volatile uint32_t*)&(counter))
+#    else
+// no atomic operations known for this compiler, only profile VMs run from a single thread
+#        define AsebaVMCountNGram(counter) ((counter)++)
+#        define AsebaVMReadNGramCount(counter) (counter)
+#    endif
+
+/*! Count the sequences ending with the bytecode about to be executed */
+static void AsebaVMProfileNGrams(AsebaVMState* vm, uint16_t bytecodeId) {
+    const uint16_t history = (uint16_t)((vm->ngramHistory << 4) | bytecodeId);
+    vm->ngramHistory = history;
+    if(vm->ngramHistoryLength < 4)
+        vm->ngramHistoryLength++;
+    if(vm->ngramHistoryLength >= 2)
+        AsebaVMCountNGram(ngramCounts2[history & 0xff]);
+    if(vm->ngramHistoryLength >= 3)
+        AsebaVMCountNGram(ngramCounts3[history & 0xfff]);
+    if(vm->ngramHistoryLength >= 4)
+        AsebaVMCountNGram(ngramCounts4[history]);
+}
+
+uint32_t AsebaVMGetNGramCount(uint16_t ngram, uint16_t n) {
+    switch(n) {
+        case 2: return AsebaVMReadNGramCount(ngramCounts2[ngram & 0xff]);
+        case 3: return AsebaVMReadNGramCount(ngramCounts3[ngram & 0xfff]);
+        case 4: return AsebaVMReadNGramCount(ngramCounts4[ngram]);
+        default: return 0;
+    }
+}
+
+void AsebaVMResetNGramCounts(void) {
+    memset(ngramCounts2, 0, sizeof(ngramCounts2));
+    memset(ngramCounts3, 0, sizeof(ngramCounts3));
+    memset(ngramCounts4, 0, sizeof(ngramCounts4));
+}
+
+#endif  // ASEBA_VM_NGRAM_PROFILER
+
+#ifdef ASEBA_VM_PROFILER
+
+void AsebaVMResetProfile(AsebaVMState* vm) {
+    AsebaVMProfile* profile = vm->profile;
+    if(!profile)
+        return;
+    memset(profile->pcSteps, 0, vm->bytecodeSize * sizeof(uint32_t));
+    memset(profile->pcNativeTime, 0, vm->bytecodeSize * sizeof(uint32_t));
+    memset(profile->eventRuns, 0, profile->eventsSize * sizeof(uint32_t));
+    memset(profile->eventSteps, 0, profile->eventsSize * sizeof(uint32_t));
+    profile->currentEvent = profile->eventsSize;
+}
+
+/*! Account the set up of the event at index in the event vector */
+static void AsebaVMProfileEvent(AsebaVMState* vm, uint16_t index) {
+    AsebaVMProfile* profile = vm->profile;
+    profile->currentEvent = index < profile->eventsSize ? index : profile->eventsSize;
+    if(profile->currentEvent < profile->eventsSize)
+        profile->eventRuns[profile->currentEvent]++;
+}
+
+/*! Account the step about to be executed */
+static void AsebaVMProfileStep(AsebaVMState* vm) {
+    AsebaVMProfile* profile = vm->profile;
+    if(vm->pc < vm->bytecodeSize)
+        profile->pcSteps[vm->pc]++;
+    if(profile->currentEvent < profile->eventsSize)
+        profile->eventSteps[profile->currentEvent]++;
+}
+
+/*! Send counters in [start, start + length) of an array of size, clamped to what fits in a message */
+static void AsebaVMSendProfileData(AsebaVMState* vm, uint16_t counters, const uint32_t* data, uint16_t size,
+                                   uint16_t start, uint16_t length) {
+    uint16_t buffer[2 + 2 * ASEBA_MAX_PROFILE_DATA_COUNT];
+    uint16_t i;
+
+    if(start > size)
+        start = size;
+    if(length > size - start)
+        length = size - start;
+    if(length > ASEBA_MAX_PROFILE_DATA_COUNT)
+        length = ASEBA_MAX_PROFILE_DATA_COUNT;
+
+    buffer[0] = counters;
+    buffer[1] = start;
+    for(i = 0; i < length; i++) {
+        buffer[2 + 2 * i] = (uint16_t)(data[start + i] & 0xffff);
+        buffer[3 + 2 * i] = (uint16_t)(data[start + i] >> 16);
+    }
+    AsebaSendMessageWords(vm, ASEBA_MESSAGE_PROFILE_DATA, buffer, 2 + 2 * length);
+}
+
+#endif  // ASEBA_VM_PROFILER
+
 void AsebaVMInit(AsebaVMState* vm) {
     vm->pc = 0;
     vm->flags = 0;
@@ -50,6 +285,21 @@ void AsebaVMInit(AsebaVMState* vm) {
     vm->bytecode[0] = 0;
     memset(vm->variables, 0, vm->variablesSize * sizeof(int16_t));
     memset(vm->variablesOld, 0, vm->variablesSize * sizeof(int16_t));
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    // the glue fills some variables after this call, so compare all of them the first time
+    if(vm->variablesDirty)
+        memset(vm->variablesDirty, 0xff, ASEBA_VM_DIRTY_WORDS(vm->variablesSize) * sizeof(uint16_t));
+#endif
+
+#ifdef ASEBA_VM_PREDECODE
+    AsebaVMDecodeBytecode(vm, 0, vm->bytecodeSize);
+#endif
+#ifdef ASEBA_VM_PROFILER
+    AsebaVMResetProfile(vm);
+#endif
+#ifdef ASEBA_VM_NGRAM_PROFILER
+    vm->ngramHistoryLength = 0;
+#endif
 }
 
 uint16_t AsebaVMGetEventAddress(AsebaVMState* vm, uint16_t event) {
@@ -67,6 +317,15 @@ uint16_t AsebaVMGetEventAddress(AsebaVMState* vm, uint16_t event) {
 uint16_t AsebaVMSetupEvent(AsebaVMState* vm, uint16_t event) {
     uint16_t address = AsebaVMGetEventAddress(vm, event);
     if(address) {
+#ifdef ASEBA_VM_PROFILER
+        if(vm->profile) {
+            uint16_t i;
+            for(i = 1; vm->bytecode[i] != event; i += 2)
+                ;
+            AsebaVMProfileEvent(vm, (i - 1) / 2);
+        }
+#endif
+
         // if currently executing a thread, notify kill
         if(AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK)) {
             AsebaSendMessageWords(vm, ASEBA_MESSAGE_EVENT_EXECUTION_KILLED, &vm->pc, 1);
@@ -75,6 +334,9 @@ uint16_t AsebaVMSetupEvent(AsebaVMState* vm, uint16_t event) {
         vm->pc = address;
         vm->sp = -1;
         AsebaMaskSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK);
+#ifdef ASEBA_VM_NGRAM_PROFILER
+        vm->ngramHistoryLength = 0;
+#endif
 
         // if we are in step by step, notify
         if(AsebaMaskIsSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK))
@@ -160,6 +422,14 @@ void AsebaVMStep(AsebaVMState* vm) {
         AsebaAssert(vm, ASEBA_ASSERT_STEP_OUT_OF_RUN);
 #endif
 
+#ifdef ASEBA_VM_NGRAM_PROFILER
+    AsebaVMProfileNGrams(vm, bytecode >> 12);
+#endif
+#ifdef ASEBA_VM_PROFILER
+    if(vm->profile)
+        AsebaVMProfileStep(vm);
+#endif
+
     switch(bytecode >> 12) {
         // Bytecode: Stop
         case ASEBA_BYTECODE_STOP: {
@@ -231,6 +501,7 @@ void AsebaVMStep(AsebaVMState* vm) {
 
             // pop value from stack
             vm->variables[variableIndex] = vm->stack[vm->sp--];
+            SET_VARIABLE_DIRTY(vm, variableIndex);
 
             // increment PC
             vm->pc++;
@@ -307,6 +578,7 @@ void AsebaVMStep(AsebaVMState* vm) {
 
             // store variable and change sp
             vm->variables[arrayIndex + variableIndex] = variableValue;
+            SET_VARIABLE_DIRTY(vm, arrayIndex + variableIndex);
             vm->sp -= 2;
 
             // increment PC
@@ -438,6 +710,14 @@ void AsebaVMStep(AsebaVMState* vm) {
         // Bytecode: Call
         case ASEBA_BYTECODE_NATIVE_CALL: {
             // call native function
+#ifdef ASEBA_VM_PROFILER
+            if(vm->profile) {
+                const uint16_t pc = vm->pc;
+                const uint32_t startTime = AsebaVMProfilerTime(vm);
+                AsebaNativeFunction(vm, bytecode & 0x0fff);
+                vm->profile->pcNativeTime[pc] += AsebaVMProfilerTime(vm) - startTime;
+            } else
+#endif
             AsebaNativeFunction(vm, bytecode & 0x0fff);
 
             // increment PC
@@ -548,6 +828,395 @@ void AsebaDebugBareRun(AsebaVMState* vm, uint16_t stepsLimit) {
     AsebaMaskClear(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
 }
 
+#if defined(ASEBA_VM_THREADED_DISPATCH) && !defined(__GNUC__)
+// computed goto is a GCC/clang extension, fall back to the switch-based loop elsewhere
+#    undef ASEBA_VM_THREADED_DISPATCH
+#endif
+
+#if defined(ASEBA_VM_THREADED_DISPATCH) && defined(ASEBA_VM_NGRAM_PROFILER)
+// the n-gram profiler sees bytecodes through AsebaVMStep
+#    undef ASEBA_VM_THREADED_DISPATCH
+#endif
+
+#ifdef ASEBA_VM_THREADED_DISPATCH
+
+// Helpers for AsebaDebugThreadedRun, pc and sp are kept in locals and written back to the VM
+// whenever something outside the loop (messages, natives, callbacks) can look at them.
+#    define THREADED_SYNC() \
+        do {                \
+            vm->pc = pc;    \
+            vm->sp = sp;    \
+        } while(0)
+#    define THREADED_RELOAD() \
+        do {                  \
+            pc = vm->pc;      \
+            sp = vm->sp;      \
+        } while(0)
+#    define THREADED_COUNT_STEP()             \
+        do {                                  \
+            if(stepsLeft && --stepsLeft == 0) \
+                goto stepsLimitReached;       \
+        } while(0)
+#    define THREADED_DISPATCH()    \
+        do {                       \
+            THREADED_COUNT_STEP(); \
+            THREADED_FETCH();      \
+        } while(0)
+#    define THREADED_POLL_AND_DISPATCH()                                   \
+        do {                                                               \
+            THREADED_COUNT_STEP();                                         \
+            if(AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) ||  \
+               AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK)) { \
+                THREADED_SYNC();                                           \
+                goto end;                                                  \
+            }                                                              \
+            THREADED_FETCH();                                              \
+        } while(0)
+#    define THREADED_STOP()        \
+        do {                       \
+            THREADED_SYNC();       \
+            THREADED_COUNT_STEP(); \
+            goto end;              \
+        } while(0)
+#    ifdef ASEBA_ASSERT
+#        define THREADED_ASSERT(condition, reason) \
+            do {                                   \
+                if(!(condition)) {                 \
+                    THREADED_SYNC();               \
+                    AsebaAssert(vm, reason);       \
+                    goto end;                      \
+                }                                  \
+            } while(0)
+#    else
+#        define THREADED_ASSERT(condition, reason)
+#    endif
+
+// Operand access, either from the pre-decoded instruction or from the raw bytecode
+#    ifdef ASEBA_VM_PREDECODE
+#        define THREADED_FETCH()                          \
+            do {                                          \
+                instruction = &vm->decoded[pc];           \
+                goto* dispatchTable[instruction->opcode]; \
+            } while(0)
+#        define THREADED_SMALL_IMMEDIATE() ((int16_t)instruction->arg0)
+#        define THREADED_LARGE_IMMEDIATE() ((int16_t)instruction->arg0)
+#        define THREADED_ADDRESS() (instruction->arg0)
+#        define THREADED_OPERATOR() (instruction->arg0)
+#        define THREADED_ARRAY_SIZE() (instruction->arg1)
+#        define THREADED_JUMP_DESTINATION() (instruction->arg0)
+#        define THREADED_BRANCH_DESTINATION() (instruction->arg1)
+#        define THREADED_EMIT_START() (instruction->arg1)
+#        define THREADED_EMIT_LENGTH() (instruction->arg2)
+#    else
+#        define THREADED_FETCH()                     \
+            do {                                     \
+                bytecode = vm->bytecode[pc];         \
+                goto* dispatchTable[bytecode >> 12]; \
+            } while(0)
+#        define THREADED_SMALL_IMMEDIATE() (((int16_t)(bytecode << 4)) >> 4)
+#        define THREADED_LARGE_IMMEDIATE() ((int16_t)vm->bytecode[pc + 1])
+#        define THREADED_ADDRESS() (bytecode & 0x0fff)
+#        define THREADED_OPERATOR() (bytecode & ASEBA_BINARY_OPERATOR_MASK)
+#        define THREADED_ARRAY_SIZE() (vm->bytecode[pc + 1])
+#        define THREADED_JUMP_DESTINATION() ((uint16_t)(pc + (((int16_t)(bytecode << 4)) >> 4)))
+#        define THREADED_BRANCH_DESTINATION() ((uint16_t)(pc + (int16_t)vm->bytecode[pc + 1]))
+#        define THREADED_EMIT_START() (vm->bytecode[pc + 1])
+#        define THREADED_EMIT_LENGTH() (vm->bytecode[pc + 2])
+#    endif
+
+#    ifdef ASEBA_VM_PREDECODE
+// Superinstructions execute count instructions at once; if the steps limit would be reached
+// within them or if the stack could overflow, they fall back to their first instruction.
+#        define THREADED_SUPER_GUARD(count, pushes, fallback)                   \
+            do {                                                                \
+                if((stepsLeft && stepsLeft <= (count)) ||                       \
+                   !(sp + (pushes) < vm->stackSize))                            \
+                    goto fallback;                                              \
+            } while(0)
+#        define THREADED_SUPER_DISPATCH(count)   \
+            do {                                 \
+                if(stepsLeft)                    \
+                    stepsLeft -= (count) - 1;    \
+                THREADED_DISPATCH();             \
+            } while(0)
+#    endif
+
+/*! Run without support of breakpoints, using direct-threaded dispatch.
+    Equivalent to AsebaDebugBareRun, including the stepsLimit semantics, but the execution
+    flags are only polled after instructions that can modify them: branches, calls, emits
+    and runtime errors. If ASEBA_VM_PREDECODE is defined, instructions are read from
+    vm->decoded, which must then be available, and frequent sequences are executed as
+    superinstructions (see AsebaVMSuperinstructionId). */
+static void AsebaDebugThreadedRun(AsebaVMState* vm, uint16_t stepsLimit) {
+#    ifdef ASEBA_VM_PREDECODE
+    static const void* const dispatchTable[19] = {
+        &&opStop,        &&opSmallImmediate, &&opLargeImmediate,   &&opLoad,
+        &&opStore,       &&opLoadIndirect,   &&opStoreIndirect,    &&opUnaryArithmetic,
+        &&opBinaryArithmetic, &&opJump,      &&opConditionalBranch, &&opEmit,
+        &&opNativeCall,  &&opSubCall,        &&opSubRet,           &&opUnknown,
+        &&opImmediateStore, &&opLoadImmediateArithmetic, &&opLoadImmediateBranch};
+#    else
+    static const void* const dispatchTable[16] = {
+        &&opStop,        &&opSmallImmediate, &&opLargeImmediate,   &&opLoad,
+        &&opStore,       &&opLoadIndirect,   &&opStoreIndirect,    &&opUnaryArithmetic,
+        &&opBinaryArithmetic, &&opJump,      &&opConditionalBranch, &&opEmit,
+        &&opNativeCall,  &&opSubCall,        &&opSubRet,           &&opUnknown};
+#    endif
+    int16_t* const variables = vm->variables;
+    int16_t* const stack = vm->stack;
+    uint16_t stepsLeft = stepsLimit;
+    uint16_t pc = vm->pc;
+    int16_t sp = vm->sp;
+#    ifdef ASEBA_VM_PREDECODE
+    const AsebaVMDecodedInstruction* instruction;
+#    else
+    uint16_t bytecode;
+#    endif
+
+    AsebaMaskSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+
+    if(AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+        goto end;
+
+    THREADED_FETCH();
+
+opStop:
+    AsebaMaskClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK);
+    THREADED_STOP();
+
+opSmallImmediate:
+    THREADED_ASSERT(sp + 1 < vm->stackSize, ASEBA_ASSERT_STACK_OVERFLOW);
+    stack[++sp] = THREADED_SMALL_IMMEDIATE();
+    pc++;
+    THREADED_DISPATCH();
+
+opLargeImmediate:
+    THREADED_ASSERT(sp + 1 < vm->stackSize, ASEBA_ASSERT_STACK_OVERFLOW);
+    stack[++sp] = THREADED_LARGE_IMMEDIATE();
+    pc += 2;
+    THREADED_DISPATCH();
+
+opLoad:
+    THREADED_ASSERT(sp + 1 < vm->stackSize, ASEBA_ASSERT_STACK_OVERFLOW);
+    THREADED_ASSERT(THREADED_ADDRESS() < vm->variablesSize, ASEBA_ASSERT_OUT_OF_VARIABLES_BOUNDS);
+    stack[++sp] = variables[THREADED_ADDRESS()];
+    pc++;
+    THREADED_DISPATCH();
+
+opStore:
+    THREADED_ASSERT(sp >= 0, ASEBA_ASSERT_STACK_UNDERFLOW);
+    THREADED_ASSERT(THREADED_ADDRESS() < vm->variablesSize, ASEBA_ASSERT_OUT_OF_VARIABLES_BOUNDS);
+    variables[THREADED_ADDRESS()] = stack[sp--];
+    SET_VARIABLE_DIRTY(vm, THREADED_ADDRESS());
+    pc++;
+    THREADED_DISPATCH();
+
+opLoadIndirect: {
+    uint16_t arraySize, variableIndex;
+    THREADED_ASSERT(sp >= 0, ASEBA_ASSERT_STACK_UNDERFLOW);
+    arraySize = THREADED_ARRAY_SIZE();
+    variableIndex = (uint16_t)stack[sp];
+    if(variableIndex >= arraySize) {
+        uint16_t buffer[3];
+        buffer[0] = pc;
+        buffer[1] = arraySize;
+        buffer[2] = variableIndex;
+        THREADED_SYNC();
+        vm->flags = ASEBA_VM_STEP_BY_STEP_MASK;
+        AsebaSendMessageWords(vm, ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS, buffer, 3);
+        if(AsebaVMErrorCB)
+            AsebaVMErrorCB(vm, NULL);
+        THREADED_STOP();
+    }
+    stack[sp] = variables[THREADED_ADDRESS() + variableIndex];
+    pc += 2;
+    THREADED_DISPATCH();
+}
+
+opStoreIndirect: {
+    uint16_t arraySize, variableIndex;
+    THREADED_ASSERT(sp >= 1, ASEBA_ASSERT_STACK_UNDERFLOW);
+    arraySize = THREADED_ARRAY_SIZE();
+    variableIndex = (uint16_t)stack[sp];
+    if(variableIndex >= arraySize) {
+        uint16_t buffer[3];
+        buffer[0] = pc;
+        buffer[1] = arraySize;
+        buffer[2] = variableIndex;
+        THREADED_SYNC();
+        vm->flags = ASEBA_VM_STEP_BY_STEP_MASK;
+        AsebaSendMessageWords(vm, ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS, buffer, 3);
+        if(AsebaVMErrorCB)
+            AsebaVMErrorCB(vm, NULL);
+        THREADED_STOP();
+    }
+    variables[THREADED_ADDRESS() + variableIndex] = stack[sp - 1];
+    SET_VARIABLE_DIRTY(vm, THREADED_ADDRESS() + variableIndex);
+    sp -= 2;
+    pc += 2;
+    THREADED_DISPATCH();
+}
+
+opUnaryArithmetic:
+    THREADED_ASSERT(sp >= 0, ASEBA_ASSERT_STACK_UNDERFLOW);
+    stack[sp] = AsebaVMDoUnaryOperation(vm, stack[sp], THREADED_OPERATOR());
+    pc++;
+    THREADED_DISPATCH();
+
+opBinaryArithmetic: {
+    const uint16_t op = THREADED_OPERATOR();
+    THREADED_ASSERT(sp >= 1, ASEBA_ASSERT_STACK_UNDERFLOW);
+    // division and modulo report errors using the pc of the VM
+    vm->pc = pc;
+    stack[sp - 1] = AsebaVMDoBinaryOperation(vm, stack[sp - 1], stack[sp], op);
+    sp--;
+    pc++;
+    if(op == ASEBA_OP_DIV || op == ASEBA_OP_MOD)
+        THREADED_POLL_AND_DISPATCH();
+    THREADED_DISPATCH();
+}
+
+opJump:
+    THREADED_ASSERT(THREADED_JUMP_DESTINATION() < vm->bytecodeSize, ASEBA_ASSERT_OUT_OF_BYTECODE_BOUNDS);
+    pc = THREADED_JUMP_DESTINATION();
+    THREADED_POLL_AND_DISPATCH();
+
+opConditionalBranch: {
+    const uint16_t bytecodeWord = vm->bytecode[pc];
+    int16_t conditionResult;
+    uint16_t destination;
+    THREADED_ASSERT(sp >= 1, ASEBA_ASSERT_STACK_UNDERFLOW);
+    vm->pc = pc;
+    conditionResult = AsebaVMDoBinaryOperation(vm, stack[sp - 1], stack[sp], THREADED_OPERATOR());
+    sp -= 2;
+
+    // same logic as in AsebaVMStep, including the write back of the when bit in the bytecode
+    if(conditionResult &&
+       !(GET_BIT(bytecodeWord, ASEBA_IF_IS_WHEN_BIT) && GET_BIT(bytecodeWord, ASEBA_IF_WAS_TRUE_BIT)))
+        destination = pc + 2;
+    else
+        destination = THREADED_BRANCH_DESTINATION();
+
+    if(conditionResult)
+        BIT_SET(vm->bytecode[pc], ASEBA_IF_WAS_TRUE_BIT);
+    else
+        BIT_CLR(vm->bytecode[pc], ASEBA_IF_WAS_TRUE_BIT);
+
+    THREADED_ASSERT(destination < vm->bytecodeSize, ASEBA_ASSERT_OUT_OF_BYTECODE_BOUNDS);
+    pc = destination;
+    THREADED_POLL_AND_DISPATCH();
+}
+
+opEmit:
+    THREADED_ASSERT(THREADED_EMIT_LENGTH() <= ASEBA_MAX_EVENT_ARG_SIZE, ASEBA_ASSERT_EMIT_BUFFER_TOO_LONG);
+    THREADED_SYNC();
+    AsebaSendMessageWords(vm, THREADED_ADDRESS(), variables + THREADED_EMIT_START(), THREADED_EMIT_LENGTH());
+    vm->pc += 3;
+    THREADED_RELOAD();
+    THREADED_POLL_AND_DISPATCH();
+
+opNativeCall:
+    THREADED_SYNC();
+    AsebaNativeFunction(vm, THREADED_ADDRESS());
+    vm->pc++;
+    THREADED_RELOAD();
+    THREADED_POLL_AND_DISPATCH();
+
+opSubCall:
+    THREADED_ASSERT(sp + 1 < vm->stackSize, ASEBA_ASSERT_STACK_OVERFLOW);
+    stack[++sp] = pc + 1;
+    pc = THREADED_ADDRESS();
+    THREADED_POLL_AND_DISPATCH();
+
+opSubRet:
+    THREADED_ASSERT(sp >= 0, ASEBA_ASSERT_STACK_UNDERFLOW);
+    pc = stack[sp--];
+    THREADED_POLL_AND_DISPATCH();
+
+opUnknown:
+    THREADED_ASSERT(0, ASEBA_ASSERT_UNKNOWN_BYTECODE);
+    // like AsebaVMStep, do not move on, only the steps limit can get us out of here
+    THREADED_POLL_AND_DISPATCH();
+
+#    ifdef ASEBA_VM_PREDECODE
+    // The fusion pass only emits these when all variable addresses are in bounds and the
+    // operators cannot fail, the values transiting through the stack are kept in locals.
+
+opImmediateStore:
+    THREADED_SUPER_GUARD(2, 1, opSmallImmediate);
+    variables[instruction[1].arg0] = (int16_t)instruction[0].arg0;
+    SET_VARIABLE_DIRTY(vm, instruction[1].arg0);
+    pc += 2;
+    THREADED_SUPER_DISPATCH(2);
+
+opLoadImmediateArithmetic:
+    THREADED_SUPER_GUARD(3, 2, opLoad);
+    stack[++sp] = AsebaVMDoBinaryOperation(vm, variables[instruction[0].arg0], (int16_t)instruction[1].arg0,
+                                           instruction[2].arg0);
+    pc += 3;
+    THREADED_SUPER_DISPATCH(3);
+
+opLoadImmediateBranch:
+    THREADED_SUPER_GUARD(3, 2, opLoad);
+    {
+        // same logic as opConditionalBranch, for the branch located two words after pc
+        const uint16_t bytecodeWord = vm->bytecode[pc + 2];
+        const int16_t conditionResult = AsebaVMDoBinaryOperation(vm, variables[instruction[0].arg0],
+                                                                 (int16_t)instruction[1].arg0, instruction[2].arg0);
+        uint16_t destination;
+
+        if(conditionResult &&
+           !(GET_BIT(bytecodeWord, ASEBA_IF_IS_WHEN_BIT) && GET_BIT(bytecodeWord, ASEBA_IF_WAS_TRUE_BIT)))
+            destination = pc + 4;
+        else
+            destination = instruction[2].arg1;
+
+        if(conditionResult)
+            BIT_SET(vm->bytecode[pc + 2], ASEBA_IF_WAS_TRUE_BIT);
+        else
+            BIT_CLR(vm->bytecode[pc + 2], ASEBA_IF_WAS_TRUE_BIT);
+
+        pc += 2;  // report a bad destination at the branch
+        THREADED_ASSERT(destination < vm->bytecodeSize, ASEBA_ASSERT_OUT_OF_BYTECODE_BOUNDS);
+        pc = destination;
+        if(stepsLeft)
+            stepsLeft -= 2;
+        THREADED_POLL_AND_DISPATCH();
+    }
+#    endif  // ASEBA_VM_PREDECODE
+
+stepsLimitReached:
+    THREADED_SYNC();
+    killSlowEvent(vm);
+
+end:
+    AsebaMaskClear(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+}
+
+#    undef THREADED_SYNC
+#    undef THREADED_RELOAD
+#    undef THREADED_COUNT_STEP
+#    undef THREADED_DISPATCH
+#    undef THREADED_POLL_AND_DISPATCH
+#    undef THREADED_STOP
+#    undef THREADED_ASSERT
+#    undef THREADED_FETCH
+#    undef THREADED_SMALL_IMMEDIATE
+#    undef THREADED_LARGE_IMMEDIATE
+#    undef THREADED_ADDRESS
+#    undef THREADED_OPERATOR
+#    undef THREADED_ARRAY_SIZE
+#    undef THREADED_JUMP_DESTINATION
+#    undef THREADED_BRANCH_DESTINATION
+#    undef THREADED_EMIT_START
+#    undef THREADED_EMIT_LENGTH
+#    ifdef ASEBA_VM_PREDECODE
+#        undef THREADED_SUPER_GUARD
+#        undef THREADED_SUPER_DISPATCH
+#    endif
+
+#endif  // ASEBA_VM_THREADED_DISPATCH
+
 /*! Run with support of breakpoints.
     Also check ASEBA_VM_EVENT_RUNNING_MASK to exit on interrupts. */
 void AsebaDebugBreakpointRun(AsebaVMState* vm, uint16_t stepsLimit) {
@@ -594,10 +1263,26 @@ uint16_t AsebaVMRun(AsebaVMState* vm, uint16_t stepsLimit) {
         return 0;
 
     // run until something stops the vm
+    // breakpoints are only supported when stepping through the raw bytecode
     if(vm->breakpointsCount)
         AsebaDebugBreakpointRun(vm, stepsLimit);
+#ifdef ASEBA_VM_PROFILER
+    // profiling counts every step in AsebaVMStep
+    else if(vm->profile)
+        AsebaDebugBareRun(vm, stepsLimit);
+#endif
+#if defined(ASEBA_VM_THREADED_DISPATCH) && defined(ASEBA_VM_PREDECODE)
+    else if(vm->decoded)
+        AsebaDebugThreadedRun(vm, stepsLimit);
     else
         AsebaDebugBareRun(vm, stepsLimit);
+#elif defined(ASEBA_VM_THREADED_DISPATCH)
+    else
+        AsebaDebugThreadedRun(vm, stepsLimit);
+#else
+    else
+        AsebaDebugBareRun(vm, stepsLimit);
+#endif
 
     return 1;
 }
@@ -726,6 +1411,9 @@ void AsebaVMDebugMessage(AsebaVMState* vm, uint16_t id, uint16_t* data, uint16_t
 #endif
             for(i = 0; i < length; i++)
                 vm->bytecode[start + i] = bswap16(data[i + 1]);
+#ifdef ASEBA_VM_PREDECODE
+            AsebaVMDecodeBytecode(vm, start, length);
+#endif
         }
             // There is no break here because we want to do a reset after a set bytecode
             ASEBA_FALLTHROUGH;
@@ -733,6 +1421,9 @@ void AsebaVMDebugMessage(AsebaVMState* vm, uint16_t id, uint16_t* data, uint16_t
         case ASEBA_MESSAGE_RESET:
             vm->flags = ASEBA_VM_STEP_BY_STEP_MASK;
             AsebaVMResetWhenFlags(vm);
+#ifdef ASEBA_VM_PROFILER
+            AsebaVMResetProfile(vm);
+#endif
             if(AsebaVMResetCB)
                 AsebaVMResetCB(vm);
             // try to setup event, if it fails, return the execution state anyway
@@ -792,6 +1483,33 @@ void AsebaVMDebugMessage(AsebaVMState* vm, uint16_t id, uint16_t* data, uint16_t
              break;
         }
 
+#ifdef ASEBA_VM_PROFILER
+        case ASEBA_MESSAGE_GET_PROFILE_DATA: {
+            const uint16_t counters = bswap16(data[0]);
+            const uint16_t start = bswap16(data[1]);
+            const uint16_t length = bswap16(data[2]);
+            const AsebaVMProfile* profile = vm->profile;
+            // VMs without counters do not answer
+            if(!profile)
+                break;
+            switch(counters) {
+                case ASEBA_PROFILE_PC_STEPS:
+                    AsebaVMSendProfileData(vm, counters, profile->pcSteps, vm->bytecodeSize, start, length);
+                    break;
+                case ASEBA_PROFILE_PC_NATIVE_TIME:
+                    AsebaVMSendProfileData(vm, counters, profile->pcNativeTime, vm->bytecodeSize, start, length);
+                    break;
+                case ASEBA_PROFILE_EVENT_RUNS:
+                    AsebaVMSendProfileData(vm, counters, profile->eventRuns, profile->eventsSize, start, length);
+                    break;
+                case ASEBA_PROFILE_EVENT_STEPS:
+                    AsebaVMSendProfileData(vm, counters, profile->eventSteps, profile->eventsSize, start, length);
+                    break;
+                default: break;
+            }
+        } break;
+#endif  // ASEBA_VM_PROFILER
+
         case ASEBA_MESSAGE_SET_VARIABLES: {
             uint16_t start = bswap16(data[0]);
             uint16_t length = dataLength - 1;
@@ -802,6 +1520,7 @@ void AsebaVMDebugMessage(AsebaVMState* vm, uint16_t id, uint16_t* data, uint16_t
 #endif
             for(i = 0; i < length; i++)
                 vm->variables[start + i] = bswap16(data[i + 1]);
+            AsebaVMSetVariablesDirty(vm, start, length);
         } break;
 
         case ASEBA_MESSAGE_WRITE_BYTECODE: AsebaWriteBytecode(vm); break;
@@ -54,6 +54,54 @@ enum {
     ASEBA_MAX_BREAKPOINTS = 16  //!< maximum number of simultaneous breakpoints the target supports
 };
 
+#ifdef ASEBA_VM_PREDECODE
+/*! A bytecode word decoded as the start of an instruction, with its immediates and branch targets resolved.
+    Every word of the bytecode has a decoded counterpart, so that execution can start at any address.
+    The meaning of the arguments depends on the opcode:
+    - small and large immediates: arg0 is the value
+    - load and store: arg0 is the variable address
+    - load and store indirect: arg0 is the array address, arg1 the array size
+    - unary and binary arithmetic: arg0 is the operator
+    - jump: arg0 is the absolute destination
+    - conditional branch: arg0 is the operator, arg1 the absolute destination if the condition is false
+    - emit: arg0 is the event id, arg1 the start of the arguments and arg2 their length
+    - native call: arg0 is the native function id
+    - subroutine call: arg0 is the absolute destination
+*/
+typedef struct {
+    uint16_t opcode; /*!< one of AsebaBytecodeId or AsebaVMSuperinstructionId */
+    uint16_t arg0;
+    uint16_t arg1;
+    uint16_t arg2;
+} AsebaVMDecodedInstruction;
+
+/*! Superinstructions, fused sequences of bytecodes produced when decoding.
+    A superinstruction keeps the arguments of the first bytecode of its sequence, the other ones are read
+    from the following decoded instructions, which are left untouched so that jumping in the middle of a
+    sequence still works. Sequences are only fused if they cannot fail at run time, besides a stack overflow.
+    They are the most frequent sequences executed by the example programs of the playground, as counted by
+    ASEBA_VM_NGRAM_PROFILER; sequences accounting for less than 1% of the executed bytecodes are not fused. */
+typedef enum {
+    ASEBA_VM_SUPER_IMMEDIATE_STORE = 0x10,     //!< SMALL_IMMEDIATE; STORE
+    ASEBA_VM_SUPER_LOAD_IMMEDIATE_ARITHMETIC,  //!< LOAD; SMALL_IMMEDIATE; BINARY_ARITHMETIC
+    ASEBA_VM_SUPER_LOAD_IMMEDIATE_BRANCH       //!< LOAD; SMALL_IMMEDIATE; CONDITIONAL_BRANCH
+} AsebaVMSuperinstructionId;
+#endif  // ASEBA_VM_PREDECODE
+
+#ifdef ASEBA_VM_PROFILER
+/*! Execution counters of a VM, the arrays are allocated by the glue code.
+    Events are identified by their index in the event vector of the bytecode, counters wrap around.
+    All counters are cleared by AsebaVMResetProfile, which is called when the VM is reset. */
+typedef struct {
+    uint32_t* pcSteps;      /*!< steps executed at each address, of size bytecodeSize */
+    uint32_t* pcNativeTime; /*!< time spent in the native function called at each address, of size bytecodeSize */
+    uint16_t eventsSize;    /*!< number of profiled entries of the event vector */
+    uint32_t* eventRuns;    /*!< times each event was set up, of size eventsSize */
+    uint32_t* eventSteps;   /*!< steps executed by each event, including its subroutines, of size eventsSize */
+    uint16_t currentEvent;  /*!< index of the event being executed, eventsSize if none */
+} AsebaVMProfile;
+#endif  // ASEBA_VM_PROFILER
+
 /*! This structure contains the state of the Aseba VM.
     This is the required and the sufficient data for the VM to run.
     This is not sufficient for the compiler to build bytecode, as there is
@@ -89,6 +137,34 @@ typedef struct {
     // breakpoint
     uint16_t breakpoints[ASEBA_MAX_BREAKPOINTS];
     uint16_t breakpointsCount;
+
+    // embedding
+    void* userData; /*!< free for the glue code, for instance to find its objects from the callbacks;
+                         never used by the VM */
+
+#ifdef ASEBA_VM_PREDECODE
+    // pre-decoded bytecode, hosted targets only
+    AsebaVMDecodedInstruction* decoded; /*!< decoded bytecode of size bytecodeSize, NULL to always run raw bytecode;
+                                             must be set before AsebaVMInit is called */
+#endif
+
+#ifdef ASEBA_VM_PROFILER
+    // execution counters, hosted targets only
+    AsebaVMProfile* profile; /*!< counters updated while running, NULL to disable profiling */
+#endif
+
+#ifdef ASEBA_VM_NGRAM_PROFILER
+    // executed bytecodes, to count their sequences
+    uint16_t ngramHistory;       /*!< ids of the last bytecodes executed by the current event, one per nibble */
+    uint16_t ngramHistoryLength; /*!< number of ids in ngramHistory, cleared when an event is set up */
+#endif
+
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+    // written variables, hosted targets only
+    uint16_t* variablesDirty; /*!< one bit per block of ASEBA_VM_DIRTY_BLOCK_SIZE variables written since the
+                                   last AsebaSendChangedVariables, of size ASEBA_VM_DIRTY_WORDS(variablesSize);
+                                   NULL to compare all variables; must be set before AsebaVMInit is called */
+#endif
 } AsebaVMState;
 
 // Macros to work with masks
@@ -135,6 +211,35 @@ void AsebaVMDebugMessage(AsebaVMState* vm, uint16_t id, uint16_t* data, uint16_t
  * error */
 void AsebaVMEmitNodeSpecificError(AsebaVMState* vm, const char* message);
 
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+//! Number of variables per bit of AsebaVMState::variablesDirty
+#    define ASEBA_VM_DIRTY_BLOCK_SIZE 16
+//! Number of words of AsebaVMState::variablesDirty for a given amount of variables, a word holding 16 blocks
+#    define ASEBA_VM_DIRTY_WORDS(variablesSize) (((variablesSize) + 16 * ASEBA_VM_DIRTY_BLOCK_SIZE - 1) >> 8)
+
+/*! Record that variables from start to start + length - 1 were written, so that AsebaSendChangedVariables
+    considers them. The VM and the standard native functions do it themselves, glue code (including its native
+    functions) must do it for the variables it writes if it sets AsebaVMState::variablesDirty. */
+void AsebaVMSetVariablesDirty(AsebaVMState* vm, uint16_t start, uint16_t length);
+#else
+#    define AsebaVMSetVariablesDirty(vm, start, length) ((void)0)
+#endif
+
+#ifdef ASEBA_VM_NGRAM_PROFILER
+/*! Return how many times a sequence of n (2 to 4) bytecodes was executed, by all VMs, since the last reset.
+    The sequence is given by the ids of its bytecodes, one per nibble, the last executed one in the lowest nibble.
+    This is used to select the superinstructions of hosted VMs, which are disabled while profiling. */
+uint32_t AsebaVMGetNGramCount(uint16_t ngram, uint16_t n);
+
+/*! Reset the counters of executed sequences of bytecodes, must not be called while a VM is running */
+void AsebaVMResetNGramCounts(void);
+#endif  // ASEBA_VM_NGRAM_PROFILER
+
+#ifdef ASEBA_VM_PROFILER
+/*! Clear the execution counters of the VM, if it has any */
+void AsebaVMResetProfile(AsebaVMState* vm);
+#endif  // ASEBA_VM_PROFILER
+
 /*! Return non-zero if VM will ignore the packet, 0 otherwise */
 uint16_t AsebaVMShouldDropPacket(AsebaVMState* vm, uint16_t source, const uint8_t* data);
 
@@ -167,6 +272,12 @@ void AsebaSendDescriptionFragment(AsebaVMState* vm, int16_t fragment);
 /*! Called by AsebaStep to perform a native function call. */
 void AsebaNativeFunction(AsebaVMState* vm, uint16_t id);
 
+#ifdef ASEBA_VM_PROFILER
+/*! Called around native function calls when profiling, return a monotonic time in a unit of the glue's choice,
+    typically microseconds. Only differences are used, so the value can wrap around. */
+uint32_t AsebaVMProfilerTime(AsebaVMState* vm);
+#endif  // ASEBA_VM_PROFILER
+
 /*! Called by AsebaVMDebugMessage when VM must write its bytecode to flash, write an empty function
  * to leave feature unsupported */
 void AsebaWriteBytecode(AsebaVMState* vm);
@@ -0,0 +1,198 @@
+#include "compiler/compiler.h"
+#include "common/utils/utils.h"
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Check that the keywords are recognized, and that compiling from a stream, a wide string or an UTF-8 string
+// gives the same result on generated programs using all tokens.
+// Run with --bench to also time the tokenizer on large generated programs.
+
+using namespace Aseba;
+
+// Give access to the tokenizer of the compiler
+class Tokenizer : public Compiler {
+public:
+    using Compiler::tokenize;
+    const std::deque<Token>& getTokens() const {
+        return tokens;
+    }
+};
+
+static const std::vector<std::wstring> keywords = {
+    L"when", L"emit", L"_emit", L"for",  L"in",  L"step",    L"while",   L"do",  L"if",     L"then", L"else", L"elseif",
+    L"end",  L"var",  L"const", L"call", L"sub", L"callsub", L"onevent", L"abs", L"return", L"or",   L"and",  L"not"};
+
+static bool checkKeywords() {
+    bool ok = true;
+    Tokenizer tokenizer;
+    for(const auto& keyword : keywords) {
+        tokenizer.tokenize(keyword);
+        if(!Compiler::isKeyword(keyword) || tokenizer.getTokens().front() == Compiler::Token::TOKEN_STRING_LITERAL) {
+            std::wcerr << L"keyword " << keyword << L" not recognized" << std::endl;
+            ok = false;
+        }
+        // identifiers which share characters with keywords, and thus possibly their hash
+        const std::vector<std::wstring> identifiers = {keyword + L"_", L"_" + keyword, keyword + keyword,
+                                                       keyword.substr(0, 1) + keyword.substr(keyword.size() - 1),
+                                                       keyword.substr(0, keyword.size() - 1) + L"é"};
+        for(const auto& identifier : identifiers) {
+            if(std::find(keywords.begin(), keywords.end(), identifier) != keywords.end())
+                continue;
+            tokenizer.tokenize(identifier);
+            if(Compiler::isKeyword(identifier) ||
+               tokenizer.getTokens().front() != Compiler::Token::TOKEN_STRING_LITERAL) {
+                std::wcerr << L"identifier " << identifier << L" taken for a keyword" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    if(Compiler::isKeyword(L"")) {
+        std::wcerr << L"empty string taken for a keyword" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// A program with as many subroutines as asked, using all tokens, comments and non-ASCII identifiers
+static std::wstring generateProgram(unsigned subroutines) {
+    std::wostringstream program;
+    program << L"#* generated program,\n   using all tokens *#\n"
+               L"const LIMIT = 100\n"
+               L"var counter = 0x1F\n"
+               L"var values[8] = [1, 2, 3, 4, 5, 6, 7, 0b101]\n"
+               L"var température\n"
+               L"var i\n"
+               L"\n"
+               L"onevent pulse\n"
+               L"\twhen counter > LIMIT do\n"
+               L"\t\temit data values\n"
+               L"\tend\n";
+    for(unsigned s = 0; s < subroutines; ++s) {
+        program << L"\n"
+                   L"sub s"
+                << s
+                << L"\n"
+                   L"\t# simple comment\n"
+                   L"\tcounter = (counter + "
+                << s
+                << L") % 0x7F  # counter\n"
+                   L"\tif counter >= 10 and not (counter == 0b101) then\n"
+                   L"\t\tvalues[counter % 8] = -counter << 2\n"
+                   L"\telseif counter != 3 or counter <= 1 then\n"
+                   L"\t\tcounter++\n"
+                   L"\telse\n"
+                   L"\t\tcounter -= abs(values[0]) * 3 / 2\n"
+                   L"\tend\n"
+                   L"\tfor i in 0:7 step 2 do\n"
+                   L"\t\tvalues[i] |= i ^ counter & 0xF\n"
+                   L"\tend\n"
+                   L"\twhile counter > LIMIT do\n"
+                   L"\t\tcounter >>= 1\n"
+                   L"\tend\n"
+                   L"\ttempérature = ~counter >> 1 | counter % 4\n"
+                   L"\tvalues[1:2] += [1, 2]\n"
+                   L"\tcall math.max(counter, counter, température)\n";
+        if(s > 0)
+            program << L"\tcallsub s" << s - 1 << L"\n";
+        program << L"\tif counter < 0 then\n"
+                   L"\t\treturn\n"
+                   L"\tend\n"
+                   L"\t_emit pulse\n";
+    }
+    return program.str();
+}
+
+static TargetDescription targetDescription() {
+    TargetDescription description;
+    description.name = L"tokenizer";
+    description.bytecodeSize = 32768;
+    description.variablesSize = 1024;
+    description.stackSize = 64;
+    TargetDescription::NativeFunction max;
+    max.name = L"math.max";
+    max.parameters = {{L"dest", -1}, {L"src1", -1}, {L"src2", -1}};
+    description.nativeFunctions.push_back(max);
+    return description;
+}
+
+static bool checkPrograms() {
+    const TargetDescription description(targetDescription());
+    CommonDefinitions definitions;
+    definitions.events.emplace_back(L"pulse", 0);
+    definitions.events.emplace_back(L"data", 8);
+
+    bool ok = true;
+    for(const unsigned subroutines : {0, 1, 10, 40}) {
+        const std::wstring program(generateProgram(subroutines));
+        const std::string utf8Program(WStringToUTF8(program));
+
+        Compiler compiler;
+        compiler.setTargetDescription(&description);
+        compiler.setCommonDefinitions(&definitions);
+        std::wistringstream stream(program);
+        BytecodeVector streamBytecode, wideBytecode, utf8Bytecode;
+        unsigned streamVariables = 0, wideVariables = 0, utf8Variables = 0;
+        Error streamError, wideError, utf8Error;
+        const bool streamSuccess = compiler.compile(stream, streamBytecode, streamVariables, streamError);
+        const bool wideSuccess =
+            compiler.compile(std::wstring_view(program), wideBytecode, wideVariables, wideError);
+        const bool utf8Success =
+            compiler.compile(std::string_view(utf8Program), utf8Bytecode, utf8Variables, utf8Error);
+
+        if(!streamSuccess) {
+            std::wcerr << L"compilation of " << subroutines << L" subroutines failed: " << streamError.toWString()
+                       << std::endl;
+            ok = false;
+            continue;
+        }
+        std::vector<uint16_t> streamWords(streamBytecode.begin(), streamBytecode.end());
+        std::vector<uint16_t> wideWords(wideBytecode.begin(), wideBytecode.end());
+        std::vector<uint16_t> utf8Words(utf8Bytecode.begin(), utf8Bytecode.end());
+        if(!wideSuccess || !utf8Success || wideWords != streamWords || utf8Words != streamWords ||
+           wideVariables != streamVariables || utf8Variables != streamVariables) {
+            std::wcerr << L"compilation of " << subroutines << L" subroutines differs between the sources"
+                       << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+template <typename Function>
+static double nanosecondsPerCharacter(Function function, size_t characters) {
+    const unsigned repetitions = 10;
+    const auto start = std::chrono::steady_clock::now();
+    for(unsigned r = 0; r < repetitions; ++r)
+        function();
+    const auto duration = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(duration).count() / (repetitions * characters);
+}
+
+int main(int argc, char* argv[]) {
+    bool ok = checkKeywords();
+    ok = checkPrograms() && ok;
+
+    if(argc > 1 && std::string(argv[1]) == "--bench") {
+        // from a classroom program to much larger ones
+        for(const unsigned subroutines : {10, 100, 1000, 10000}) {
+            const std::wstring program(generateProgram(subroutines));
+            const std::string utf8Program(WStringToUTF8(program));
+            Tokenizer tokenizer;
+            tokenizer.tokenize(program);
+            const double tokenize = nanosecondsPerCharacter([&]() { tokenizer.tokenize(program); }, program.size());
+            const double utf8 = nanosecondsPerCharacter(
+                [&]() { tokenizer.tokenize(UTF8ToWString(utf8Program)); }, program.size());
+            std::cout << "subroutines " << subroutines << "\tcharacters " << program.size() << "\ttokens "
+                      << tokenizer.getTokens().size() << "\ttokenize " << tokenize << "\tfrom UTF-8 " << utf8
+                      << " (ns per character)" << std::endl;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
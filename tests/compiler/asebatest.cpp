@@ -15,6 +15,7 @@ using namespace Aseba;
 #include <fstream>
 #include <sstream>
 #include <valarray>
+#include <vector>
 
 // C
 #include <getopt.h>  // getopt_long()
@@ -24,6 +25,7 @@ using namespace Aseba;
 #define DEFAULT_STEPS 1000
 
 extern "C" bool AsebaExecutionErrorOccurred();
+extern "C" bool AsebaExecutionKilled();
 
 static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] = {ASEBA_NATIVES_STD_DESCRIPTIONS, nullptr};
 
@@ -34,15 +36,18 @@ extern "C" const AsebaNativeFunctionDescription* const* AsebaGetNativeFunctionsD
 // helper function
 std::wstring read_source(const std::string& filename);
 void dump_source(const std::wstring& source);
+void check_incremental_compilation(Compiler& compiler, const CommonDefinitions& definitions,
+                                   const std::wstring& source);
 
-static const char short_options[] = "fcepnvsdumi:";
+static const char short_options[] = "fcepnvsdumi:r";
 static const struct option long_options[] = {
     {"fail", no_argument, nullptr, 'f'},        {"comp_fail", no_argument, nullptr, 'c'},
     {"exec_fail", no_argument, nullptr, 'e'},   {"post_fail", no_argument, nullptr, 'p'},
     {"memcmp_fail", no_argument, nullptr, 'n'}, {"event", no_argument, nullptr, 'v'},
     {"source", no_argument, nullptr, 's'},      {"dump", no_argument, nullptr, 'd'},
     {"memdump", no_argument, nullptr, 'u'},     {"memcmp", required_argument, nullptr, 'm'},
-    {"steps", required_argument, nullptr, 'i'}, {nullptr, 0, nullptr, 0}};
+    {"steps", required_argument, nullptr, 'i'}, {"incremental", no_argument, nullptr, 'r'},
+    {nullptr, 0, nullptr, 0}};
 
 static void usage(int, char** argv) {
     std::cerr << "Usage: " << argv[0] << " [options] source" << std::endl
@@ -58,7 +63,10 @@ static void usage(int, char** argv) {
               << "    -d | --dump         Dump the compilation result (tokens, tree, bytecode)" << std::endl
               << "    -u | --memdump      Dump the memory content at the end of the execution" << std::endl
               << "    -m | --memcmp file  Compare result of the VM execution with file" << std::endl
-              << "    -i | --steps        Number of VM execution steps (default: " << DEFAULT_STEPS << ")" << std::endl;
+              << "    -i | --steps        Number of VM execution steps (default: " << DEFAULT_STEPS << ")" << std::endl
+              << "    -r | --incremental  Compile incrementally, after each line was removed in turn, checking that"
+              << std::endl
+              << "                        the bytecode is the same as when compiling the whole program" << std::endl;
 }
 
 
@@ -66,6 +74,9 @@ struct AsebaNode {
     AsebaVMState vm;
     std::valarray<unsigned short> bytecode;
     std::valarray<signed short> stack;
+#ifdef ASEBA_VM_PREDECODE
+    std::valarray<AsebaVMDecodedInstruction> decoded;
+#endif
     TargetDescription d;
 
     struct Variables {
@@ -78,6 +89,16 @@ struct AsebaNode {
         bytecode.resize(512);
         vm.bytecode = &bytecode[0];
         vm.bytecodeSize = bytecode.size();
+#ifdef ASEBA_VM_PREDECODE
+        decoded.resize(bytecode.size());
+        vm.decoded = &decoded[0];
+#endif
+#ifdef ASEBA_VM_PROFILER
+        vm.profile = nullptr;
+#endif
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+        vm.variablesDirty = nullptr;
+#endif
 
         stack.resize(64);
         vm.stack = &stack[0];
@@ -199,6 +220,7 @@ int main(int argc, char** argv) {
     bool dump = false;
     bool memDump = false;
     bool memCmp = false;
+    bool incremental = false;
     int stepCount = DEFAULT_STEPS;
     std::string memCmpFileName;
 
@@ -236,6 +258,7 @@ int main(int argc, char** argv) {
                 memCmpFileName = optarg;
                 break;
             case 'i': stepCount = atoi(optarg); break;
+            case 'r': incremental = true; break;
             default: usage(argc, argv); exit(EXIT_FAILURE);
         }
     }
@@ -279,6 +302,8 @@ int main(int argc, char** argv) {
     // compile
     compiler.setTargetDescription(node.getTargetDescription());
     compiler.setCommonDefinitions(&definitions);
+    if(incremental)
+        check_incremental_compilation(compiler, definitions, wSource);
     if(dump)
         compiler.compile(ifs, bytecode, varCount, outError, &(std::wcout));
     else
@@ -295,8 +320,8 @@ int main(int argc, char** argv) {
     }
     node.run(stepCount);
 
-    // is execution completed?
-    const bool stillExecuting(node.vm.flags & ASEBA_VM_EVENT_ACTIVE_MASK);
+    // is execution completed? the VM kills the event if it runs out of steps
+    const bool stillExecuting((node.vm.flags & ASEBA_VM_EVENT_ACTIVE_MASK) || AsebaExecutionKilled());
     checkForError("PostInitExecution", should_postexecution_fail, stillExecuting,
                   WFormatableString(L"VM was still running after %0 steps").arg(stepCount));
 
@@ -404,3 +429,52 @@ void dump_source(const std::wstring& source) {
     }
     std::cout << std::endl;
 }
+
+// compile variants of the source incrementally, as if the user was editing it, then the source itself,
+// and check that the results are the same as when compiling the whole program
+void check_incremental_compilation(Compiler& compiler, const CommonDefinitions& definitions,
+                                   const std::wstring& source) {
+    std::vector<std::wstring> lines;
+    std::wistringstream is(source);
+    for(std::wstring line; std::getline(is, line);)
+        lines.push_back(line);
+
+    compiler.setIncrementalCompilation(true);
+    for(size_t removed = 0; removed <= lines.size(); ++removed) {
+        std::wstring variant;
+        for(size_t i = 0; i < lines.size(); ++i)
+            if(i != removed)
+                variant += lines[i] + L"\n";
+
+        Compiler fullCompiler;
+        fullCompiler.setTargetDescription(compiler.getTargetDescription());
+        fullCompiler.setCommonDefinitions(&definitions);
+        std::wistringstream fullSource(variant);
+        BytecodeVector fullBytecode;
+        unsigned fullVarCount = 0;
+        Error fullError;
+        const bool fullSuccess = fullCompiler.compile(fullSource, fullBytecode, fullVarCount, fullError);
+
+        BytecodeVector bytecode;
+        unsigned varCount = 0;
+        Error error;
+        const bool success = compiler.compile(std::wstring_view(variant), bytecode, varCount, error);
+
+        bool same = success == fullSuccess && error.toWString() == fullError.toWString() &&
+            bytecode.size() == fullBytecode.size();
+        if(success && same) {
+            same = varCount == fullVarCount;
+            for(size_t i = 0; i < bytecode.size(); ++i)
+                same = same && bytecode[i].bytecode == fullBytecode[i].bytecode &&
+                    bytecode[i].line == fullBytecode[i].line;
+        }
+        if(!same) {
+            std::cerr << "Incremental compilation differs from full compilation";
+            if(removed < lines.size())
+                std::cerr << " without line " << removed + 1;
+            std::cerr << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::cerr << "Incremental compilation was successful" << std::endl;
+}
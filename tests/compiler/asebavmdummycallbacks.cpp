@@ -27,11 +27,16 @@
 #include <iostream>
 
 static bool executionError(false);
+static bool executionKilled(false);
 
 extern "C" bool AsebaExecutionErrorOccurred() {
     return executionError;
 }
 
+extern "C" bool AsebaExecutionKilled() {
+    return executionKilled;
+}
+
 extern "C" void AsebaSendMessage(AsebaVMState*, uint16_t type, const void*, uint16_t size) {
     switch(type) {
         case ASEBA_MESSAGE_DIVISION_BY_ZERO:
@@ -44,6 +49,11 @@ extern "C" void AsebaSendMessage(AsebaVMState*, uint16_t type, const void*, uint
             executionError = true;
             break;
 
+        case ASEBA_MESSAGE_EVENT_EXECUTION_KILLED:
+            std::cerr << "Event execution killed" << std::endl;
+            executionKilled = true;
+            break;
+
         default: std::cerr << "AsebaSendMessage of type " << type << ", size " << size << std::endl; break;
     }
 }
@@ -82,6 +92,12 @@ extern "C" void AsebaNativeFunction(AsebaVMState* vm, uint16_t id) {
     nativeFunctions[id](vm);
 }
 
+#ifdef ASEBA_VM_PROFILER
+extern "C" uint32_t AsebaVMProfilerTime(AsebaVMState*) {
+    return 0;
+}
+#endif
+
 extern "C" void AsebaWriteBytecode(AsebaVMState*) {
     std::cerr << "AsebaWriteBytecode" << std::endl;
 }
@@ -101,6 +101,55 @@ void testMessageNoInitNoFunc(Args&&... args) {
     testMessage<T>([](T&) {}, {}, args...);
 }
 
+//! Check that the SetBytecode messages built by sendBytecodeChanges turn previous into bytecode,
+//! and that there are as many as expected
+void testBytecodeChanges(const vector<uint16_t>& previous, const vector<uint16_t>& bytecode, size_t expectedCount) {
+    vector<shared_ptr<Message>> messages;
+    sendBytecodeChanges(messages, 1, previous, bytecode);
+
+    vector<uint16_t> result(previous);
+    result.resize(bytecode.size());
+    for(const auto& message : messages) {
+        const auto& setBytecode = dynamic_cast<const SetBytecode&>(*message);
+        if(setBytecode.dest != 1 || setBytecode.start + setBytecode.bytecode.size() > result.size())
+            throw logic_error("SetBytecode message out of the bytecode");
+        copy(setBytecode.bytecode.begin(), setBytecode.bytecode.end(), result.begin() + setBytecode.start);
+    }
+    if(result != bytecode || messages.size() != expectedCount) {
+        cerr << "sendBytecodeChanges built " << messages.size() << " messages instead of " << expectedCount << endl;
+        throw logic_error("Bytecode changes failed");
+    }
+}
+
+void testBytecodeChanges() {
+    const size_t payload = ASEBA_MAX_EVENT_ARG_COUNT - 2;
+    vector<uint16_t> previous(payload * 3);
+    for(size_t i = 0; i < previous.size(); ++i)
+        previous[i] = uint16_t(i);
+
+    testBytecodeChanges(previous, previous, 0);
+    testBytecodeChanges({}, previous, 3);
+
+    auto bytecode = previous;
+    bytecode[10] = 0;
+    testBytecodeChanges(previous, bytecode, 1);
+    // close changes are sent together
+    bytecode[14] = 0;
+    testBytecodeChanges(previous, bytecode, 1);
+    // distant ones are not
+    bytecode[payload * 2] = 0;
+    testBytecodeChanges(previous, bytecode, 2);
+
+    // a longer program
+    bytecode = previous;
+    bytecode.push_back(1);
+    testBytecodeChanges(previous, bytecode, 1);
+    // a shorter one
+    bytecode.resize(payload);
+    bytecode[0] = 1;
+    testBytecodeChanges(previous, bytecode, 1);
+}
+
 int main() {
     // Test the serialization and deserialization of all messages
 
@@ -196,6 +245,16 @@ int main() {
         {[](Variables& m) { m.start = 20; }, [](Variables& m) { m.variables[0] = 3; },
          [](Variables& m) { m.variables[1] = 4; }, [](Variables& m) { m.variables.push_back(5); }});
 
+    testMessage<ProfileData>(
+        [](ProfileData& m) {
+            m.counters = ASEBA_PROFILE_PC_STEPS;
+            m.start = 10;
+            m.values = {1, 0x10000};
+        },
+        {[](ProfileData& m) { m.counters = ASEBA_PROFILE_EVENT_RUNS; }, [](ProfileData& m) { m.start = 20; },
+         [](ProfileData& m) { m.values[0] = 0xffff0001; }, [](ProfileData& m) { m.values[1] = 3; },
+         [](ProfileData& m) { m.values.push_back(5); }});
+
     testMessage<ArrayAccessOutOfBounds>(
         [](ArrayAccessOutOfBounds& m) {
             m.pc = 10;
@@ -303,6 +362,16 @@ int main() {
         {[](GetVariables& m) { m.dest = 3; }, [](GetVariables& m) { m.start = 20; },
          [](GetVariables& m) { m.length = 20; }});
 
+    testMessage<GetProfileData>(
+        [](GetProfileData& m) {
+            m.dest = 1;
+            m.counters = ASEBA_PROFILE_PC_STEPS;
+            m.start = 10;
+            m.length = 10;
+        },
+        {[](GetProfileData& m) { m.dest = 3; }, [](GetProfileData& m) { m.counters = ASEBA_PROFILE_EVENT_STEPS; },
+         [](GetProfileData& m) { m.start = 20; }, [](GetProfileData& m) { m.length = 20; }});
+
     testMessage<SetVariables>(
         [](SetVariables& m) {
             m.dest = 1;
@@ -318,5 +387,7 @@ int main() {
     testMessage<Reboot>([](Reboot& m) { m.dest = 1; }, {[](Reboot& m) { m.dest = 3; }});
     testMessage<Sleep>([](Sleep& m) { m.dest = 1; }, {[](Sleep& m) { m.dest = 3; }});
 
+    testBytecodeChanges();
+
     return 0;
 }
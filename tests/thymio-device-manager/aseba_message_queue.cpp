@@ -0,0 +1,131 @@
+#include <catch2/catch.hpp>
+#include <aseba/thymio-device-manager/aseba_message_queue.h>
+
+namespace {
+
+std::vector<uint16_t> write_all(mobsya::aseba_message_queue& queue) {
+    std::vector<uint16_t> types;
+    while(!queue.empty()) {
+        types.push_back(queue.start_writing()->type);
+        queue.finish_writing();
+    }
+    return types;
+}
+
+std::vector<mobsya::aseba_message_queue::message> upload(uint16_t node) {
+    return {std::make_shared<Aseba::SetBytecode>(node, 0),
+            std::make_shared<Aseba::SetBytecode>(node, 2),
+            std::make_shared<Aseba::Run>(node)};
+}
+
+}  // namespace
+
+TEST_CASE("messages are written by priority", "[aseba_message_queue]") {
+    mobsya::aseba_message_queue queue;
+    queue.push({std::make_shared<Aseba::GetChangedVariables>(1)});
+    queue.push(upload(1));
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_SET_BYTECODE);
+
+    // the user changes a variable of another node and stops it during the upload
+    queue.push({std::make_shared<Aseba::SetVariables>(2, 0, Aseba::VariablesDataVector{1})});
+    queue.push({std::make_shared<Aseba::Stop>(2)});
+    queue.finish_writing();
+    REQUIRE(write_all(queue) ==
+            std::vector<uint16_t>{ASEBA_MESSAGE_STOP, ASEBA_MESSAGE_SET_VARIABLES, ASEBA_MESSAGE_SET_BYTECODE,
+                                  ASEBA_MESSAGE_RUN, ASEBA_MESSAGE_GET_CHANGED_VARIABLES});
+    REQUIRE(queue.statistics().messages == 0);
+}
+
+TEST_CASE("messages to a node being uploaded are written after the upload", "[aseba_message_queue]") {
+    mobsya::aseba_message_queue queue;
+    queue.push({std::make_shared<Aseba::GetChangedVariables>(1)});
+    queue.push(upload(1));
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_SET_BYTECODE);
+
+    // the next SetBytecode resets the vm, which would lose the variable and the stop
+    queue.push({std::make_shared<Aseba::SetVariables>(1, 0, Aseba::VariablesDataVector{1})});
+    queue.push({std::make_shared<Aseba::Stop>(1)});
+    queue.finish_writing();
+    REQUIRE(write_all(queue) ==
+            std::vector<uint16_t>{ASEBA_MESSAGE_SET_BYTECODE, ASEBA_MESSAGE_RUN, ASEBA_MESSAGE_SET_VARIABLES,
+                                  ASEBA_MESSAGE_STOP, ASEBA_MESSAGE_GET_CHANGED_VARIABLES});
+
+    // once the upload is written, control messages have their priority again
+    queue.push({std::make_shared<Aseba::GetChangedVariables>(1)});
+    queue.push({std::make_shared<Aseba::Stop>(1)});
+    REQUIRE(write_all(queue) == std::vector<uint16_t>{ASEBA_MESSAGE_STOP, ASEBA_MESSAGE_GET_CHANGED_VARIABLES});
+}
+
+TEST_CASE("stopping a node uploads the stop program before stopping", "[aseba_message_queue]") {
+    // like aseba_node::set_vm_execution_state(Stop), while a poll is being written
+    mobsya::aseba_message_queue queue;
+    queue.push({std::make_shared<Aseba::GetChangedVariables>(1)});
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_GET_CHANGED_VARIABLES);
+    auto messages = upload(1);
+    messages.pop_back();
+    queue.push(std::move(messages));
+    queue.push({std::make_shared<Aseba::Run>(1)});
+    queue.push({std::make_shared<Aseba::Stop>(1)});
+    queue.finish_writing();
+    REQUIRE(write_all(queue) == std::vector<uint16_t>{ASEBA_MESSAGE_SET_BYTECODE, ASEBA_MESSAGE_SET_BYTECODE,
+                                                      ASEBA_MESSAGE_RUN, ASEBA_MESSAGE_STOP});
+}
+
+TEST_CASE("messages queued together keep their order", "[aseba_message_queue]") {
+    mobsya::aseba_message_queue queue;
+    int calls = 0;
+    queue.push(upload(1), [&calls](boost::system::error_code) { calls++; });
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_SET_BYTECODE);
+    REQUIRE(!queue.finish_writing());
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_SET_BYTECODE);
+    REQUIRE(!queue.finish_writing());
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_RUN);
+    auto cb = queue.finish_writing();
+    REQUIRE(cb);
+    cb({});
+    REQUIRE(calls == 1);
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE("pending polls are not queued again", "[aseba_message_queue]") {
+    mobsya::aseba_message_queue queue;
+    REQUIRE(queue.push({std::make_shared<Aseba::GetChangedVariables>(1)}));
+    REQUIRE(queue.push({std::make_shared<Aseba::GetChangedVariables>(2)}));
+    REQUIRE(!queue.push({std::make_shared<Aseba::GetChangedVariables>(1)}));
+    REQUIRE(queue.push({std::make_shared<Aseba::ListNodes>()}));
+    REQUIRE(!queue.push({std::make_shared<Aseba::ListNodes>()}));
+    REQUIRE(queue.statistics().deduplicated_polls == 2);
+
+    // still pending while being written
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_GET_CHANGED_VARIABLES);
+    REQUIRE(!queue.push({std::make_shared<Aseba::GetChangedVariables>(1)}));
+    queue.finish_writing();
+    REQUIRE(queue.push({std::make_shared<Aseba::GetChangedVariables>(1)}));
+
+    queue.clear();
+    REQUIRE(queue.empty());
+    REQUIRE(!queue.writing());
+    REQUIRE(queue.push({std::make_shared<Aseba::ListNodes>()}));
+}
+
+TEST_CASE("the variables polled by range make one poll", "[aseba_message_queue]") {
+    mobsya::aseba_message_queue queue;
+    auto ranges = [](uint16_t node) -> std::vector<mobsya::aseba_message_queue::message> {
+        return {std::make_shared<Aseba::GetVariables>(node, 0, 4), std::make_shared<Aseba::GetVariables>(node, 10, 2)};
+    };
+    REQUIRE(queue.push(ranges(1)));
+    REQUIRE(queue.push(ranges(2)));
+    REQUIRE(!queue.push(ranges(1)));
+    REQUIRE(!queue.push({std::make_shared<Aseba::GetVariables>(1, 20, 1)}));
+    REQUIRE(queue.statistics().deduplicated_polls == 2);
+    // not a poll when queued with a callback
+    REQUIRE(queue.push({std::make_shared<Aseba::GetVariables>(1, 20, 1)}, [](boost::system::error_code) {}));
+
+    // pending until the last range is written
+    REQUIRE(queue.start_writing()->type == ASEBA_MESSAGE_GET_VARIABLES);
+    queue.finish_writing();
+    REQUIRE(!queue.push(ranges(1)));
+    queue.start_writing();
+    queue.finish_writing();
+    REQUIRE(queue.push(ranges(1)));
+}
@@ -0,0 +1,90 @@
+#include <catch2/catch.hpp>
+#include <aseba/thymio-device-manager/compilation_cache.h>
+
+TEST_CASE("compilation results are cached", "[compilation_cache]") {
+    mobsya::compilation_cache<int> cache(2);
+    const mobsya::compilation_key a{"var a", L"thymio", L""};
+    const mobsya::compilation_key b{"var b", L"thymio", L""};
+    const mobsya::compilation_key c{"var c", L"thymio", L""};
+
+    REQUIRE(!cache.find(a));
+    cache.insert(a, 1);
+    REQUIRE(cache.find(a) == 1);
+    REQUIRE(cache.statistics().hits == 1);
+    REQUIRE(cache.statistics().misses == 1);
+
+    SECTION("the target and the definitions are part of the key") {
+        REQUIRE(!cache.find({"var a", L"dummy", L""}));
+        REQUIRE(!cache.find({"var a", L"thymio", L"ping"}));
+        REQUIRE(cache.statistics().misses == 3);
+    }
+
+    SECTION("the least recently used result is evicted") {
+        cache.insert(b, 2);
+        REQUIRE(cache.find(a) == 1);
+        cache.insert(c, 3);
+        REQUIRE(cache.statistics().entries == 2);
+        REQUIRE(!cache.find(b));
+        REQUIRE(cache.find(a) == 1);
+        REQUIRE(cache.find(c) == 3);
+    }
+
+    SECTION("inserting an existing key replaces its result") {
+        cache.insert(a, 4);
+        REQUIRE(cache.statistics().entries == 1);
+        REQUIRE(cache.find(a) == 4);
+    }
+}
+
+TEST_CASE("common definitions are compared by content", "[compilation_cache]") {
+    Aseba::CommonDefinitions defs;
+    defs.events.emplace_back(L"ping", 1);
+    defs.constants.emplace_back(L"SIZE", 4);
+    Aseba::CommonDefinitions same = defs;
+    REQUIRE(mobsya::definitions_layout(defs) == mobsya::definitions_layout(same));
+
+    Aseba::CommonDefinitions other = defs;
+    other.constants[0].value = 5;
+    REQUIRE(mobsya::definitions_layout(defs) != mobsya::definitions_layout(other));
+
+    // an event is not a constant
+    Aseba::CommonDefinitions swapped;
+    swapped.constants.emplace_back(L"ping", 1);
+    swapped.events.emplace_back(L"SIZE", 4);
+    REQUIRE(mobsya::definitions_layout(defs) != mobsya::definitions_layout(swapped));
+
+    // names are not merged with their neighbours
+    Aseba::CommonDefinitions split;
+    split.events.emplace_back(L"pi", 1);
+    split.events.emplace_back(L"ng", 1);
+    Aseba::CommonDefinitions joined;
+    joined.events.emplace_back(L"p", 1);
+    joined.events.emplace_back(L"ing", 1);
+    REQUIRE(mobsya::definitions_layout(split) != mobsya::definitions_layout(joined));
+}
+
+TEST_CASE("targets are compared by their whole layout", "[compilation_cache]") {
+    Aseba::TargetDescription target;
+    target.bytecodeSize = 1534;
+    target.variablesSize = 1024;
+    target.stackSize = 32;
+    target.namedVariables.emplace_back(L"acc", 3);
+    target.nativeFunctions.push_back({L"math.max", L"", {{L"dest", -1}, {L"src1", -1}, {L"src2", -1}}});
+    const Aseba::TargetDescription same = target;
+    REQUIRE(mobsya::target_layout(target) == mobsya::target_layout(same));
+
+    // the layout does not depend on the documentation
+    Aseba::TargetDescription documented = target;
+    documented.nativeFunctions[0].description = L"maximum of two vectors";
+    REQUIRE(mobsya::target_layout(target) == mobsya::target_layout(documented));
+
+    Aseba::TargetDescription larger = target;
+    larger.namedVariables[0].size = 4;
+    REQUIRE(mobsya::target_layout(target) != mobsya::target_layout(larger));
+
+    // the 16-bit crc of the description cannot tell these targets apart
+    Aseba::TargetDescription colliding = target;
+    colliding.namedVariables[0].name = L"var222";
+    REQUIRE(colliding.crc() == target.crc());
+    REQUIRE(mobsya::target_layout(target) != mobsya::target_layout(colliding));
+}
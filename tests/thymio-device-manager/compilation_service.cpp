@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+#include <aseba/thymio-device-manager/compilation_service.h>
+#include <boost/asio/executor_work_guard.hpp>
+#include <future>
+#include <vector>
+
+namespace {
+using result = tl::expected<int, boost::system::error_code>;
+
+bool aborted(const result& r) {
+    return !r && r.error() == boost::asio::error::operation_aborted;
+}
+}  // namespace
+
+TEST_CASE("a superseded compilation is aborted", "[compilation_service]") {
+    boost::asio::io_context ctx;
+    auto guard = boost::asio::make_work_guard(ctx);
+    auto& service = boost::asio::use_service<mobsya::compilation_service>(ctx);
+
+    std::promise<void> started, superseded;
+    result first, second;
+    int completed = 0;
+    auto count = [&]() {
+        if(++completed == 2)
+            guard.reset();
+    };
+
+    mobsya::compilation_service::cancellation_token token;
+    service.start(
+        token, ctx.get_executor(),
+        [&started, future = superseded.get_future()]() {
+            started.set_value();
+            future.wait();
+            return result(1);
+        },
+        [&](result r) {
+            first = r;
+            count();
+        });
+    const auto first_token = token;
+
+    // a new program is compiled while the first one is still compiling
+    started.get_future().wait();
+    service.start(token, ctx.get_executor(), []() { return result(2); },
+                  [&](result r) {
+                      second = r;
+                      count();
+                  });
+    superseded.set_value();
+    ctx.run();
+
+    REQUIRE(*first_token);
+    REQUIRE(!*token);
+    REQUIRE(aborted(first));
+    REQUIRE(second == 2);
+}
+
+TEST_CASE("a compilation cancelled before its result is handled is aborted", "[compilation_service]") {
+    boost::asio::io_context ctx;
+    auto guard = boost::asio::make_work_guard(ctx);
+    auto& service = boost::asio::use_service<mobsya::compilation_service>(ctx);
+
+    result compiled;
+    mobsya::compilation_service::cancellation_token token;
+    // like aseba_node::compile_and_send_aseba_command, cancel the pending compilation without starting another one
+    service.start(
+        token, ctx.get_executor(),
+        [&token]() {
+            *token = true;
+            return result(1);
+        },
+        [&](result r) {
+            compiled = r;
+            guard.reset();
+        });
+    ctx.run();
+
+    REQUIRE(aborted(compiled));
+}
@@ -0,0 +1,161 @@
+#include <catch2/catch.hpp>
+#include <aseba/thymio-device-manager/app_message_queue.h>
+#include <boost/uuid/uuid_generators.hpp>
+#include <limits>
+
+namespace {
+
+mobsya::app_message_queue::message make_message(std::size_t padding = 0) {
+    flatbuffers::FlatBufferBuilder builder;
+    builder.CreateVector(std::vector<uint8_t>(padding));
+    return std::make_shared<mobsya::tagged_detached_flatbuffer>(
+        mobsya::wrap_fb(builder, mobsya::fb::CreatePing(builder)));
+}
+
+constexpr auto unlimited = std::numeric_limits<std::size_t>::max();
+
+}  // namespace
+
+TEST_CASE("pending variables updates are merged", "[message_queue]") {
+    mobsya::app_message_queue queue(1024 * 1024);
+    const mobsya::node_id id = boost::uuids::random_generator()();
+    const mobsya::node_id other = boost::uuids::random_generator()();
+    std::vector<mobsya::variables_map> serialized;
+    auto serialize = [&serialized](const mobsya::variables_map& values) {
+        serialized.push_back(values);
+        return make_message();
+    };
+    auto push = [&](const mobsya::node_id& node, mobsya::variables_map values) {
+        queue.push_variables(node, make_message(), std::make_shared<mobsya::variables_map>(std::move(values)),
+                             serialize);
+    };
+
+    SECTION("a message being written is never merged") {
+        push(id, {{"a", 1}});
+        REQUIRE(queue.start_writing(unlimited, unlimited).size() == 1);
+        push(id, {{"a", 2}});
+        REQUIRE(queue.size() == 2);
+        REQUIRE(serialized.empty());
+        queue.finish_writing();
+        REQUIRE(queue.size() == 1);
+    }
+
+    SECTION("latest value wins") {
+        queue.push(make_message());
+        push(id, {{"a", 1}, {"b", 1}});
+        push(other, {{"a", 5}});
+        push(id, {{"a", 2}, {"c", 2}});
+        REQUIRE(queue.size() == 3);
+        REQUIRE(queue.statistics().merged == 1);
+        REQUIRE(serialized.size() == 1);
+        REQUIRE(serialized[0].size() == 3);
+        REQUIRE(serialized[0]["a"] == 2);
+        REQUIRE(serialized[0]["b"] == 1);
+        REQUIRE(serialized[0]["c"] == 2);
+
+        // the merged message is being written, it must not be merged into anymore
+        REQUIRE(queue.start_writing(unlimited, unlimited).size() == 3);
+        push(id, {{"a", 3}});
+        REQUIRE(queue.size() == 4);
+        REQUIRE(serialized.size() == 1);
+    }
+}
+
+TEST_CASE("node values are only converted when merged", "[message_queue]") {
+    mobsya::app_message_queue queue(1024 * 1024);
+    const mobsya::node_id id = boost::uuids::random_generator()();
+    const std::vector<int16_t> words{1, 2, 3};
+    int conversions = 0;
+    auto push = [&](int16_t value) {
+        auto snapshot = std::make_shared<mobsya::variables_snapshot>();
+        snapshot->add("a", &value, 1);
+        snapshot->add("b", words.data(), words.size());
+        snapshot->add_null("c");
+        queue.push_variables(
+            id, make_message(),
+            mobsya::app_message_queue::variables_source([snapshot, &conversions] {
+                conversions++;
+                return snapshot->to_variables_map();
+            }),
+            [](const mobsya::variables_map&) { return make_message(); });
+    };
+
+    push(1);
+    REQUIRE(conversions == 0);
+    push(2);
+    REQUIRE(conversions == 2);
+    REQUIRE(queue.size() == 1);
+
+    queue.start_writing(unlimited, unlimited);
+    queue.finish_writing();
+    push(3);
+    push(4);
+    REQUIRE(conversions == 4);
+}
+
+TEST_CASE("variables snapshots", "[message_queue]") {
+    const std::vector<int16_t> words{1, 2, 3};
+    mobsya::variables_snapshot snapshot;
+    snapshot.add("a", words.data(), 1);
+    snapshot.add("b", words.data(), words.size());
+    snapshot.add_null("c");
+    REQUIRE(snapshot.size() == 3);
+
+    auto map = snapshot.to_variables_map();
+    REQUIRE(map.size() == 3);
+    REQUIRE(map["a"].size() == 1);
+    REQUIRE(map["a"][0] == 1);
+    REQUIRE(map["b"].size() == 3);
+    REQUIRE(map["b"][2] == 3);
+    REQUIRE(map["c"].is_null());
+}
+
+TEST_CASE("events are dropped over budget", "[message_queue]") {
+    const auto size = make_message(256)->buffer.size();
+    mobsya::app_message_queue queue(size * 3);
+
+    REQUIRE(queue.push_droppable(make_message(256)));
+    REQUIRE(queue.push_droppable(make_message(256)));
+    REQUIRE(queue.push_droppable(make_message(256)));
+    REQUIRE(!queue.over_budget());
+    REQUIRE(!queue.push_droppable(make_message(256)));
+    REQUIRE(queue.statistics().dropped == 1);
+
+    // messages which must be delivered are queued anyway
+    queue.push(make_message(256));
+    REQUIRE(queue.over_budget());
+    REQUIRE(queue.size() == 4);
+    REQUIRE(queue.statistics().bytes == size * 4);
+    REQUIRE(queue.statistics().peak_bytes == size * 4);
+
+    queue.start_writing(unlimited, unlimited);
+    queue.finish_writing();
+    REQUIRE(queue.empty());
+    REQUIRE(queue.statistics().bytes == 0);
+    REQUIRE(queue.statistics().messages == 0);
+    REQUIRE(queue.statistics().peak_bytes == size * 4);
+}
+
+TEST_CASE("messages are written in batches", "[message_queue]") {
+    const auto size = make_message(100)->buffer.size();
+    mobsya::app_message_queue queue(unlimited);
+    for(int i = 0; i < 6; i++)
+        queue.push(make_message(100));
+
+    REQUIRE(queue.start_writing(2, unlimited).size() == 2);
+    REQUIRE(queue.writing());
+    queue.finish_writing();
+    REQUIRE(!queue.writing());
+    REQUIRE(queue.size() == 4);
+
+    // a message larger than max_bytes is still written alone
+    REQUIRE(queue.start_writing(unlimited, size / 2).size() == 1);
+    queue.finish_writing();
+    // each message comes with a header, the size of a tcp message
+    REQUIRE(queue.start_writing(unlimited, size * 2 + 7, 4).size() == 1);
+    queue.finish_writing();
+    REQUIRE(queue.start_writing(unlimited, size * 2 + 8, 4).size() == 2);
+    queue.finish_writing();
+    REQUIRE(queue.empty());
+    REQUIRE(queue.statistics().bytes == 0);
+}
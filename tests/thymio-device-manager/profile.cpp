@@ -0,0 +1,17 @@
+#include <catch2/catch.hpp>
+#include <aseba/thymio-device-manager/aseba_node.h>
+
+TEST_CASE("profiles can be exported as folded stacks", "[profile]") {
+    mobsya::aseba_node::vm_profile profile;
+
+    SECTION("empty profile") {
+        REQUIRE(profile.folded_stacks().empty());
+    }
+
+    SECTION("one entry per line with steps") {
+        profile.lines.push_back({"onevent button.center", 3, 12, 0});
+        profile.lines.push_back({"sub blink", 7, 40, 250});
+        profile.lines.push_back({"onevent prox", 10, 0, 8});
+        REQUIRE(profile.folded_stacks() == "onevent button.center;line 3 12\nsub blink;line 7 40\n");
+    }
+}
@@ -0,0 +1,210 @@
+#include "transport/buffer/vm-buffer.h"
+#include "vm/vm.h"
+#include "vm/natives.h"
+#include "common/consts.h"
+
+// C++
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Check that tracking the written variables does not change the messages sent by AsebaSendChangedVariables,
+// whether variables are written by the bytecode, by native functions, by debug messages or by the glue.
+
+using Packet = std::vector<uint8_t>;
+
+struct Node {
+    AsebaVMState vm;
+    std::vector<uint16_t> bytecode;
+#ifdef ASEBA_VM_PREDECODE
+    std::vector<AsebaVMDecodedInstruction> decoded;
+#endif
+    std::vector<int16_t> stack;
+    std::vector<int16_t> variables;
+    std::vector<int16_t> variablesOld;
+    std::vector<uint16_t> variablesDirty;
+    std::vector<Packet> sent;
+
+    Node(uint16_t size, bool track) : bytecode(6), stack(8), variables(size), variablesOld(size) {
+        vm.nodeId = 1;
+        vm.bytecode = bytecode.data();
+        vm.bytecodeSize = uint16_t(bytecode.size());
+        vm.stack = stack.data();
+        vm.stackSize = uint16_t(stack.size());
+        vm.variables = variables.data();
+        vm.variablesOld = variablesOld.data();
+        vm.variablesSize = size;
+        vm.userData = this;
+#ifdef ASEBA_VM_PREDECODE
+        decoded.resize(bytecode.size());
+        vm.decoded = decoded.data();
+#endif
+#ifdef ASEBA_VM_PROFILER
+        vm.profile = nullptr;
+#endif
+        variablesDirty.resize(ASEBA_VM_DIRTY_WORDS(size));
+        vm.variablesDirty = track ? variablesDirty.data() : nullptr;
+        AsebaVMInit(&vm);
+    }
+
+    // glue code writing variables
+    void write(uint16_t index, int16_t value) {
+        variables[index] = value;
+        AsebaVMSetVariablesDirty(&vm, index, 1);
+    }
+
+    // a debug message writing variables
+    void setVariables(uint16_t start, const std::vector<int16_t>& values) {
+        std::vector<uint16_t> data{bswap16(vm.nodeId), bswap16(start)};
+        for(const auto value : values)
+            data.push_back(bswap16(uint16_t(value)));
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_SET_VARIABLES, data.data(), uint16_t(data.size()));
+    }
+
+    // bytecode storing a small immediate into a variable, sent like a debugger would
+    void store(uint16_t index, int16_t value) {
+        const uint16_t program[] = {3,
+                                    0,
+                                    3,
+                                    uint16_t((ASEBA_BYTECODE_SMALL_IMMEDIATE << 12) | (uint16_t(value) & 0x0fff)),
+                                    uint16_t((ASEBA_BYTECODE_STORE << 12) | index),
+                                    ASEBA_BYTECODE_STOP << 12};
+        std::vector<uint16_t> data{bswap16(vm.nodeId), 0};
+        for(const auto word : program)
+            data.push_back(bswap16(word));
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_SET_BYTECODE, data.data(), uint16_t(data.size()));
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_RUN, data.data(), 1);
+        AsebaVMSetupEvent(&vm, 0);
+        AsebaVMRun(&vm, 1000);
+        if(variables[index] != value) {
+            std::cerr << "bytecode did not store " << value << " into variable " << index << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // math.fill(dest[start:start+length-1], value)
+    void fill(uint16_t start, uint16_t length, uint16_t valueIndex) {
+        vm.stack[0] = int16_t(length);
+        vm.stack[1] = int16_t(valueIndex);
+        vm.stack[2] = int16_t(start);
+        vm.sp = 2;
+        AsebaNative_vecfill(&vm);
+    }
+
+    std::vector<Packet> getChangedVariables() {
+        sent.clear();
+        uint16_t data = bswap16(vm.nodeId);
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_GET_CHANGED_VARIABLES, &data, 1);
+        return sent;
+    }
+};
+
+static std::mt19937 generator(0xA5EBA);
+
+static unsigned random(unsigned count) {
+    return std::uniform_int_distribution<unsigned>(0, count - 1)(generator);
+}
+
+static bool check(uint16_t size) {
+    Node reference(size, false);
+    Node tracked(size, true);
+    Node* const nodes[] = {&reference, &tracked};
+
+    for(unsigned round = 0; round < 200; ++round) {
+        // a burst of writes, sometimes of the value already there
+        const unsigned writes(random(4) == 0 ? random(size) : random(8));
+        for(unsigned w = 0; w < writes; ++w) {
+            const uint16_t index(uint16_t(random(size)));
+            const int16_t value(int16_t(random(4) == 0 ? reference.variables[index] : random(2048) - 1024));
+            const uint16_t length(uint16_t(std::min<unsigned>(random(40) + 1, size - index)));
+            const uint16_t valueIndex(uint16_t(random(size)));
+            std::vector<int16_t> values(length);
+            for(auto& v : values)
+                v = int16_t(random(2048) - 1024);
+            switch(random(4)) {
+                case 0:
+                    for(auto node : nodes)
+                        node->write(index, value);
+                    break;
+                case 1:
+                    for(auto node : nodes)
+                        node->setVariables(index, values);
+                    break;
+                case 2:
+                    if(index < 4096)
+                        for(auto node : nodes)
+                            node->store(index, value);
+                    break;
+                default:
+                    for(auto node : nodes)
+                        node->fill(index, length, valueIndex);
+                    break;
+            }
+        }
+
+        if(reference.getChangedVariables() != tracked.getChangedVariables() ||
+           reference.variablesOld != tracked.variablesOld) {
+            std::cerr << "changed variables differ for " << size << " variables at round " << round << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    for(const uint16_t size : {1, 15, 16, 17, 255, 256, 257, 300, 1000, 5000})
+        ok = check(size) && ok;
+    return ok ? 0 : 1;
+}
+
+// glue for vm-buffer
+
+static const AsebaVMDescription description = {"test", {{1, "id"}, {1, "source"}, {32, "args"}, {0, nullptr}}};
+static const AsebaLocalEventDescription localEvents[] = {{nullptr, nullptr}};
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] = {nullptr};
+
+extern "C" void AsebaSendBuffer(AsebaVMState* vm, const uint8_t* data, uint16_t length) {
+    static_cast<Node*>(vm->userData)->sent.emplace_back(data, data + length);
+}
+
+extern "C" uint16_t AsebaGetBuffer(AsebaVMState*, uint8_t*, uint16_t, uint16_t*) {
+    return 0;
+}
+
+extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState*) {
+    return &description;
+}
+
+extern "C" const AsebaLocalEventDescription* AsebaGetLocalEventsDescriptions(AsebaVMState*) {
+    return localEvents;
+}
+
+extern "C" const AsebaNativeFunctionDescription* const* AsebaGetNativeFunctionsDescriptions(AsebaVMState*) {
+    return nativeFunctionsDescriptions;
+}
+
+extern "C" void AsebaNativeFunction(AsebaVMState*, uint16_t) {}
+
+extern "C" void AsebaPutVmToSleep(AsebaVMState*) {}
+
+#ifdef ASEBA_VM_PROFILER
+extern "C" uint32_t AsebaVMProfilerTime(AsebaVMState*) {
+    return 0;
+}
+#endif
+
+extern "C" void AsebaWriteBytecode(AsebaVMState*) {}
+
+extern "C" void AsebaResetIntoBootloader(AsebaVMState*) {}
+
+extern "C" int AsebaHandleDeviceInfoMessages(AsebaVMState*, uint16_t, uint16_t*, uint16_t) {
+    return 1;
+}
+
+extern "C" void AsebaAssert(AsebaVMState*, AsebaAssertReason reason) {
+    std::cerr << "VM assertion " << reason << std::endl;
+    std::exit(1);
+}
@@ -0,0 +1,98 @@
+#include "vm/natives.h"
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Check that the sort used by math.sort on hosted builds gives the same result as the comb sort.
+// Run with --bench to also time them on the array sizes found in Aseba programs.
+
+using Vector = std::vector<int16_t>;
+
+static std::mt19937 generator(0xA5EBA);
+
+static Vector randomVector(size_t size, int range) {
+    std::uniform_int_distribution<int> value(-range, range - 1);
+    Vector v(size);
+    for(auto& e : v)
+        e = int16_t(value(generator));
+    return v;
+}
+
+static bool check(const Vector& input) {
+    Vector intro(input);
+    Vector comb(input);
+    Vector reference(input);
+    aseba_intro_sort(intro.data(), uint16_t(intro.size()));
+    aseba_comb_sort(comb.data(), uint16_t(comb.size()));
+    std::sort(reference.begin(), reference.end());
+    if(intro != reference || comb != reference) {
+        std::cerr << "sorting failed for size " << input.size() << ":";
+        for(const auto e : input)
+            std::cerr << " " << e;
+        std::cerr << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static double nanosecondsPerSort(void (*sort)(int16_t*, uint16_t), const std::vector<Vector>& inputs) {
+    const unsigned repetitions = 20;
+    std::chrono::steady_clock::duration duration(0);
+    for(unsigned r = 0; r < repetitions; ++r) {
+        std::vector<Vector> work(inputs);
+        const auto start = std::chrono::steady_clock::now();
+        for(auto& v : work)
+            sort(v.data(), uint16_t(v.size()));
+        duration += std::chrono::steady_clock::now() - start;
+    }
+    return std::chrono::duration<double, std::nano>(duration).count() / (repetitions * inputs.size());
+}
+
+int main(int argc, char* argv[]) {
+    bool ok = true;
+
+    // all permutations of small arrays, which exercise every comparator of the sorting networks
+    for(unsigned size = 0; size <= 9; ++size) {
+        Vector v(size);
+        for(unsigned i = 0; i < size; ++i)
+            v[i] = int16_t(i);
+        do {
+            ok = check(v) && ok;
+        } while(std::next_permutation(v.begin(), v.end()));
+    }
+
+    // random arrays with many or few duplicates, as well as sorted, reversed, organ pipe and constant ones
+    for(unsigned size = 0; size <= 600; ++size) {
+        Vector pipe(size);
+        for(unsigned i = 0; i < size; ++i)
+            pipe[i] = int16_t(std::min(i, size - 1 - i));
+        ok = check(pipe) && ok;
+        ok = check(randomVector(size, 32768)) && ok;
+        ok = check(randomVector(size, 4)) && ok;
+        Vector v(randomVector(size, 32768));
+        std::sort(v.begin(), v.end());
+        ok = check(v) && ok;
+        std::reverse(v.begin(), v.end());
+        ok = check(v) && ok;
+        ok = check(Vector(size, -32768)) && ok;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "--bench") {
+        // median filters over 3 to 9 samples, proximity sensors, buffered sensor windows and sound samples
+        for(const size_t size : {3, 5, 7, 9, 16, 32, 64, 128, 256, 1024}) {
+            std::vector<Vector> inputs;
+            for(unsigned i = 0; i < 100; ++i)
+                inputs.push_back(randomVector(size, 4096));
+            std::cout << "size " << size << "\tcomb sort " << nanosecondsPerSort(aseba_comb_sort, inputs)
+                      << "\tintrosort " << nanosecondsPerSort(aseba_intro_sort, inputs) << " (ns per sort)"
+                      << std::endl;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include "vm/natives_simd.h"
+
+// C++
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Check that all vectorized kernels usable on this processor give the same results as the scalar ones.
+// Run with --bench to also time them against the scalar reference.
+
+using Vector = std::vector<int16_t>;
+
+static const unsigned maxKernels = 8;
+static const uint16_t maxLength = 300;
+
+static std::mt19937 generator(0xA5EBA);
+
+static Vector randomVector(size_t size) {
+    // favour the extreme values, which are the ones that overflow
+    static const int16_t extremes[] = {-32768, -32767, -1, 0, 1, 32766, 32767};
+    std::uniform_int_distribution<int> value(-32768, 32767);
+    std::uniform_int_distribution<int> pick(0, 15);
+    Vector v(size);
+    for(auto& e : v) {
+        const int p = pick(generator);
+        e = p < 7 ? extremes[p] : int16_t(value(generator));
+    }
+    return v;
+}
+
+static bool check(const AsebaVectorKernels& k, const AsebaVectorKernels& ref, uint16_t length) {
+    const AsebaVectorKernels* const kernels[] = {&k, &ref};
+    const Vector a(randomVector(length + 1));
+    const Vector b(randomVector(length + 1));
+    const Vector c(randomVector(length + 1));
+    bool ok = true;
+
+    auto fail = [&](const char* what) {
+        std::cerr << k.name << " " << what << " differs from " << ref.name << " for length " << length << std::endl;
+        ok = false;
+    };
+
+    // element-by-element operations, out of place, in place and overlapping backward
+    using Binary = void (*)(int16_t*, const int16_t*, const int16_t*, uint16_t);
+    const struct {
+        const char* name;
+        Binary kernel[2];
+    } binaries[] = {{"add", {k.add, ref.add}},
+                    {"sub", {k.sub, ref.sub}},
+                    {"mul", {k.mul, ref.mul}},
+                    {"min", {k.min, ref.min}},
+                    {"max", {k.max, ref.max}}};
+    for(const auto& op : binaries) {
+        Vector out[2], inPlace[2], shifted[2];
+        for(unsigned j = 0; j < 2; ++j) {
+            out[j] = Vector(length + 1, 0);
+            op.kernel[j](out[j].data(), a.data(), b.data(), length);
+            inPlace[j] = a;
+            op.kernel[j](inPlace[j].data(), inPlace[j].data(), b.data(), length);
+            shifted[j] = a;
+            op.kernel[j](shifted[j].data(), shifted[j].data() + 1, b.data(), length);
+        }
+        if(out[0] != out[1] || inPlace[0] != inPlace[1] || shifted[0] != shifted[1])
+            fail(op.name);
+    }
+
+    Vector clamped[2];
+    for(unsigned j = 0; j < 2; ++j) {
+        clamped[j] = Vector(length, 0);
+        kernels[j]->clamp(clamped[j].data(), a.data(), b.data(), c.data(), length);
+    }
+    if(clamped[0] != clamped[1])
+        fail("clamp");
+
+    if(k.dot(a.data(), b.data(), length) != ref.dot(a.data(), b.data(), length))
+        fail("dot");
+
+    if(length) {
+        int16_t min[2], max[2];
+        int32_t sum[2];
+        uint16_t argmin[2], argmax[2];
+        for(unsigned j = 0; j < 2; ++j) {
+            sum[j] = kernels[j]->stat(a.data(), length, &min[j], &max[j]);
+            kernels[j]->argbounds(a.data(), length, &argmin[j], &argmax[j]);
+        }
+        if(sum[0] != sum[1] || min[0] != min[1] || max[0] != max[1])
+            fail("stat");
+        if(argmin[0] != argmin[1] || argmax[0] != argmax[1])
+            fail("argbounds");
+    }
+    return ok;
+}
+
+template <typename F>
+static double nanosecondsPerCall(F f) {
+    const unsigned repetitions = 100000;
+    const auto start = std::chrono::steady_clock::now();
+    for(unsigned r = 0; r < repetitions; ++r)
+        f();
+    const auto duration = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(duration).count() / repetitions;
+}
+
+static void bench(const AsebaVectorKernels* const* kernels, unsigned count, uint16_t length) {
+    // all kernels work on the same buffers, so that they see the same memory layout
+    const Vector a(randomVector(length));
+    const Vector b(randomVector(length));
+    const Vector c(randomVector(length));
+    Vector dest(length);
+    int16_t min, max;
+    uint16_t argmin, argmax;
+    volatile int32_t sink = 0;
+
+    for(unsigned i = 0; i < count; ++i) {
+        const AsebaVectorKernels& k(*kernels[i]);
+        std::cout << k.name << "\t" << length;
+        std::cout << "\tadd " << nanosecondsPerCall([&] { k.add(dest.data(), a.data(), b.data(), length); });
+        std::cout << "\tmul " << nanosecondsPerCall([&] { k.mul(dest.data(), a.data(), b.data(), length); });
+        std::cout << "\tclamp "
+                  << nanosecondsPerCall([&] { k.clamp(dest.data(), a.data(), b.data(), c.data(), length); });
+        std::cout << "\tdot " << nanosecondsPerCall([&] { sink = sink + k.dot(a.data(), b.data(), length); });
+        std::cout << "\tstat " << nanosecondsPerCall([&] { sink = sink + k.stat(a.data(), length, &min, &max); });
+        std::cout << "\targbounds " << nanosecondsPerCall([&] {
+            k.argbounds(a.data(), length, &argmin, &argmax);
+            sink = sink + argmin;
+        });
+        std::cout << " (ns per call)" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const AsebaVectorKernels* kernels[maxKernels];
+    const unsigned count = AsebaGetAvailableVectorKernels(kernels, maxKernels);
+    const AsebaVectorKernels& ref(AsebaScalarVectorKernels);
+
+    std::cout << "using " << AsebaGetVectorKernels()->name << " kernels" << std::endl;
+
+    bool ok = true;
+    for(unsigned i = 0; i < count; ++i)
+        for(uint16_t length = 0; length <= maxLength; ++length)
+            ok = check(*kernels[i], ref, length) && ok;
+
+    if(argc > 1 && std::string(argv[1]) == "--bench") {
+        // typical sizes: proximity sensors, ground sensors, microphone/camera lines, and images
+        for(const uint16_t length : {7, 32, 128, 1024})
+            bench(kernels, count, length);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include "compiler/compiler.h"
+#include "targets/playground/VMScheduler.h"
+#include "vm/natives.h"
+#include "vm/vm.h"
+#include "common/consts.h"
+
+// C++
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// Check that stepping nodes with a VMScheduler gives the same variables and math.rand sequences whatever the
+// number of threads, and that the calls deferred by nodes are run in the order in which the nodes were added.
+
+using namespace Aseba;
+
+extern "C" const AsebaNativeFunctionDescription* const* AsebaGetNativeFunctionsDescriptions(AsebaVMState*) {
+    static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] = {ASEBA_NATIVES_STD_DESCRIPTIONS,
+                                                                                  nullptr};
+    return nativeFunctionsDescriptions;
+}
+
+// an event drawing random numbers and doing a varying amount of work depending on them
+static const wchar_t* const program = L"var r[4]\n"
+                                      L"var count\n"
+                                      L"var sum\n"
+                                      L"var i\n"
+                                      L"\n"
+                                      L"onevent tick\n"
+                                      L"\tcall math.rand(r)\n"
+                                      L"\tcount++\n"
+                                      L"\ti = 0\n"
+                                      L"\twhile i < (r[0] & 127) do\n"
+                                      L"\t\tsum = sum + r[i % 4] / 16\n"
+                                      L"\t\ti++\n"
+                                      L"\tend\n";
+
+static const unsigned nodeCount = 29;
+static const unsigned tickCount = 200;
+static const unsigned countIndex = 4;  // address of count, after r
+
+// A VM with its own memory, recording the random numbers drawn at every tick
+class TestNode : public ScheduledNode {
+public:
+    TestNode(uint16_t id, const std::vector<uint16_t>& bytecode, std::vector<uint16_t>& deferredIds)
+        : id(id), bytecode(256), decoded(256), variables(64), variablesOld(64), stack(32), deferredIds(deferredIds) {
+        vm.nodeId = id;
+        vm.bytecode = this->bytecode.data();
+        vm.bytecodeSize = uint16_t(this->bytecode.size());
+#ifdef ASEBA_VM_PREDECODE
+        vm.decoded = decoded.data();
+#endif
+#ifdef ASEBA_VM_PROFILER
+        vm.profile = nullptr;
+#endif
+#ifdef ASEBA_VM_DIRTY_VARIABLES
+        vm.variablesDirty = nullptr;
+#endif
+        vm.variables = variables.data();
+        vm.variablesOld = variablesOld.data();
+        vm.variablesSize = uint16_t(variables.size());
+        vm.stack = stack.data();
+        vm.stackSize = uint16_t(stack.size());
+        AsebaVMInit(&vm);
+
+        // load the program, which resets the VM, and run its initialization; messages start with their destination
+        std::vector<uint16_t> setBytecode{id, 0};
+        setBytecode.insert(setBytecode.end(), bytecode.begin(), bytecode.end());
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_SET_BYTECODE, setBytecode.data(), uint16_t(setBytecode.size()));
+        uint16_t run(id);
+        AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_RUN, &run, 1);
+        AsebaVMRun(&vm, 1000);
+    }
+
+    ~TestNode() override {
+        if(scheduler)
+            scheduler->remove(this);
+    }
+
+    void scheduledStep() override {
+        AsebaVMSetupEvent(&vm, ASEBA_EVENT_LOCAL_EVENTS_START);
+        AsebaVMRun(&vm, 10000);
+        drawn.insert(drawn.end(), variables.begin(), variables.begin() + 4);
+        VMScheduler::defer([this]() { deferredIds.push_back(id); });
+    }
+
+    const uint16_t id;
+    AsebaVMState vm;
+    std::vector<uint16_t> bytecode;
+    std::vector<AsebaVMDecodedInstruction> decoded;
+    std::vector<int16_t> variables;
+    std::vector<int16_t> variablesOld;
+    std::vector<int16_t> stack;
+    std::vector<int16_t> drawn;  //!< content of r after every tick
+    std::vector<uint16_t>& deferredIds;  //!< ids of the nodes whose deferred call ran, shared by all nodes
+};
+
+static std::vector<uint16_t> compileProgram() {
+    TargetDescription description;
+    description.name = L"scheduled";
+    description.bytecodeSize = 256;
+    description.variablesSize = 64;
+    description.stackSize = 32;
+    const AsebaNativeFunctionDescription* const* nativeDescs(AsebaGetNativeFunctionsDescriptions(nullptr));
+    for(; *nativeDescs; ++nativeDescs) {
+        const std::string name((*nativeDescs)->name);
+        TargetDescription::NativeFunction native{std::wstring(name.begin(), name.end()), L"", {}};
+        for(const AsebaNativeFunctionArgumentDescription* param = (*nativeDescs)->arguments; param->size; ++param) {
+            const std::string paramName(param->name);
+            native.parameters.emplace_back(std::wstring(paramName.begin(), paramName.end()), param->size);
+        }
+        description.nativeFunctions.push_back(native);
+    }
+    TargetDescription::LocalEvent tick;
+    tick.name = L"tick";
+    description.localEvents.push_back(tick);
+
+    CommonDefinitions definitions;
+    Compiler compiler;
+    compiler.setTargetDescription(&description);
+    compiler.setCommonDefinitions(&definitions);
+    std::wistringstream source(program);
+    BytecodeVector bytecode;
+    unsigned variablesCount;
+    Error error;
+    if(!compiler.compile(source, bytecode, variablesCount, error)) {
+        std::wcerr << L"compilation failed: " << error.toWString() << std::endl;
+        return {};
+    }
+    return std::vector<uint16_t>(bytecode.begin(), bytecode.end());
+}
+
+struct Result {
+    std::vector<std::vector<int16_t>> variables;
+    std::vector<std::vector<int16_t>> drawn;
+    std::vector<uint16_t> deferredIds;
+};
+
+static Result run(unsigned threadCount, const std::vector<uint16_t>& bytecode, bool& ok) {
+    Result result;
+    // seeds are drawn when nodes are added, start from the same state for every run
+    AsebaSetRandomSeed(0);
+    VMScheduler scheduler(threadCount);
+    if(scheduler.threadCount() != threadCount) {
+        std::cerr << "scheduler runs on " << scheduler.threadCount() << " threads instead of " << threadCount
+                  << std::endl;
+        ok = false;
+    }
+    std::vector<std::unique_ptr<TestNode>> nodes;
+    for(unsigned i = 0; i < nodeCount; ++i) {
+        nodes.emplace_back(new TestNode(uint16_t(i + 1), bytecode, result.deferredIds));
+        scheduler.add(nodes.back().get());
+    }
+
+    for(unsigned tick = 0; tick < tickCount; ++tick) {
+        const size_t deferredBefore(result.deferredIds.size());
+        scheduler.step();
+        for(unsigned i = 0; i < nodeCount; ++i) {
+            if(deferredBefore + i >= result.deferredIds.size() ||
+               result.deferredIds[deferredBefore + i] != nodes[i]->id) {
+                std::cerr << "with " << threadCount << " threads, deferred calls of tick " << tick
+                          << " not run in node order" << std::endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    for(const auto& node : nodes) {
+        result.variables.push_back(node->variables);
+        result.drawn.push_back(node->drawn);
+    }
+    return result;
+}
+
+int main() {
+    const std::vector<uint16_t> bytecode(compileProgram());
+    if(bytecode.empty())
+        return 1;
+
+    bool ok = true;
+    const Result single(run(1, bytecode, ok));
+    const Result parallel(run(4, bytecode, ok));
+
+    for(unsigned i = 0; i < nodeCount; ++i) {
+        if(single.drawn[i] != parallel.drawn[i]) {
+            std::cerr << "math.rand sequence of node " << i + 1 << " depends on the number of threads" << std::endl;
+            ok = false;
+        }
+        if(single.variables[i] != parallel.variables[i]) {
+            std::cerr << "variables of node " << i + 1 << " depend on the number of threads" << std::endl;
+            ok = false;
+        }
+        if(single.variables[i][countIndex] != int16_t(tickCount)) {
+            std::cerr << "node " << i + 1 << " ran its event " << single.variables[i][countIndex] << " times instead of "
+                      << tickCount << std::endl;
+            ok = false;
+        }
+        // nodes are seeded differently, so they must not draw the same numbers
+        if(i > 0 && single.drawn[i] == single.drawn[i - 1]) {
+            std::cerr << "nodes " << i << " and " << i + 1 << " draw the same random numbers" << std::endl;
+            ok = false;
+        }
+    }
+    if(single.deferredIds.size() != nodeCount * tickCount || single.deferredIds != parallel.deferredIds) {
+        std::cerr << "deferred calls depend on the number of threads" << std::endl;
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}